@@ -217,7 +217,8 @@ int main(int argc, char const* argv[])
       loop.addProcessor(std::make_shared<TrackFinder>(
           dev, sensorIds, searchSpatialSigmaMax, searchTemporalSigmaMax,
           sensorIds.size(), redChi2Max));
-      loop.addProcessor(std::make_shared<UnbiasedStraight3dFitter>(dev));
+      loop.addProcessor(
+          std::make_shared<UnbiasedStraight3dFitter>(dev, sensorIds));
       loop.addAnalyzer(std::make_shared<Residuals>(stepDir, dev, sensorIds,
                                                    "unbiased_residuals", 40, 255));
       tracks = std::make_shared<Tracks>(stepDir, dev);
@@ -230,7 +231,8 @@ int main(int argc, char const* argv[])
       loop.addProcessor(std::make_shared<TrackFinder>(
           dev, sensorIds, searchSpatialSigmaMax, searchTemporalSigmaMax,
           sensorIds.size(), redChi2Max));
-      loop.addProcessor(std::make_shared<UnbiasedStraight3dFitter>(dev));
+      loop.addProcessor(
+          std::make_shared<UnbiasedStraight3dFitter>(dev, sensorIds));
       loop.addAnalyzer(std::make_shared<Residuals>(stepDir, dev, sensorIds,
                                                    "unbiased_residuals", 40, 255));
       tracks = std::make_shared<Tracks>(stepDir, dev);
@@ -272,7 +274,8 @@ int main(int argc, char const* argv[])
     loop.addProcessor(std::make_shared<TrackFinder>(
         dev, sensorIds, searchSpatialSigmaMax, searchTemporalSigmaMax,
         sensorIds.size(), redChi2Max));
-    loop.addProcessor(std::make_shared<UnbiasedStraight3dFitter>(dev));
+    loop.addProcessor(
+        std::make_shared<UnbiasedStraight3dFitter>(dev, sensorIds));
 
     // minimal set of analyzers
     loop.addAnalyzer(std::make_shared<GlobalOccupancy>(subDir, dev));
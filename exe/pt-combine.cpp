@@ -59,9 +59,11 @@ int main(int argc, char const* argv[])
   INFO("read configuration '", section, "' from '", args.get("config"), "'");
 
   // open reader and writer
+  // optional reader settings as for the other tools
+  const toml::Value* cfgReader = cfg->find("reader");
   std::vector<std::shared_ptr<Reader>> readers;
   for (const auto& path : args.get<std::vector<std::string>>("input"))
-    readers.push_back(openRead(path, *cfg));
+    readers.push_back(openRead(path, cfgReader ? *cfgReader : toml::Value()));
   auto merger = std::make_shared<EventMerger>(readers);
   auto writer =
       std::make_shared<RceRootWriter>(args.get("output"), merger->numSensors());
@@ -24,26 +24,37 @@ int main(int argc, char const* argv[])
 {
   using namespace proteus;
 
-  Application app("match", "match tracks and clusters");
+  toml::Table defaults = {
+      // no distance cut by default for backward compatibility
+      {"distance_sigma_max", -1.},
+      {"optimal_assignment", false},
+  };
+  Application app("match", "match tracks and clusters", defaults);
   app.initialize(argc, argv);
 
   // configuration
-  auto sensorIds = app.config().get<std::vector<Index>>("sensor_ids");
+  const auto& cfg = app.config();
+  auto sensorIds = cfg.get<std::vector<Index>>("sensor_ids");
+  auto distanceSigmaMax = cfg.get<double>("distance_sigma_max");
+  auto optimalAssignment = cfg.get<bool>("optimal_assignment");
   // output
   auto hists = openRootWrite(app.outputPath("hists.root"));
-  auto trees = openRootWrite(app.outputPath("trees.root"));
+  auto writeOptions = app.writeOptions();
+  auto trees = openRootWrite(app.outputPath("trees.root"), writeOptions);
 
   auto loop = app.makeEventLoop();
   setupPerSensorProcessing(app.device(), loop);
   for (auto sensorId : sensorIds)
-    loop.addProcessor(std::make_shared<Matcher>(app.device(), sensorId));
+    loop.addProcessor(std::make_shared<Matcher>(
+        app.device(), sensorId, distanceSigmaMax, optimalAssignment));
   loop.addAnalyzer(std::make_shared<Tracks>(hists.get(), app.device()));
   for (auto sensorId : sensorIds) {
     const auto& sensor = app.device().getSensor(sensorId);
     loop.addAnalyzer(std::make_shared<Distances>(hists.get(), sensor));
     loop.addAnalyzer(std::make_shared<Matching>(hists.get(), sensor));
     loop.addAnalyzer(std::make_shared<Efficiency>(hists.get(), sensor));
-    loop.addWriter(std::make_shared<MatchWriter>(trees.get(), sensor));
+    loop.addWriter(
+        std::make_shared<MatchWriter>(trees.get(), sensor, writeOptions));
   }
   loop.run();
 
@@ -1,6 +1,8 @@
 // Copyright (c) 2014-2019 The Proteus authors
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
+
 #include <Compression.h>
 #include <TFile.h>
 #include <TTree.h>
@@ -19,6 +21,8 @@
 #include "processors/matcher.h"
 #include "processors/setupsensors.h"
 #include "storage/event.h"
+#include "tracking/cellularfinder.h"
+#include "tracking/houghfinder.h"
 #include "tracking/setupfitter.h"
 #include "tracking/trackfinder.h"
 #include "utils/application.h"
@@ -35,6 +39,12 @@ int main(int argc, char const* argv[])
       {"search_temporal_sigma_max", -1.},
       {"num_points_min", 3},
       {"reduced_chi2_max", -1.},
+      // search pruning is disabled by default for backward compatibility
+      {"search_candidates_max", -1},
+      {"search_reduced_chi2_max", -1.},
+      // single-cluster seeds by default for backward compatibility
+      {"seed_size", 1},
+      {"track_finder", "combinatorial"},
       {"track_fitter", "straight3d"},
   };
   Application app("recon", "preprocess, cluster, and track", defaults);
@@ -53,11 +63,16 @@ int main(int argc, char const* argv[])
   auto searchTemporalSigmaMax = cfg.get<double>("search_temporal_sigma_max");
   auto numPointsMin = cfg.get<int>("num_points_min");
   auto redChi2Max = cfg.get<double>("reduced_chi2_max");
+  auto searchCandidatesMax = cfg.get<int>("search_candidates_max");
+  auto searchRedChi2Max = cfg.get<double>("search_reduced_chi2_max");
+  auto seedSize = cfg.get<int>("seed_size");
+  auto finder = cfg.get<std::string>("track_finder");
   auto fitter = cfg.get<std::string>("track_fitter");
 
   // output
   auto hists = openRootWrite(app.outputPath("hists.root"));
-  auto trees = openRootWrite(app.outputPath("trees.root"));
+  auto writeOptions = app.writeOptions();
+  auto trees = openRootWrite(app.outputPath("trees.root"), writeOptions);
 
   auto loop = app.makeEventLoop();
 
@@ -72,10 +87,29 @@ int main(int argc, char const* argv[])
   loop.addAnalyzer(std::make_shared<Correlations>(hists.get(), app.device()));
 
   // tracking
-  loop.addProcessor(std::make_shared<TrackFinder>(
-      app.device(), trackingIds, searchSpatialSigmaMax, searchTemporalSigmaMax,
-      numPointsMin, redChi2Max));
-  setupTrackFitter(app.device(), fitter, loop);
+  if (finder == "combinatorial") {
+    loop.addProcessor(std::make_shared<TrackFinder>(
+        app.device(), trackingIds, searchSpatialSigmaMax,
+        searchTemporalSigmaMax, numPointsMin, redChi2Max, searchCandidatesMax,
+        searchRedChi2Max, seedSize));
+  } else if (finder == "cellular") {
+    loop.addProcessor(std::make_shared<CellularFinder>(
+        app.device(), trackingIds, searchSpatialSigmaMax, numPointsMin,
+        redChi2Max));
+  } else if (finder == "hough") {
+    loop.addProcessor(std::make_shared<HoughFinder>(
+        app.device(), trackingIds, searchSpatialSigmaMax, numPointsMin,
+        redChi2Max));
+  } else {
+    FAIL("unknown configured track finder '", finder, "'");
+  }
+  // local track states are only needed on the tracking and matched sensors
+  std::vector<Index> fitIds = trackingIds;
+  fitIds.insert(fitIds.end(), extrapolationIds.begin(), extrapolationIds.end());
+  // sensors can be used both for tracking and as extrapolation targets
+  std::sort(fitIds.begin(), fitIds.end());
+  fitIds.erase(std::unique(fitIds.begin(), fitIds.end()), fitIds.end());
+  setupTrackFitter(app.device(), fitter, fitIds, loop);
   loop.addAnalyzer(std::make_shared<Tracks>(hists.get(), app.device()));
   loop.addAnalyzer(
       std::make_shared<Residuals>(hists.get(), app.device(), trackingIds));
@@ -87,7 +121,8 @@ int main(int argc, char const* argv[])
     loop.addAnalyzer(std::make_shared<Distances>(hists.get(), sensor));
     loop.addAnalyzer(std::make_shared<Matching>(hists.get(), sensor));
     loop.addAnalyzer(std::make_shared<Efficiency>(hists.get(), sensor));
-    loop.addWriter(std::make_shared<MatchWriter>(trees.get(), sensor));
+    loop.addWriter(
+        std::make_shared<MatchWriter>(trees.get(), sensor, writeOptions));
   }
 
   loop.run();
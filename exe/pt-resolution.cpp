@@ -153,7 +153,7 @@ int main(int argc, char const* argv[])
   // of the measurements. the resulting fit uncertainties from fitting a
   // perfect track are therefore a reasonable estimator of the expected
   // reconstruction uncertainties.
-  GblFitter fitter(device);
+  GblFitter fitter(device, device.sensorIds());
   fitter.execute(event);
 
   printResolutionTable(device, event, std::cout);
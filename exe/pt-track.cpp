@@ -21,6 +21,8 @@
 #include "mechanics/device.h"
 #include "processors/setupsensors.h"
 #include "storage/event.h"
+#include "tracking/cellularfinder.h"
+#include "tracking/houghfinder.h"
 #include "tracking/setupfitter.h"
 #include "tracking/trackfinder.h"
 #include "utils/application.h"
@@ -37,6 +39,12 @@ int main(int argc, char const* argv[])
       {"search_temporal_sigma_max", -1.},
       {"num_points_min", 3},
       {"reduced_chi2_max", -1.},
+      // search pruning is disabled by default for backward compatibility
+      {"search_candidates_max", -1},
+      {"search_reduced_chi2_max", -1.},
+      // single-cluster seeds by default for backward compatibility
+      {"seed_size", 1},
+      {"track_finder", "combinatorial"},
       {"track_fitter", "straight3d"},
   };
   Application app("recon", "preprocess, cluster, and track", defaults);
@@ -54,6 +62,10 @@ int main(int argc, char const* argv[])
   auto searchTemporalSigmaMax = cfg.get<double>("search_temporal_sigma_max");
   auto numPointsMin = cfg.get<int>("num_points_min");
   auto redChi2Max = cfg.get<double>("reduced_chi2_max");
+  auto searchCandidatesMax = cfg.get<int>("search_candidates_max");
+  auto searchRedChi2Max = cfg.get<double>("search_reduced_chi2_max");
+  auto seedSize = cfg.get<int>("seed_size");
+  auto finder = cfg.get<std::string>("track_finder");
   auto fitter = cfg.get<std::string>("track_fitter");
 
   // output
@@ -72,17 +84,33 @@ int main(int argc, char const* argv[])
   loop.addAnalyzer(std::make_shared<Correlations>(hists.get(), app.device()));
 
   // tracking
-  loop.addProcessor(std::make_shared<TrackFinder>(
-      app.device(), sensorIds, searchSpatialSigmaMax, searchTemporalSigmaMax,
-      numPointsMin, redChi2Max));
-  setupTrackFitter(app.device(), fitter, loop);
+  if (finder == "combinatorial") {
+    loop.addProcessor(std::make_shared<TrackFinder>(
+        app.device(), sensorIds, searchSpatialSigmaMax,
+        searchTemporalSigmaMax, numPointsMin, redChi2Max, searchCandidatesMax,
+        searchRedChi2Max, seedSize));
+  } else if (finder == "cellular") {
+    loop.addProcessor(std::make_shared<CellularFinder>(
+        app.device(), sensorIds, searchSpatialSigmaMax, numPointsMin,
+        redChi2Max));
+  } else if (finder == "hough") {
+    loop.addProcessor(std::make_shared<HoughFinder>(
+        app.device(), sensorIds, searchSpatialSigmaMax, numPointsMin,
+        redChi2Max));
+  } else {
+    FAIL("unknown configured track finder '", finder, "'");
+  }
+  // the output data is used e.g. for later matching and must contain local
+  // track states on all sensors
+  setupTrackFitter(app.device(), fitter, app.device().sensorIds(), loop);
   loop.addAnalyzer(std::make_shared<Tracks>(hists.get(), app.device()));
   loop.addAnalyzer(
       std::make_shared<Residuals>(hists.get(), app.device(), sensorIds));
 
   // data writing
   loop.addWriter(std::make_shared<RceRootWriter>(app.outputPath("data.root"),
-                                                 app.device().numSensors()));
+                                                 app.device().numSensors(),
+                                                 app.writeOptions()));
 
   loop.run();
 
@@ -251,7 +251,7 @@ void LocalChi2Aligner::execute(const Event& event)
 
       // unbiased residuals have a contribution from
       // the cluster uncertainty and the tracking uncertainty
-      SymMatrix2 weight = (cluster.uvCov() + state.loc01Cov()).inverse();
+      SymMatrix2 weight = symmetricInverse(cluster.uvCov() + state.loc01Cov());
       if (!fitter.addTrack(state, cluster, weight)) {
         WARN("Invalid track/cluster input event=", event.frame(),
              " sensor=", sensorId, " track=", cluster.track());
@@ -22,7 +22,7 @@ Correlations::Correlations(TDirectory* dir,
                            const Device& dev,
                            const std::vector<Index>& sensorIds,
                            const int neighbors)
-    : m_geo(dev.geometry())
+    : m_geo(dev.compiledGeometry())
 {
   if (sensorIds.size() < 2)
     FAIL("need at least two sensors but ", sensorIds.size(), " given");
@@ -102,11 +102,16 @@ void Correlations::execute(const Event& event)
     const SensorEvent& sensor0 = event.getSensorEvent(id0);
     const SensorEvent& sensor1 = event.getSensorEvent(id1);
 
+    // transform the second sensor clusters only once and not for each pair
+    m_global1.resize(sensor1.numClusters());
+    for (Index c1 = 0; c1 < sensor1.numClusters(); ++c1) {
+      m_global1[c1] = plane1.toGlobal(sensor1.getCluster(c1).position());
+    }
+
     for (Index c0 = 0; c0 < sensor0.numClusters(); ++c0) {
       Vector4 global0 = plane0.toGlobal(sensor0.getCluster(c0).position());
 
-      for (Index c1 = 0; c1 < sensor1.numClusters(); ++c1) {
-        Vector4 global1 = plane1.toGlobal(sensor1.getCluster(c1).position());
+      for (const Vector4& global1 : m_global1) {
 
         hist.corrX->Fill(global0[kX], global1[kX]);
         hist.corrY->Fill(global0[kY], global1[kY]);
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <map>
+#include <vector>
 
 #include <TH1D.h>
 
@@ -16,7 +17,7 @@ class TH2D;
 namespace proteus {
 
 class Device;
-class Geometry;
+class CompiledGeometry;
 class Sensor;
 
 class Correlations : public Analyzer {
@@ -61,8 +62,10 @@ private:
     TH1D* diffT = nullptr;
   };
 
-  const Geometry& m_geo;
+  const CompiledGeometry& m_geo;
   std::map<std::pair<Index, Index>, Hists> m_hists;
+  // global cluster positions on the second sensor, reused between events
+  std::vector<Vector4> m_global1;
 };
 
 } // namespace proteus
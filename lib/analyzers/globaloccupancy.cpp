@@ -15,7 +15,7 @@
 namespace proteus {
 
 GlobalOccupancy::GlobalOccupancy(TDirectory* dir, const Device& device)
-    : m_geo(device.geometry())
+    : m_geo(device.compiledGeometry())
 {
   auto box = device.boundingBox();
   // create per-sensor histograms
@@ -32,7 +32,7 @@ private:
     TH1D* clustersT = nullptr;
   };
 
-  const Geometry& m_geo;
+  const CompiledGeometry& m_geo;
   std::vector<SensorHists> m_sensorHists;
 };
 
@@ -13,6 +13,7 @@
 #include "mechanics/sensor.h"
 #include "storage/event.h"
 #include "utils/logger.h"
+#include "utils/root.h"
 
 namespace proteus {
 
@@ -166,6 +167,13 @@ void MatchWriter::DistData::addToTree(TTree* tree)
 }
 
 MatchWriter::MatchWriter(TDirectory* dir, const Sensor& sensor)
+    : MatchWriter(dir, sensor, RootWriteOptions())
+{
+}
+
+MatchWriter::MatchWriter(TDirectory* dir,
+                         const Sensor& sensor,
+                         const RootWriteOptions& options)
     : m_sensor(sensor)
     , m_sensorId(sensor.id())
     , m_name("MatchWriter(" + sensor.name() + ')')
@@ -179,11 +187,13 @@ MatchWriter::MatchWriter(TDirectory* dir, const Sensor& sensor)
   m_track.addToTree(m_matchedTree);
   m_matchedCluster.addToTree(m_matchedTree);
   m_matchedDist.addToTree(m_matchedTree);
+  setupTreeWrite(m_matchedTree, options);
 
   m_unmatchTree = new TTree("clusters_unmatched", "");
   m_unmatchTree->SetDirectory(sub);
   m_event.addToTree(m_unmatchTree);
   m_unmatchCluster.addToTree(m_unmatchTree);
+  setupTreeWrite(m_unmatchTree, options);
 
   // pixel masks
   TTree* treeMask = new TTree("masked_pixels", "");
@@ -21,6 +21,7 @@ namespace proteus {
 
 class Cluster;
 class Event;
+struct RootWriteOptions;
 class Track;
 class TrackState;
 class Sensor;
@@ -30,6 +31,10 @@ class SensorEvent;
 class MatchWriter : public Writer {
 public:
   MatchWriter(TDirectory* dir, const Sensor& sensor);
+  /** Write w/ non-default basket and flush settings for the trees. */
+  MatchWriter(TDirectory* dir,
+              const Sensor& sensor,
+              const RootWriteOptions& options);
 
   std::string name() const override final;
   void append(const Event& event) override final;
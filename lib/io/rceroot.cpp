@@ -3,11 +3,15 @@
 
 #include "rceroot.h"
 
+#include <algorithm>
 #include <cassert>
 
+#include <TTreeCache.h>
+
 #include "Compression.h"
 
 #include "storage/event.h"
+#include "utils/config.h"
 #include "utils/logger.h"
 
 namespace proteus {
@@ -21,12 +25,178 @@ RceRootCommon::RceRootCommon(RootFilePtr&& file)
     , m_next(0)
     , m_eventInfo(nullptr)
     , m_tracks(nullptr)
+    , m_tracksCount(nullptr)
+{
+}
+
+void RceRootCommon::resizeTracks(size_t numTracks)
+{
+  trackChi2.resize(numTracks);
+  trackDof.resize(numTracks);
+  trackX.resize(numTracks);
+  trackY.resize(numTracks);
+  trackSlopeX.resize(numTracks);
+  trackSlopeY.resize(numTracks);
+  trackCov.resize(numTracks);
+}
+
+void RceRootCommon::resizeHits(size_t numHits)
+{
+  hitPixX.resize(numHits);
+  hitPixY.resize(numHits);
+  hitTiming.resize(numHits);
+  hitValue.resize(numHits);
+  hitInCluster.resize(numHits);
+}
+
+void RceRootCommon::resizeClusters(size_t numClusters)
+{
+  clusterCol.resize(numClusters);
+  clusterRow.resize(numClusters);
+  clusterVarCol.resize(numClusters);
+  clusterVarRow.resize(numClusters);
+  clusterCovColRow.resize(numClusters);
+  clusterTiming.resize(numClusters);
+  clusterValue.resize(numClusters);
+  clusterTrack.resize(numClusters);
+}
+
+void RceRootCommon::resizeIntercepts(size_t numIntercepts)
 {
+  interceptU.resize(numIntercepts);
+  interceptV.resize(numIntercepts);
+  interceptSlopeU.resize(numIntercepts);
+  interceptSlopeV.resize(numIntercepts);
+  interceptCov.resize(numIntercepts);
+  interceptTrack.resize(numIntercepts);
 }
 
 // -----------------------------------------------------------------------------
 // reader
 
+namespace {
+
+// Disable all branches and setup the read cache w/o any branches.
+void prepareTree(TTree* tree, const RceRootReader::Options& options)
+{
+  tree->SetBranchStatus("*", false);
+  tree->SetCacheSize(std::max<int64_t>(0, options.cacheSize));
+  if ((0 < options.cacheSize) && (0 < options.cacheLearnEntries))
+    tree->SetCacheLearnEntries(options.cacheLearnEntries);
+}
+
+// maximum number of entries that are decoded at once for each tree
+constexpr int64_t kRangeEntries = 4096;
+
+// Enable a single branch and connect it to the buffer.
+template <typename T>
+TBranch* connectBranch(TTree* tree,
+                       const char* name,
+                       T* buffer,
+                       const RceRootReader::Options& options)
+{
+  TBranch* branch = tree->GetBranch(name);
+  if (!branch)
+    THROW("could not find branch '", name, "' in '", tree->GetName(), "'");
+  tree->SetBranchStatus(name, true);
+  tree->SetBranchAddress(name, buffer);
+  // w/o learning, all enabled branches are prefetched from the beginning
+  if ((0 < options.cacheSize) && (options.cacheLearnEntries <= 0))
+    tree->AddBranchToCache(name);
+  return branch;
+}
+
+// Enable a single variable-length branch and connect it to the buffer.
+template <typename Buffer>
+TBranch* connectBuffer(TTree* tree,
+                       const char* name,
+                       Buffer& buffer,
+                       const RceRootReader::Options& options)
+{
+  TBranch* branch = tree->GetBranch(name);
+  if (!branch)
+    THROW("could not find branch '", name, "' in '", tree->GetName(), "'");
+  tree->SetBranchStatus(name, true);
+  buffer.connect(branch);
+  // w/o learning, all enabled branches are prefetched from the beginning
+  if ((0 < options.cacheSize) && (options.cacheLearnEntries <= 0))
+    tree->AddBranchToCache(name);
+  return branch;
+}
+
+// Enable a single variable-length branch and decode it into the column.
+template <typename Buffer, typename Column>
+void connectColumn(TTree* tree,
+                   const char* name,
+                   Buffer& buffer,
+                   Column& column,
+                   const RceRootReader::Options& options)
+{
+  column.connect(connectBuffer(tree, name, buffer, options));
+}
+
+// Read only the number of elements in the entry.
+void readCount(TBranch* count, int64_t ientry)
+{
+  if (count->GetEntry(ientry) <= 0)
+    FAIL("could not read '", count->GetName(), "' entry ", ientry);
+}
+
+// Finalize the read cache after all branches have been connected.
+void finishTree(TTree* tree, const RceRootReader::Options& options)
+{
+  if ((0 < options.cacheSize) && (options.cacheLearnEntries <= 0))
+    tree->StopCacheLearningPhase();
+}
+
+} // namespace
+
+void RceRootReader::EntryRange::setup(TTree* tree,
+                                      TBranch* count,
+                                      const Int_t* countValue,
+                                      int64_t maxEntries)
+{
+  m_tree = tree;
+  m_count = count;
+  m_countValue = countValue;
+  m_maxEntries = maxEntries;
+}
+
+void RceRootReader::EntryRange::load(int64_t ientry)
+{
+  // stay within the cluster so every basket is decompressed only once
+  TTree::TClusterIterator clusters = m_tree->GetClusterIterator(ientry);
+  clusters.Next();
+  m_begin = ientry;
+  m_end = std::min<int64_t>(clusters.GetNextEntry(), ientry + m_maxEntries);
+  m_end = std::max(m_end, ientry + 1);
+
+  m_offsets.resize(1);
+  m_maxSize = 0;
+  for (int64_t i = m_begin; i < m_end; ++i) {
+    size_t size = 1;
+    if (m_count) {
+      readCount(m_count, i);
+      size = static_cast<size_t>(std::max<Int_t>(0, *m_countValue));
+    }
+    m_offsets.push_back(m_offsets.back() + size);
+    m_maxSize = std::max(m_maxSize, size);
+  }
+}
+
+template <typename T, size_t kWidth>
+void RceRootReader::Column<T, kWidth>::read(const EntryRange& range,
+                                            const T* storage)
+{
+  m_values.resize(kWidth * range.numElements());
+  for (int64_t ientry = range.begin(); ientry < range.end(); ++ientry) {
+    if (m_branch->GetEntry(ientry) < 0)
+      FAIL("could not read '", m_branch->GetName(), "' entry ", ientry);
+    std::copy_n(storage, kWidth * range.size(ientry),
+                m_values.data() + kWidth * range.offset(ientry));
+  }
+}
+
 int RceRootReader::check(const std::string& path)
 {
   std::unique_ptr<TFile> file(TFile::Open(path.c_str(), "READ"));
@@ -44,15 +214,46 @@ int RceRootReader::check(const std::string& path)
 }
 
 std::shared_ptr<RceRootReader>
-RceRootReader::open(const std::string& path,
-                    const toml::Value& /* unused configuration */)
+RceRootReader::open(const std::string& path, const toml::Value& cfg)
 {
-  return std::make_shared<RceRootReader>(path);
+  Options defaults;
+  toml::Value combined = toml::Table{
+      {"read_hits", defaults.readHits},
+      {"read_clusters", defaults.readClusters},
+      {"read_intercepts", defaults.readIntercepts},
+      {"read_tracks", defaults.readTracks},
+      {"cache_size", defaults.cacheSize},
+      {"cache_learn_entries", defaults.cacheLearnEntries},
+  };
+  // configuration is optional
+  if (cfg.is<toml::Table>())
+    combined = configWithDefaults(cfg, combined);
+
+  Options options;
+  options.readHits = combined.get<bool>("read_hits");
+  options.readClusters = combined.get<bool>("read_clusters");
+  options.readIntercepts = combined.get<bool>("read_intercepts");
+  options.readTracks = combined.get<bool>("read_tracks");
+  options.cacheSize = combined.get<int64_t>("cache_size");
+  options.cacheLearnEntries = combined.get<int>("cache_learn_entries");
+  return std::make_shared<RceRootReader>(path, options);
 }
 
 RceRootReader::RceRootReader(const std::string& path)
+    : RceRootReader(path, Options())
+{
+}
+
+RceRootReader::RceRootReader(const std::string& path, const Options& options)
     : RceRootCommon(openRootRead(path.c_str()))
+    , m_options(options)
+    , m_rangeEntries(kRangeEntries)
 {
+  // all branches must be read within the learning phase of the cache
+  if ((0 < m_options.cacheSize) && (0 < m_options.cacheLearnEntries))
+    m_rangeEntries = std::min<int64_t>(m_rangeEntries,
+                                       m_options.cacheLearnEntries);
+
   int64_t entriesEvent = INT64_MAX;
   int64_t entriesTracks = INT64_MAX;
 
@@ -62,26 +263,37 @@ RceRootReader::RceRootReader(const std::string& path)
     entriesEvent = m_eventInfo->GetEntriesFast();
     if (entriesEvent < 0)
       THROW("could not determine number of entries of Event tree");
-    m_eventInfo->SetBranchAddress("FrameNumber", &frameNumber);
-    m_eventInfo->SetBranchAddress("TimeStamp", &timestamp);
-    m_eventInfo->SetBranchAddress("TriggerTime", &triggerTime);
-    m_eventInfo->SetBranchAddress("Invalid", &invalid);
+    prepareTree(m_eventInfo, m_options);
+    // the unix timestamp and the invalid flag are not used
+    m_global.frameNumber.connect(connectBranch(m_eventInfo, "FrameNumber",
+                                               &frameNumber, m_options));
+    m_global.triggerTime.connect(connectBranch(m_eventInfo, "TriggerTime",
+                                               &triggerTime, m_options));
+    finishTree(m_eventInfo, m_options);
+    m_global.event.setup(m_eventInfo, nullptr, nullptr, m_rangeEntries);
   }
 
   // tracks tree is optional
-  m_file->GetObject("Tracks", m_tracks);
+  if (m_options.readTracks)
+    m_file->GetObject("Tracks", m_tracks);
   if (m_tracks) {
     entriesTracks = m_tracks->GetEntriesFast();
     if (entriesTracks < 0)
       THROW("could not determine number of entries in Tracks tree");
-    m_tracks->SetBranchAddress("NTracks", &numTracks);
-    m_tracks->SetBranchAddress("Chi2", trackChi2);
-    m_tracks->SetBranchAddress("Dof", trackDof);
-    m_tracks->SetBranchAddress("X", trackX);
-    m_tracks->SetBranchAddress("Y", trackY);
-    m_tracks->SetBranchAddress("SlopeX", trackSlopeX);
-    m_tracks->SetBranchAddress("SlopeY", trackSlopeY);
-    m_tracks->SetBranchAddress("Cov", trackCov);
+    prepareTree(m_tracks, m_options);
+    m_tracksCount = connectBranch(m_tracks, "NTracks", &numTracks, m_options);
+    connectColumn(m_tracks, "Chi2", trackChi2, m_global.trackChi2, m_options);
+    connectColumn(m_tracks, "Dof", trackDof, m_global.trackDof, m_options);
+    connectColumn(m_tracks, "X", trackX, m_global.trackX, m_options);
+    connectColumn(m_tracks, "Y", trackY, m_global.trackY, m_options);
+    connectColumn(m_tracks, "SlopeX", trackSlopeX, m_global.trackSlopeX,
+                  m_options);
+    connectColumn(m_tracks, "SlopeY", trackSlopeY, m_global.trackSlopeY,
+                  m_options);
+    connectColumn(m_tracks, "Cov", trackCov, m_global.trackCov, m_options);
+    finishTree(m_tracks, m_options);
+    m_global.tracks.setup(m_tracks, m_tracksCount, &numTracks,
+                          m_rangeEntries);
   }
 
   // entries from Events and Tracks. might still be undefined here
@@ -140,58 +352,96 @@ int64_t RceRootReader::addSensor(TDirectory* dir)
   assert(dir && "Directory must be non-null");
 
   SensorTrees trees;
+  SensorColumns columns;
   // use INT64_MAX to mark uninitialized/ missing values that can be used
   // directly in std::min to find the number of entries
   int64_t entriesHits = INT64_MAX;
   int64_t entriesClusters = INT64_MAX;
   int64_t entriesIntercepts = INT64_MAX;
 
-  dir->GetObject("Hits", trees.hits);
+  if (m_options.readHits)
+    dir->GetObject("Hits", trees.hits);
   if (trees.hits) {
     entriesHits = trees.hits->GetEntriesFast();
     if (entriesHits < 0)
       THROW("could not determine entries in ", dir->GetName(), "/Hits tree");
-    trees.hits->SetBranchAddress("NHits", &numHits);
-    trees.hits->SetBranchAddress("PixX", hitPixX);
-    trees.hits->SetBranchAddress("PixY", hitPixY);
-    trees.hits->SetBranchAddress("Timing", hitTiming);
-    trees.hits->SetBranchAddress("Value", hitValue);
-    trees.hits->SetBranchAddress("HitInCluster", hitInCluster);
+    prepareTree(trees.hits, m_options);
+    trees.hitsCount = connectBranch(trees.hits, "NHits", &numHits, m_options);
+    connectColumn(trees.hits, "PixX", hitPixX, columns.hitPixX, m_options);
+    connectColumn(trees.hits, "PixY", hitPixY, columns.hitPixY, m_options);
+    connectColumn(trees.hits, "Timing", hitTiming, columns.hitTiming,
+                  m_options);
+    connectColumn(trees.hits, "Value", hitValue, columns.hitValue, m_options);
+    connectColumn(trees.hits, "HitInCluster", hitInCluster,
+                  columns.hitInCluster, m_options);
+    finishTree(trees.hits, m_options);
+    columns.hits.setup(trees.hits, trees.hitsCount, &numHits, m_rangeEntries);
   }
-  dir->GetObject("Clusters", trees.clusters);
+  if (m_options.readClusters)
+    dir->GetObject("Clusters", trees.clusters);
   if (trees.clusters) {
     entriesClusters = trees.clusters->GetEntriesFast();
     if (entriesClusters < 0)
       THROW("could not determine entries in ", dir->GetName(),
             "/Clusters tree");
-    trees.clusters->SetBranchAddress("NClusters", &numClusters);
-    trees.clusters->SetBranchAddress("Col", clusterCol);
-    trees.clusters->SetBranchAddress("Row", clusterRow);
-    trees.clusters->SetBranchAddress("VarCol", clusterVarCol);
-    trees.clusters->SetBranchAddress("VarRow", clusterVarRow);
-    trees.clusters->SetBranchAddress("Timing", clusterTiming);
-    trees.clusters->SetBranchAddress("Value", clusterValue);
-    trees.clusters->SetBranchAddress("Track", clusterTrack);
+    prepareTree(trees.clusters, m_options);
+    trees.clustersCount =
+        connectBranch(trees.clusters, "NClusters", &numClusters, m_options);
+    connectColumn(trees.clusters, "Col", clusterCol, columns.clusterCol,
+                  m_options);
+    connectColumn(trees.clusters, "Row", clusterRow, columns.clusterRow,
+                  m_options);
+    connectColumn(trees.clusters, "VarCol", clusterVarCol,
+                  columns.clusterVarCol, m_options);
+    connectColumn(trees.clusters, "VarRow", clusterVarRow,
+                  columns.clusterVarRow, m_options);
+    // older files do not store the col/row covariance
+    trees.hasClusterCovColRow =
+        (trees.clusters->GetBranch("CovColRow") != nullptr);
+    if (trees.hasClusterCovColRow)
+      connectColumn(trees.clusters, "CovColRow", clusterCovColRow,
+                    columns.clusterCovColRow, m_options);
+    connectColumn(trees.clusters, "Timing", clusterTiming,
+                  columns.clusterTiming, m_options);
+    connectColumn(trees.clusters, "Value", clusterValue, columns.clusterValue,
+                  m_options);
+    connectColumn(trees.clusters, "Track", clusterTrack, columns.clusterTrack,
+                  m_options);
+    finishTree(trees.clusters, m_options);
+    columns.clusters.setup(trees.clusters, trees.clustersCount, &numClusters,
+                           m_rangeEntries);
   }
-  dir->GetObject("Intercepts", trees.intercepts);
+  if (m_options.readIntercepts)
+    dir->GetObject("Intercepts", trees.intercepts);
   if (trees.intercepts) {
-    entriesIntercepts = trees.hits->GetEntriesFast();
+    entriesIntercepts = trees.intercepts->GetEntriesFast();
     if (entriesIntercepts < 0)
       THROW("could not determine entries in ", dir->GetName(),
             "Intercepts tree");
-    trees.intercepts->SetBranchAddress("NIntercepts", &numIntercepts);
-    trees.intercepts->SetBranchAddress("U", interceptU);
-    trees.intercepts->SetBranchAddress("V", interceptV);
-    trees.intercepts->SetBranchAddress("SlopeU", interceptSlopeU);
-    trees.intercepts->SetBranchAddress("SlopeV", interceptSlopeV);
-    trees.intercepts->SetBranchAddress("Cov", interceptCov);
-    trees.intercepts->SetBranchAddress("Track", interceptTrack);
+    prepareTree(trees.intercepts, m_options);
+    trees.interceptsCount = connectBranch(trees.intercepts, "NIntercepts",
+                                          &numIntercepts, m_options);
+    connectColumn(trees.intercepts, "U", interceptU, columns.interceptU,
+                  m_options);
+    connectColumn(trees.intercepts, "V", interceptV, columns.interceptV,
+                  m_options);
+    connectColumn(trees.intercepts, "SlopeU", interceptSlopeU,
+                  columns.interceptSlopeU, m_options);
+    connectColumn(trees.intercepts, "SlopeV", interceptSlopeV,
+                  columns.interceptSlopeV, m_options);
+    connectColumn(trees.intercepts, "Cov", interceptCov, columns.interceptCov,
+                  m_options);
+    connectColumn(trees.intercepts, "Track", interceptTrack,
+                  columns.interceptTrack, m_options);
+    finishTree(trees.intercepts, m_options);
+    columns.intercepts.setup(trees.intercepts, trees.interceptsCount,
+                             &numIntercepts, m_rangeEntries);
   }
 
   // this directory does not contain any valid data
   if ((entriesHits == INT64_MAX) && (entriesClusters == INT64_MAX) &&
       (entriesIntercepts == INT64_MAX))
-    THROW("could not find any of ", dir->GetName(),
+    THROW("could not find any enabled tree of ", dir->GetName(),
           "/{Hits,Clusters,Intercepts}");
 
   // check that all active trees have consistent entries
@@ -209,9 +459,31 @@ int64_t RceRootReader::addSensor(TDirectory* dir)
           " expected=", trees.entries);
 
   m_sensors.push_back(trees);
+  m_columns.push_back(std::move(columns));
   return trees.entries;
 }
 
+RceRootReader::~RceRootReader()
+{
+  auto logCache = [&](TTree* tree, const std::string& name) {
+    TTreeCache* cache = tree ? tree->GetReadCache(m_file.get()) : nullptr;
+    if (cache) {
+      VERBOSE(name, " read cache efficiency ", cache->GetEfficiency(),
+              " relative ", cache->GetEfficiencyRel());
+    }
+  };
+  logCache(m_eventInfo, "Event");
+  logCache(m_tracks, "Tracks");
+  for (size_t isensor = 0; isensor < m_sensors.size(); ++isensor) {
+    std::string prefix = "Plane" + std::to_string(isensor);
+    logCache(m_sensors[isensor].hits, prefix + "/Hits");
+    logCache(m_sensors[isensor].clusters, prefix + "/Clusters");
+    logCache(m_sensors[isensor].intercepts, prefix + "/Intercepts");
+  }
+  INFO("read ", m_file->GetBytesRead(), " bytes in ", m_file->GetReadCalls(),
+       " read calls");
+}
+
 std::string RceRootReader::name() const { return "RceRootReader"; }
 
 uint64_t RceRootReader::numEvents() const
@@ -229,6 +501,84 @@ void RceRootReader::skip(uint64_t n)
   } else {
     m_next += n;
   }
+  // only prefetch the baskets for the remaining entries
+  auto restrictCache = [&](TTree* tree) {
+    if (tree)
+      tree->SetCacheEntryRange(m_next, m_entries);
+  };
+  restrictCache(m_eventInfo);
+  restrictCache(m_tracks);
+  for (auto& trees : m_sensors) {
+    restrictCache(trees.hits);
+    restrictCache(trees.clusters);
+    restrictCache(trees.intercepts);
+  }
+}
+
+void RceRootReader::loadRanges(int64_t ientry)
+{
+  // global event data
+  if (m_eventInfo && !m_global.event.contains(ientry)) {
+    m_global.event.load(ientry);
+    m_global.frameNumber.read(m_global.event, &frameNumber);
+    m_global.triggerTime.read(m_global.event, &triggerTime);
+  }
+
+  // global tracks info
+  if (m_tracks && !m_global.tracks.contains(ientry)) {
+    m_global.tracks.load(ientry);
+    // buffers must be large enough before any entry is read
+    resizeTracks(m_global.tracks.maxSize());
+    m_global.trackChi2.read(m_global.tracks, trackChi2.data());
+    m_global.trackDof.read(m_global.tracks, trackDof.data());
+    m_global.trackX.read(m_global.tracks, trackX.data());
+    m_global.trackY.read(m_global.tracks, trackY.data());
+    m_global.trackSlopeX.read(m_global.tracks, trackSlopeX.data());
+    m_global.trackSlopeY.read(m_global.tracks, trackSlopeY.data());
+    m_global.trackCov.read(m_global.tracks, trackCov.data());
+  }
+
+  // per-sensor data
+  for (size_t isensor = 0; isensor < numSensors(); ++isensor) {
+    SensorTrees& trees = m_sensors[isensor];
+    SensorColumns& columns = m_columns[isensor];
+
+    if (trees.intercepts && !columns.intercepts.contains(ientry)) {
+      columns.intercepts.load(ientry);
+      resizeIntercepts(columns.intercepts.maxSize());
+      columns.interceptU.read(columns.intercepts, interceptU.data());
+      columns.interceptV.read(columns.intercepts, interceptV.data());
+      columns.interceptSlopeU.read(columns.intercepts,
+                                   interceptSlopeU.data());
+      columns.interceptSlopeV.read(columns.intercepts,
+                                   interceptSlopeV.data());
+      columns.interceptCov.read(columns.intercepts, interceptCov.data());
+      columns.interceptTrack.read(columns.intercepts, interceptTrack.data());
+    }
+    if (trees.clusters && !columns.clusters.contains(ientry)) {
+      columns.clusters.load(ientry);
+      resizeClusters(columns.clusters.maxSize());
+      columns.clusterCol.read(columns.clusters, clusterCol.data());
+      columns.clusterRow.read(columns.clusters, clusterRow.data());
+      columns.clusterVarCol.read(columns.clusters, clusterVarCol.data());
+      columns.clusterVarRow.read(columns.clusters, clusterVarRow.data());
+      if (trees.hasClusterCovColRow)
+        columns.clusterCovColRow.read(columns.clusters,
+                                      clusterCovColRow.data());
+      columns.clusterTiming.read(columns.clusters, clusterTiming.data());
+      columns.clusterValue.read(columns.clusters, clusterValue.data());
+      columns.clusterTrack.read(columns.clusters, clusterTrack.data());
+    }
+    if (trees.hits && !columns.hits.contains(ientry)) {
+      columns.hits.load(ientry);
+      resizeHits(columns.hits.maxSize());
+      columns.hitPixX.read(columns.hits, hitPixX.data());
+      columns.hitPixY.read(columns.hits, hitPixY.data());
+      columns.hitTiming.read(columns.hits, hitTiming.data());
+      columns.hitValue.read(columns.hits, hitValue.data());
+      columns.hitInCluster.read(columns.hits, hitInCluster.data());
+    }
+  }
 }
 
 bool RceRootReader::read(Event& event)
@@ -242,10 +592,11 @@ bool RceRootReader::read(Event& event)
 
   int64_t ievent = m_next++;
 
+  loadRanges(ievent);
+
   // global event data
   if (m_eventInfo) {
-    if (m_eventInfo->GetEntry(ievent) <= 0)
-      FAIL("could not read 'Events' entry ", ievent);
+    size_t i = m_global.event.offset(ievent);
     // listen chap, here's the deal:
     // we want a timestamp, i.e. a simple counter of clockcycles or bunch
     // crossings, for each event that defines the trigger/ readout time with
@@ -256,71 +607,79 @@ bool RceRootReader::read(Event& event)
     // to the actual trigger time and has only a 1s resolution, i.e. it is
     // completely useless. The `TriggerTime` actually stores the internal
     // FPGA timestamp/ clock cyles and is what we need to use.
-    event.clear(frameNumber, triggerTime);
+    event.clear(m_global.frameNumber[i], m_global.triggerTime[i]);
   } else {
     event.clear(ievent);
   }
 
   // global tracks info
   if (m_tracks) {
-    if (m_tracks->GetEntry(ievent) <= 0)
-      FAIL("could not read 'Tracks' entry ", ievent);
-    for (Int_t itrack = 0; itrack < numTracks; ++itrack) {
-      TrackState state(trackX[itrack], trackY[itrack], trackSlopeX[itrack],
-                       trackSlopeY[itrack]);
-      state.setCovSpatialPacked(trackCov[itrack]);
-      event.addTrack({state, trackChi2[itrack], trackDof[itrack]});
+    const GlobalColumns& columns = m_global;
+    size_t offset = columns.tracks.offset(ievent);
+    size_t size = columns.tracks.size(ievent);
+    for (size_t itrack = 0; itrack < size; ++itrack) {
+      size_t i = offset + itrack;
+      TrackState state(columns.trackX[i], columns.trackY[i],
+                       columns.trackSlopeX[i], columns.trackSlopeY[i]);
+      state.setCovSpatialPacked(columns.trackCov.values(i));
+      event.addTrack({state, columns.trackChi2[i], columns.trackDof[i]});
     }
   }
 
   // per-sensor data
   for (size_t isensor = 0; isensor < numSensors(); ++isensor) {
-    SensorTrees& trees = m_sensors[isensor];
+    const SensorTrees& trees = m_sensors[isensor];
+    const SensorColumns& columns = m_columns[isensor];
     SensorEvent& sensorEvent = event.getSensorEvent(isensor);
 
     // local track states
     if (trees.intercepts) {
-      if (trees.intercepts->GetEntry(ievent) <= 0)
-        FAIL("could not read 'Intercepts' entry ", ievent);
-
-      for (Int_t iintercept = 0; iintercept < numIntercepts; ++iintercept) {
-        TrackState local(interceptU[iintercept], interceptV[iintercept],
-                         interceptSlopeU[iintercept],
-                         interceptSlopeV[iintercept]);
-        local.setCovSpatialPacked(interceptCov[iintercept]);
-        sensorEvent.setLocalState(interceptTrack[iintercept], local);
+      size_t offset = columns.intercepts.offset(ievent);
+      size_t size = columns.intercepts.size(ievent);
+      for (size_t iintercept = 0; iintercept < size; ++iintercept) {
+        size_t i = offset + iintercept;
+        TrackState local(columns.interceptU[i], columns.interceptV[i],
+                         columns.interceptSlopeU[i],
+                         columns.interceptSlopeV[i]);
+        local.setCovSpatialPacked(columns.interceptCov.values(i));
+        sensorEvent.setLocalState(columns.interceptTrack[i], local);
       }
     }
 
     // local clusters
     if (trees.clusters) {
-      if (trees.clusters->GetEntry(ievent) <= 0)
-        FAIL("could not read 'Clusters' entry ", ievent);
-
-      for (Int_t icluster = 0; icluster < numClusters; ++icluster) {
+      size_t offset = columns.clusters.offset(ievent);
+      size_t size = columns.clusters.size(ievent);
+      for (size_t icluster = 0; icluster < size; ++icluster) {
+        size_t i = offset + icluster;
+        Double_t covColRow =
+            trees.hasClusterCovColRow ? columns.clusterCovColRow[i] : 0;
         Cluster& cluster = sensorEvent.addCluster(
-            clusterCol[icluster], clusterRow[icluster], clusterTiming[icluster],
-            clusterValue[icluster], clusterVarCol[icluster],
-            clusterVarRow[icluster], 1.0 / 12.0, clusterCovColRow[icluster]);
+            columns.clusterCol[i], columns.clusterRow[i],
+            columns.clusterTiming[i], columns.clusterValue[i],
+            columns.clusterVarCol[i], columns.clusterVarRow[i], 1.0 / 12.0,
+            covColRow);
         // Fix cluster/track relationship if possible
-        if (m_tracks && (0 <= clusterTrack[icluster])) {
-          cluster.setTrack(clusterTrack[icluster]);
-          event.getTrack(clusterTrack[icluster]).addCluster(isensor, icluster);
+        Int_t itrack = columns.clusterTrack[i];
+        if (m_tracks && (0 <= itrack)) {
+          cluster.setTrack(itrack);
+          event.getTrack(itrack).addCluster(isensor, icluster);
         }
       }
     }
 
     // local hits
     if (trees.hits) {
-      if (trees.hits->GetEntry(ievent) <= 0)
-        FAIL("could not read 'Hits' entry ", ievent);
-
-      for (Int_t ihit = 0; ihit < numHits; ++ihit) {
-        Hit& hit = sensorEvent.addHit(hitPixX[ihit], hitPixY[ihit],
-                                      hitTiming[ihit], hitValue[ihit]);
+      size_t offset = columns.hits.offset(ievent);
+      size_t size = columns.hits.size(ievent);
+      for (size_t ihit = 0; ihit < size; ++ihit) {
+        size_t i = offset + ihit;
+        Hit& hit =
+            sensorEvent.addHit(columns.hitPixX[i], columns.hitPixY[i],
+                               columns.hitTiming[i], columns.hitValue[i]);
         // Fix hit/cluster relationship is possibl
-        if (trees.clusters && hitInCluster[ihit] >= 0)
-          sensorEvent.getCluster(hitInCluster[ihit]).addHit(hit);
+        if (trees.clusters && columns.hitInCluster[i] >= 0)
+          sensorEvent.getCluster(columns.hitInCluster[i]).addHit(hit);
       }
     }
   } // end loop in planes
@@ -330,8 +689,29 @@ bool RceRootReader::read(Event& event)
 // -----------------------------------------------------------------------------
 // writer
 
+namespace {
+
+// Create a variable-length branch and connect it to the buffer.
+template <typename Buffer>
+void createBranch(TTree* tree,
+                  const char* name,
+                  Buffer& buffer,
+                  const char* leaflist)
+{
+  buffer.connect(tree->Branch(name, buffer.data(), leaflist));
+}
+
+} // namespace
+
 RceRootWriter::RceRootWriter(const std::string& path, size_t numSensors)
-    : RceRootCommon(openRootWrite(path))
+    : RceRootWriter(path, numSensors, RootWriteOptions())
+{
+}
+
+RceRootWriter::RceRootWriter(const std::string& path,
+                             size_t numSensors,
+                             const RootWriteOptions& options)
+    : RceRootCommon(openRootWrite(path, options))
 {
   m_file->cd();
 
@@ -342,28 +722,31 @@ RceRootWriter::RceRootWriter(const std::string& path, size_t numSensors)
   m_eventInfo->Branch("TimeStamp", &timestamp, "TimeStamp/l");
   m_eventInfo->Branch("TriggerTime", &triggerTime, "TriggerTime/l");
   m_eventInfo->Branch("Invalid", &invalid, "Invalid/O");
+  setupTreeWrite(m_eventInfo, options);
 
   // global track tree
   m_tracks = new TTree("Tracks", "Track parameters");
   m_tracks->SetDirectory(m_file.get());
   m_tracks->Branch("NTracks", &numTracks, "NTracks/I");
-  m_tracks->Branch("Chi2", trackChi2, "Chi2[NTracks]/D");
-  m_tracks->Branch("Dof", trackDof, "Dof[NTracks]/I");
-  m_tracks->Branch("X", trackX, "X[NTracks]/D");
-  m_tracks->Branch("Y", trackY, "Y[NTracks]/D");
-  m_tracks->Branch("SlopeX", trackSlopeX, "SlopeX[NTracks]/D");
-  m_tracks->Branch("SlopeY", trackSlopeY, "SlopeY[NTracks]/D");
-  m_tracks->Branch("Cov", trackCov, "Cov[NTracks][10]/D");
+  createBranch(m_tracks, "Chi2", trackChi2, "Chi2[NTracks]/D");
+  createBranch(m_tracks, "Dof", trackDof, "Dof[NTracks]/I");
+  createBranch(m_tracks, "X", trackX, "X[NTracks]/D");
+  createBranch(m_tracks, "Y", trackY, "Y[NTracks]/D");
+  createBranch(m_tracks, "SlopeX", trackSlopeX, "SlopeX[NTracks]/D");
+  createBranch(m_tracks, "SlopeY", trackSlopeY, "SlopeY[NTracks]/D");
+  createBranch(m_tracks, "Cov", trackCov, "Cov[NTracks][10]/D");
+  setupTreeWrite(m_tracks, options);
 
   // per-sensor trees
   for (size_t isensor = 0; isensor < numSensors; ++isensor) {
     std::string name("Plane" + std::to_string(isensor));
     TDirectory* sensorDir = m_file->mkdir(name.c_str());
-    addSensor(sensorDir);
+    addSensor(sensorDir, options);
   }
 }
 
-void RceRootWriter::addSensor(TDirectory* dir)
+void RceRootWriter::addSensor(TDirectory* dir,
+                              const RootWriteOptions& options)
 {
   dir->cd();
 
@@ -372,34 +755,41 @@ void RceRootWriter::addSensor(TDirectory* dir)
   trees.hits = new TTree("Hits", "Hits");
   trees.hits->SetDirectory(dir);
   trees.hits->Branch("NHits", &numHits, "NHits/I");
-  trees.hits->Branch("PixX", hitPixX, "HitPixX[NHits]/I");
-  trees.hits->Branch("PixY", hitPixY, "HitPixY[NHits]/I");
-  trees.hits->Branch("Timing", hitTiming, "HitTiming[NHits]/I");
-  trees.hits->Branch("Value", hitValue, "HitValue[NHits]/I");
-  trees.hits->Branch("HitInCluster", hitInCluster, "HitInCluster[NHits]/I");
+  createBranch(trees.hits, "PixX", hitPixX, "HitPixX[NHits]/I");
+  createBranch(trees.hits, "PixY", hitPixY, "HitPixY[NHits]/I");
+  createBranch(trees.hits, "Timing", hitTiming, "HitTiming[NHits]/I");
+  createBranch(trees.hits, "Value", hitValue, "HitValue[NHits]/I");
+  createBranch(trees.hits, "HitInCluster", hitInCluster,
+               "HitInCluster[NHits]/I");
+  setupTreeWrite(trees.hits, options);
   // local clusters
   trees.clusters = new TTree("Clusters", "Clusters");
   trees.clusters->SetDirectory(dir);
   trees.clusters->Branch("NClusters", &numClusters, "NClusters/I");
-  trees.clusters->Branch("Col", clusterCol, "Col[NClusters]/D");
-  trees.clusters->Branch("Row", clusterRow, "Row[NClusters]/D");
-  trees.clusters->Branch("VarCol", clusterVarCol, "VarCol[NClusters]/D");
-  trees.clusters->Branch("VarRow", clusterVarRow, "VarRow[NClusters]/D");
-  trees.clusters->Branch("CovColRow", clusterCovColRow,
-                         "CovColRow[NClusters]/D");
-  trees.clusters->Branch("Timing", clusterTiming, "Timing[NClusters]/D");
-  trees.clusters->Branch("Value", clusterValue, "Value[NClusters]/D");
-  trees.clusters->Branch("Track", clusterTrack, "Track[NClusters]/I");
+  createBranch(trees.clusters, "Col", clusterCol, "Col[NClusters]/D");
+  createBranch(trees.clusters, "Row", clusterRow, "Row[NClusters]/D");
+  createBranch(trees.clusters, "VarCol", clusterVarCol, "VarCol[NClusters]/D");
+  createBranch(trees.clusters, "VarRow", clusterVarRow, "VarRow[NClusters]/D");
+  createBranch(trees.clusters, "CovColRow", clusterCovColRow,
+               "CovColRow[NClusters]/D");
+  createBranch(trees.clusters, "Timing", clusterTiming, "Timing[NClusters]/D");
+  createBranch(trees.clusters, "Value", clusterValue, "Value[NClusters]/D");
+  createBranch(trees.clusters, "Track", clusterTrack, "Track[NClusters]/I");
+  setupTreeWrite(trees.clusters, options);
   // local track states
   trees.intercepts = new TTree("Intercepts", "Intercepts");
   trees.intercepts->SetDirectory(dir);
   trees.intercepts->Branch("NIntercepts", &numIntercepts, "NIntercepts/I");
-  trees.intercepts->Branch("U", interceptU, "U[NIntercepts]/D");
-  trees.intercepts->Branch("V", interceptV, "V[NIntercepts]/D");
-  trees.intercepts->Branch("SlopeU", interceptSlopeU, "SlopeU[NIntercepts]/D");
-  trees.intercepts->Branch("SlopeV", interceptSlopeV, "SlopeV[NIntercepts]/D");
-  trees.intercepts->Branch("Cov", interceptCov, "Cov[NIntercepts][10]/D");
-  trees.intercepts->Branch("Track", interceptTrack, "Track[NIntercepts]/I");
+  createBranch(trees.intercepts, "U", interceptU, "U[NIntercepts]/D");
+  createBranch(trees.intercepts, "V", interceptV, "V[NIntercepts]/D");
+  createBranch(trees.intercepts, "SlopeU", interceptSlopeU,
+               "SlopeU[NIntercepts]/D");
+  createBranch(trees.intercepts, "SlopeV", interceptSlopeV,
+               "SlopeV[NIntercepts]/D");
+  createBranch(trees.intercepts, "Cov", interceptCov, "Cov[NIntercepts][10]/D");
+  createBranch(trees.intercepts, "Track", interceptTrack,
+               "Track[NIntercepts]/I");
+  setupTreeWrite(trees.intercepts, options);
   m_sensors.emplace_back(trees);
 }
 
@@ -427,9 +817,8 @@ void RceRootWriter::append(const Event& event)
 
   // tracks
   if (m_tracks) {
-    if (kMaxTracks < event.numTracks())
-      FAIL("tracks exceed MAX_TRACKS");
     numTracks = event.numTracks();
+    resizeTracks(numTracks);
     for (Index itrack = 0; itrack < event.numTracks(); ++itrack) {
       const Track& track = event.getTrack(itrack);
       trackChi2[itrack] = track.chi2();
@@ -439,7 +828,7 @@ void RceRootWriter::append(const Event& event)
       trackY[itrack] = state.loc1();
       trackSlopeX[itrack] = state.slopeLoc0();
       trackSlopeY[itrack] = state.slopeLoc1();
-      state.getCovSpatialPacked(trackCov[itrack]);
+      state.getCovSpatialPacked(trackCov.values(itrack));
     }
     m_tracks->Fill();
   }
@@ -451,9 +840,8 @@ void RceRootWriter::append(const Event& event)
 
     // local hits
     if (trees.hits) {
-      if (kMaxHits < sensorEvent.numHits())
-        FAIL("hits exceed MAX_HITS");
       numHits = sensorEvent.numHits();
+      resizeHits(numHits);
       for (Index ihit = 0; ihit < sensorEvent.numHits(); ++ihit) {
         const Hit hit = sensorEvent.getHit(ihit);
         hitPixX[ihit] = hit.digitalCol();
@@ -467,9 +855,8 @@ void RceRootWriter::append(const Event& event)
 
     // local clusters
     if (trees.clusters) {
-      if (kMaxHits < sensorEvent.numClusters())
-        FAIL("clusters exceed MAX_HITS");
       numClusters = sensorEvent.numClusters();
+      resizeClusters(numClusters);
       for (Index iclu = 0; iclu < sensorEvent.numClusters(); ++iclu) {
         const Cluster& cluster = sensorEvent.getCluster(iclu);
         clusterCol[iclu] = cluster.col();
@@ -487,14 +874,13 @@ void RceRootWriter::append(const Event& event)
     // local track states
     if (trees.intercepts) {
       numIntercepts = 0;
+      resizeIntercepts(sensorEvent.localStates().size());
       for (const auto& local : sensorEvent.localStates()) {
-        if (kMaxTracks < static_cast<Index>(numIntercepts + 1))
-          FAIL("intercepts exceed MAX_TRACKS");
         interceptU[numIntercepts] = local.loc0();
         interceptV[numIntercepts] = local.loc1();
         interceptSlopeU[numIntercepts] = local.slopeLoc0();
         interceptSlopeV[numIntercepts] = local.slopeLoc1();
-        local.getCovSpatialPacked(interceptCov[numIntercepts]);
+        local.getCovSpatialPacked(interceptCov.values(numIntercepts));
         interceptTrack[numIntercepts] = local.track();
         numIntercepts += 1;
       }
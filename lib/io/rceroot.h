@@ -3,11 +3,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include <TBranch.h>
 #include <TTree.h>
 
 #include "loop/reader.h"
@@ -26,26 +28,62 @@ protected:
   RceRootCommon(RootFilePtr&& file);
   ~RceRootCommon() = default;
 
-  /* NOTE: these sizes are used to initialize arrays of track, cluster and
-   * hit information. BUT these arrays are generated ONLY ONCE and re-used
-   * to load events. Vectors could have been used in the ROOT file format, but
-   * they would need to be constructed at each event reading step. */
-  static constexpr Index kMaxHits = 1 << 14;
-  static constexpr Index kMaxTracks = 1 << 14;
+  /** Growable storage for a variable-length branch.
+   *
+   * Each element consists of `kWidth` consecutive values. The same storage
+   * can be connected to branches in multiple trees, e.g. the hit trees of all
+   * sensors. Connected branches are rebound when the storage is reallocated.
+   */
+  template <typename T, size_t kWidth = 1>
+  class Buffer {
+  public:
+    // non-empty storage ensures that branch addresses are never null
+    Buffer() : m_values(kWidth * 64) {}
+
+    /** Connect the branch to the current storage. */
+    TBranch* connect(TBranch* branch);
+    /** Ensure storage for at least the given number of elements. */
+    void resize(size_t size);
+
+    T* data() { return m_values.data(); }
+    T& operator[](size_t i) { return m_values[i]; }
+    /** Access all values of the i-th element. */
+    T* values(size_t i) { return m_values.data() + kWidth * i; }
+
+  private:
+    std::vector<T> m_values;
+    std::vector<TBranch*> m_branches;
+  };
 
   struct SensorTrees {
     TTree* hits = nullptr;
     TTree* clusters = nullptr;
     TTree* intercepts = nullptr;
+    // branches w/ the number of elements in each entry
+    TBranch* hitsCount = nullptr;
+    TBranch* clustersCount = nullptr;
+    TBranch* interceptsCount = nullptr;
+    // older files do not store the cluster col/row covariance
+    bool hasClusterCovColRow = true;
     int64_t entries = 0;
   };
 
+  /** Ensure sufficient buffer sizes for the given number of tracks. */
+  void resizeTracks(size_t numTracks);
+  /** Ensure sufficient buffer sizes for the given number of hits. */
+  void resizeHits(size_t numHits);
+  /** Ensure sufficient buffer sizes for the given number of clusters. */
+  void resizeClusters(size_t numClusters);
+  /** Ensure sufficient buffer sizes for the given number of intercepts. */
+  void resizeIntercepts(size_t numIntercepts);
+
   RootFilePtr m_file;
   int64_t m_entries;
   int64_t m_next;
   // Trees global to the entire event
   TTree* m_eventInfo;
   TTree* m_tracks;
+  TBranch* m_tracksCount;
   // Trees containing event-by-event data for each sensors
   std::vector<SensorTrees> m_sensors;
 
@@ -56,51 +94,81 @@ protected:
   Bool_t invalid;
   // global track state and info
   Int_t numTracks;
-  Double_t trackChi2[kMaxTracks];
-  Int_t trackDof[kMaxTracks];
-  Double_t trackX[kMaxTracks];
-  Double_t trackY[kMaxTracks];
-  Double_t trackSlopeX[kMaxTracks];
-  Double_t trackSlopeY[kMaxTracks];
-  Double_t trackCov[kMaxTracks][10];
+  Buffer<Double_t> trackChi2;
+  Buffer<Int_t> trackDof;
+  Buffer<Double_t> trackX;
+  Buffer<Double_t> trackY;
+  Buffer<Double_t> trackSlopeX;
+  Buffer<Double_t> trackSlopeY;
+  Buffer<Double_t, 10> trackCov;
   // local hits
   Int_t numHits;
-  Int_t hitPixX[kMaxHits];
-  Int_t hitPixY[kMaxHits];
-  Int_t hitTiming[kMaxHits];
-  Int_t hitValue[kMaxHits];
-  Int_t hitInCluster[kMaxHits];
+  Buffer<Int_t> hitPixX;
+  Buffer<Int_t> hitPixY;
+  Buffer<Int_t> hitTiming;
+  Buffer<Int_t> hitValue;
+  Buffer<Int_t> hitInCluster;
   // local clusters
   Int_t numClusters;
-  Double_t clusterCol[kMaxHits];
-  Double_t clusterRow[kMaxHits];
-  Double_t clusterVarCol[kMaxHits];
-  Double_t clusterVarRow[kMaxHits];
-  Double_t clusterCovColRow[kMaxHits];
-  Double_t clusterTiming[kMaxHits];
-  Double_t clusterValue[kMaxHits];
-  Int_t clusterTrack[kMaxHits];
+  Buffer<Double_t> clusterCol;
+  Buffer<Double_t> clusterRow;
+  Buffer<Double_t> clusterVarCol;
+  Buffer<Double_t> clusterVarRow;
+  Buffer<Double_t> clusterCovColRow;
+  Buffer<Double_t> clusterTiming;
+  Buffer<Double_t> clusterValue;
+  Buffer<Int_t> clusterTrack;
   // local track states
   Int_t numIntercepts;
-  Double_t interceptU[kMaxTracks];
-  Double_t interceptV[kMaxTracks];
-  Double_t interceptSlopeU[kMaxTracks];
-  Double_t interceptSlopeV[kMaxTracks];
-  Double_t interceptCov[kMaxTracks][10];
-  Int_t interceptTrack[kMaxTracks];
+  Buffer<Double_t> interceptU;
+  Buffer<Double_t> interceptV;
+  Buffer<Double_t> interceptSlopeU;
+  Buffer<Double_t> interceptSlopeV;
+  Buffer<Double_t, 10> interceptCov;
+  Buffer<Int_t> interceptTrack;
 };
 
-/** Read events from a RCE ROOT file. */
+/** Read events from a RCE ROOT file.
+ *
+ * Only the branches that are used are enabled. Complete trees can be
+ * excluded via the options and are never read or decompressed. Each tree
+ * uses its own read cache that either learns the accessed branches during
+ * the first entries or prefetches all enabled branches.
+ *
+ * Entries are not read one event at a time. Each tree is decoded for a range
+ * of entries, bounded by the tree clusters, one branch after the other and
+ * the values are stored in one column per branch. Events are then filled
+ * from the columns w/o accessing the trees until the range is exhausted.
+ */
 class RceRootReader : public RceRootCommon, public Reader {
 public:
+  /** Optional settings to tune the input. */
+  struct Options {
+    // which per-event data should be read
+    bool readHits = true;
+    bool readClusters = true;
+    bool readIntercepts = true;
+    bool readTracks = true;
+    // per-tree read cache size in bytes; zero disables the cache
+    int64_t cacheSize = 8 * 1024 * 1024;
+    // number of entries used to learn the accessed branches; zero disables
+    // the learning and all enabled branches are cached right away. entry
+    // ranges are limited to this size so all branches are seen while
+    // learning.
+    int cacheLearnEntries = 0;
+  };
+
   /** Return a score of how likely the given path is an RCE Root file. */
   static int check(const std::string& path);
-  /** Open the the file. */
+  /** Open the the file w/ options from the configuration. */
   static std::shared_ptr<RceRootReader> open(const std::string& path,
-                                             const toml::Value& /* unused */);
+                                             const toml::Value& cfg);
 
   /** Open an existing file and determine the number of sensors and events. */
   RceRootReader(const std::string& path);
+  /** Open an existing file w/ non-default options. */
+  RceRootReader(const std::string& path, const Options& options);
+  ~RceRootReader();
 
   std::string name() const override final;
   uint64_t numEvents() const override final;
@@ -110,7 +178,119 @@ public:
   bool read(Event& event) override final;
 
 private:
+  /** Element offsets of each entry for the current range of entries. */
+  class EntryRange {
+  public:
+    /** Setup the tree and the optional branch w/ the number of elements.
+     *
+     * W/o count branch, every entry contains exactly one element.
+     */
+    void setup(TTree* tree,
+               TBranch* count,
+               const Int_t* countValue,
+               int64_t maxEntries);
+    /** Read the number of elements for the range starting at the entry. */
+    void load(int64_t ientry);
+
+    bool contains(int64_t ientry) const
+    {
+      return (m_begin <= ientry) && (ientry < m_end);
+    }
+    int64_t begin() const { return m_begin; }
+    int64_t end() const { return m_end; }
+    /** Offset of the first element of the entry in the range. */
+    size_t offset(int64_t ientry) const { return m_offsets[ientry - m_begin]; }
+    /** Number of elements in the entry. */
+    size_t size(int64_t ientry) const
+    {
+      return m_offsets[ientry - m_begin + 1] - m_offsets[ientry - m_begin];
+    }
+    /** Number of elements in all entries of the range. */
+    size_t numElements() const { return m_offsets.back(); }
+    /** Largest number of elements in a single entry of the range. */
+    size_t maxSize() const { return m_maxSize; }
+
+  private:
+    TTree* m_tree = nullptr;
+    TBranch* m_count = nullptr;
+    const Int_t* m_countValue = nullptr;
+    int64_t m_maxEntries = 1;
+    int64_t m_begin = 0;
+    int64_t m_end = 0;
+    // one additional offset to mark the end of the last entry
+    std::vector<size_t> m_offsets = {0};
+    size_t m_maxSize = 0;
+  };
+  /** Values of a single branch for all entries of the current range.
+   *
+   * Each element consists of `kWidth` consecutive values.
+   */
+  template <typename T, size_t kWidth = 1>
+  class Column {
+  public:
+    /** Read values from the branch. */
+    void connect(TBranch* branch) { m_branch = branch; }
+    /** Read the branch for all entries and copy them from its storage.
+     *
+     * The storage must be large enough for the largest entry of the range.
+     */
+    void read(const EntryRange& range, const T* storage);
+
+    const T& operator[](size_t i) const { return m_values[i]; }
+    /** Access all values of the i-th element. */
+    const T* values(size_t i) const { return m_values.data() + kWidth * i; }
+
+  private:
+    TBranch* m_branch = nullptr;
+    std::vector<T> m_values;
+  };
+  struct GlobalColumns {
+    EntryRange event;
+    Column<ULong64_t> frameNumber;
+    Column<ULong64_t> triggerTime;
+    EntryRange tracks;
+    Column<Double_t> trackChi2;
+    Column<Int_t> trackDof;
+    Column<Double_t> trackX;
+    Column<Double_t> trackY;
+    Column<Double_t> trackSlopeX;
+    Column<Double_t> trackSlopeY;
+    Column<Double_t, 10> trackCov;
+  };
+  struct SensorColumns {
+    EntryRange hits;
+    Column<Int_t> hitPixX;
+    Column<Int_t> hitPixY;
+    Column<Int_t> hitTiming;
+    Column<Int_t> hitValue;
+    Column<Int_t> hitInCluster;
+    EntryRange clusters;
+    Column<Double_t> clusterCol;
+    Column<Double_t> clusterRow;
+    Column<Double_t> clusterVarCol;
+    Column<Double_t> clusterVarRow;
+    Column<Double_t> clusterCovColRow;
+    Column<Double_t> clusterTiming;
+    Column<Double_t> clusterValue;
+    Column<Int_t> clusterTrack;
+    EntryRange intercepts;
+    Column<Double_t> interceptU;
+    Column<Double_t> interceptV;
+    Column<Double_t> interceptSlopeU;
+    Column<Double_t> interceptSlopeV;
+    Column<Double_t, 10> interceptCov;
+    Column<Int_t> interceptTrack;
+  };
+
   int64_t addSensor(TDirectory* dir);
+  /** Decode a new range for all trees that do not contain the entry. */
+  void loadRanges(int64_t ientry);
+
+  Options m_options;
+  // maximum number of entries that are decoded at once
+  int64_t m_rangeEntries;
+  GlobalColumns m_global;
+  std::vector<SensorColumns> m_columns;
 };
 
 /** Write event in the RCE ROOT file format. */
@@ -118,6 +298,10 @@ class RceRootWriter : public RceRootCommon, public Writer {
 public:
   /** Open a new file and truncate existing content. */
   RceRootWriter(const std::string& path, size_t numSensors);
+  /** Open a new file w/ non-default compression and tree settings. */
+  RceRootWriter(const std::string& path,
+                size_t numSensors,
+                const RootWriteOptions& options);
   ~RceRootWriter();
 
   std::string name() const;
@@ -125,7 +309,28 @@ public:
   void append(const Event& event);
 
 private:
-  void addSensor(TDirectory* dir);
+  void addSensor(TDirectory* dir, const RootWriteOptions& options);
 };
 
+// inline implementations
+
+template <typename T, size_t kWidth>
+inline TBranch* RceRootCommon::Buffer<T, kWidth>::connect(TBranch* branch)
+{
+  branch->SetAddress(m_values.data());
+  m_branches.push_back(branch);
+  return branch;
+}
+
+template <typename T, size_t kWidth>
+inline void RceRootCommon::Buffer<T, kWidth>::resize(size_t size)
+{
+  if (kWidth * size <= m_values.size())
+    return;
+  // grow geometrically to limit the number of reallocations
+  m_values.resize(std::max(kWidth * size, 2 * m_values.size()));
+  for (TBranch* branch : m_branches)
+    branch->SetAddress(m_values.data());
+}
+
 } // namespace proteus
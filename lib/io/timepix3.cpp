@@ -3,14 +3,141 @@
 
 #include "timepix3.h"
 
-#include <sstream>
+#include <algorithm>
+#include <chrono>
 #include <string>
 
 #include "storage/event.h"
 #include "storage/sensorevent.h"
 #include "utils/logger.h"
+#include "utils/threadpool.h"
 
 namespace proteus {
+namespace {
+
+// Number of 64-bit data words that are read at once
+constexpr size_t kBlockWords = 1 << 20;
+// Number of data words in each independently decoded chunk of a block
+constexpr size_t kChunkWords = 1 << 15;
+constexpr size_t kBlockChunks = kBlockWords / kChunkWords;
+
+// Decode the pixel content of all words regardless of their packet type.
+//
+// The loop body only uses shifts and masks w/o any branches and can be
+// vectorized by the compiler. Values decoded from non-pixel packets are
+// meaningless and must be ignored based on the header.
+void decodeWords(size_t n,
+                 const uint64_t* words,
+                 uint8_t* headers,
+                 uint16_t* cols,
+                 uint16_t* rows,
+                 uint16_t* tots,
+                 long long int* times)
+{
+  for (size_t i = 0; i < n; ++i) {
+    const uint64_t word = words[i];
+    // 0x4 is the "heartbeat" signal, 0xA and 0xB are pixel data
+    headers[i] = static_cast<uint8_t>(word >> 60);
+    // pixel address from double column, super pixel, and pixel
+    const uint64_t dcol = (word >> 52) & 0xFE;
+    const uint64_t spix = (word >> 45) & 0xFC;
+    const uint64_t pix = (word >> 44) & 0x7;
+    cols[i] = static_cast<uint16_t>(dcol + (pix >> 2));
+    rows[i] = static_cast<uint16_t>(spix + (pix & 0x3));
+    tots[i] = static_cast<uint16_t>((word >> 20) & 0x3FF);
+    // fine and coarse time-of-arrival and the SPIDR time
+    const uint64_t ftoa = (word >> 16) & 0xF;
+    const uint64_t toa = (word >> 30) & 0x3FFF;
+    const uint64_t spidrTime = word & 0xFFFF;
+    times[i] = ((spidrTime << 18) + (toa << 4) + (15 - ftoa)) << 8;
+  }
+}
+
+// Update the heartbeat time base w/ a heartbeat packet.
+void updateSyncTime(uint64_t pixdata,
+                    long long int& syncTime,
+                    bool& clearedHeader)
+{
+  // There is a second 4-bit header that says if it is the most or least
+  // significant part of the timestamp
+  const uint8_t header2 = ((pixdata & 0x0F00000000000000) >> 56) & 0xF;
+
+  // This is a bug fix. There appear to be errant packets with garbage data
+  // - source to be tracked down.
+  // Between the data and the header the intervening bits should all be 0,
+  // check if this is the case
+  const uint8_t intermediateBits =
+      ((pixdata & 0x00FF000000000000) >> 48) & 0xFF;
+  if (intermediateBits != 0x00)
+    return;
+
+  // 0x4 is the least significant part of the timestamp
+  if (header2 == 0x4) {
+    // The data is shifted 16 bits to the right, then 12 to the left in
+    // order to match the timestamp format (net 4 right)
+    syncTime = (syncTime & 0xFFFFF00000000000) +
+               ((pixdata & 0x0000FFFFFFFF0000) >> 4);
+  }
+
+  // 0x5 is the most significant part of the timestamp
+  if (header2 == 0x5) {
+    // The data is shifted 16 bits to the right, then 44 to the left in
+    // order to match the timestamp format (net 28 left)
+    syncTime = (syncTime & 0x00000FFFFFFFFFFF) +
+               ((pixdata & 0x00000000FFFF0000) << 28);
+    // Sometimes data left still in the buffers at the start of a run. For
+    // that reason we keep skipping data until this "header" data has been
+    // cleared, when the heart beat signal starts from a low number (~few
+    // seconds max)
+    if (!clearedHeader && (double)syncTime / (4096. * 40000000.) < 6.) {
+      clearedHeader = true;
+    }
+  }
+}
+
+// Apply the heartbeat time base to all pixel packets in the range.
+//
+// Starts from the heartbeat state at the beginning of the range and
+// replaces the provisional pixel times by the full timestamps. Only pixel
+// packets after the header data has been cleared are accepted.
+void resolveTimes(size_t begin,
+                  size_t end,
+                  const uint64_t* words,
+                  const uint8_t* headers,
+                  long long int syncTime,
+                  bool clearedHeader,
+                  long long int* times,
+                  uint8_t* accepted)
+{
+  for (size_t i = begin; i < end; ++i) {
+    accepted[i] = false;
+
+    if (headers[i] == 0x4)
+      updateSyncTime(words[i], syncTime, clearedHeader);
+    if (!clearedHeader)
+      continue;
+    // Header 0xA and 0xB indicate pixel data
+    if ((headers[i] != 0xA) && (headers[i] != 0xB))
+      continue;
+
+    // Add the heartbeat time base to the pixel time
+    long long int time = times[i] + (syncTime & 0xFFFFFC0000000000);
+
+    // The time from the pixels has a maximum value of ~26 seconds. We compare
+    // the pixel time to the "heartbeat" signal (which has an overflow of ~4
+    // years) and check if the pixel time has wrapped back around to 0
+
+    // If the counter overflow happens before reading the new heartbeat
+    while (syncTime - time > 0x0000020000000000) {
+      time += 0x0000040000000000;
+    }
+
+    times[i] = time;
+    accepted[i] = true;
+  }
+}
+
+} // namespace
 
 int Timepix3Reader::check(const std::string& path)
 {
@@ -46,6 +173,8 @@ Timepix3Reader::open(const std::string& path,
 
 Timepix3Reader::Timepix3Reader(const std::string& path)
     : m_file()
+    , m_decodedBytes(0)
+    , m_decodeSeconds(0)
     , m_syncTime(0)
     , m_prevTime(0)
     , m_clearedHeader(false)
@@ -74,6 +203,24 @@ Timepix3Reader::Timepix3Reader(const std::string& path)
   // Skip the full header:
   m_file.seekg(headerSize);
   INFO("Reading ''", path, "', skipped ", headerSize, " header bytes");
+
+  m_block.words.resize(kBlockWords);
+  m_block.headers.resize(kBlockWords);
+  m_block.cols.resize(kBlockWords);
+  m_block.rows.resize(kBlockWords);
+  m_block.tots.resize(kBlockWords);
+  m_block.times.resize(kBlockWords);
+  m_block.accepted.resize(kBlockWords);
+  m_block.chunks.resize(kBlockChunks);
+}
+
+Timepix3Reader::~Timepix3Reader()
+{
+  if (0 < m_decodeSeconds) {
+    INFO("decoded ", m_decodedBytes / (1024. * 1024.), " MB in ",
+         m_decodeSeconds, " s (",
+         m_decodedBytes / (1024. * 1024. * m_decodeSeconds), " MB/s)");
+  }
 }
 
 std::string Timepix3Reader::name() const { return "Timepix3Reader"; }
@@ -102,6 +249,62 @@ bool Timepix3Reader::read(Event& event)
   return status;
 }
 
+bool Timepix3Reader::readBlock()
+{
+  m_file.read(reinterpret_cast<char*>(m_block.words.data()),
+              m_block.words.size() * sizeof(uint64_t));
+  // an incomplete trailing word is ignored
+  m_block.size = static_cast<size_t>(m_file.gcount()) / sizeof(uint64_t);
+  m_block.next = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  size_t numChunks = (m_block.size + kChunkWords - 1) / kChunkWords;
+
+  // 1. decode all chunks w/ a provisional time base and find the heartbeats
+  globalThreadPool().parallelFor(numChunks, [&](size_t, size_t ichunk) {
+    size_t begin = ichunk * kChunkWords;
+    size_t end = std::min(m_block.size, begin + kChunkWords);
+    Chunk& chunk = m_block.chunks[ichunk];
+    decodeWords(end - begin, &m_block.words[begin], &m_block.headers[begin],
+                &m_block.cols[begin], &m_block.rows[begin],
+                &m_block.tots[begin], &m_block.times[begin]);
+    chunk.heartbeats.clear();
+    for (size_t i = begin; i < end; ++i) {
+      if (m_block.headers[i] == 0x4)
+        chunk.heartbeats.push_back(i);
+    }
+  });
+
+  // 2. propagate the heartbeat time base serially through all chunks
+  for (size_t ichunk = 0; ichunk < numChunks; ++ichunk) {
+    Chunk& chunk = m_block.chunks[ichunk];
+    chunk.syncTime = m_syncTime;
+    chunk.clearedHeader = m_clearedHeader;
+    for (auto i : chunk.heartbeats) {
+      updateSyncTime(m_block.words[i], m_syncTime, m_clearedHeader);
+      DEBUG("'Heartbeat' timestamp: ",
+            (double)m_syncTime / (4096. * 40000000.));
+    }
+  }
+
+  // 3. repair the pixel timestamps starting from the chunk time base
+  globalThreadPool().parallelFor(numChunks, [&](size_t, size_t ichunk) {
+    size_t begin = ichunk * kChunkWords;
+    size_t end = std::min(m_block.size, begin + kChunkWords);
+    const Chunk& chunk = m_block.chunks[ichunk];
+    resolveTimes(begin, end, m_block.words.data(), m_block.headers.data(),
+                 chunk.syncTime, chunk.clearedHeader, m_block.times.data(),
+                 m_block.accepted.data());
+  });
+
+  std::chrono::duration<double> duration =
+      std::chrono::steady_clock::now() - start;
+  m_decodedBytes += m_block.size * sizeof(uint64_t);
+  m_decodeSeconds += duration.count();
+
+  return (0 < m_block.size);
+}
+
 bool Timepix3Reader::getSensorEvent(SensorEvent& sensorEvent)
 {
 
@@ -111,137 +314,45 @@ bool Timepix3Reader::getSensorEvent(SensorEvent& sensorEvent)
 
   // Count pixels read in this "frame"
   int npixels = 0;
+  // Whether the event was terminated by the next hit or by the end of data
+  bool isComplete = false;
 
-  // Read 64-bit chunks of data
-  uint64_t pixdata = 0;
-  while (m_file.read(reinterpret_cast<char*>(&pixdata), sizeof(pixdata))) {
-
-    std::stringstream s;
-    s << std::hex << pixdata << std::dec;
-    DEBUG("Data: 0x", s.str());
-
-    // Get the header (first 4 bits) and do things depending on what it is
-    // 0x4 is the "heartbeat" signal, 0xA and 0xB are pixel data
-    const uint8_t header = ((pixdata & 0xF000000000000000) >> 60) & 0xF;
-
-    if (header == 0x7) {
-      DEBUG("Header 0x7: 'Config Acknowledge'");
-    }
-
-    if (header == 0x4) {
-      DEBUG("Header 0x4: 'Heartbeat'");
-      // The 0x4 header tells us that it is part of the timestamp
-      // There is a second 4-bit header that says if it is the most or least
-      // significant part of the timestamp
-      const uint8_t header2 = ((pixdata & 0x0F00000000000000) >> 56) & 0xF;
-
-      // This is a bug fix. There appear to be errant packets with garbage data
-      // - source to be tracked down.
-      // Between the data and the header the intervening bits should all be 0,
-      // check if this is the case
-      const uint8_t intermediateBits =
-          ((pixdata & 0x00FF000000000000) >> 48) & 0xFF;
-      if (intermediateBits != 0x00)
-        continue;
-
-      // 0x4 is the least significant part of the timestamp
-      if (header2 == 0x4) {
-        DEBUG("            'Heartbeat' LSB");
-        // The data is shifted 16 bits to the right, then 12 to the left in
-        // order to match the timestamp format (net 4 right)
-        m_syncTime = (m_syncTime & 0xFFFFF00000000000) +
-                     ((pixdata & 0x0000FFFFFFFF0000) >> 4);
-      }
-
-      // 0x5 is the most significant part of the timestamp
-      if (header2 == 0x5) {
-        DEBUG("            'Heartbeat' MSB");
-        // The data is shifted 16 bits to the right, then 44 to the left in
-        // order to match the timestamp format (net 28 left)
-        m_syncTime = (m_syncTime & 0x00000FFFFFFFFFFF) +
-                     ((pixdata & 0x00000000FFFF0000) << 28);
-        if (!m_clearedHeader && (double)m_syncTime / (4096. * 40000000.) < 6.) {
-          DEBUG("Cleared header");
-          m_clearedHeader = true;
-        }
-        DEBUG("            'Heartbeat' timestamp: ",
-              (double)m_syncTime / (4096. * 40000000.));
-      }
-    }
-
-    // Sometimes data left still in the buffers at the start of a run. For that
-    // reason we keep skipping data until this "header" data has been cleared,
-    // when the heart beat signal starts from a low number (~few seconds max)
-    if (!m_clearedHeader)
+  // Process the decoded pixel packets in file order
+  while ((m_block.next < m_block.size) || readBlock()) {
+    const size_t i = m_block.next++;
+    if (!m_block.accepted[i])
       continue;
 
-    // Header 0x06 and 0x07 are the start and stop signals for power pulsing
-    if (header == 0x0) {
-      DEBUG("Header 0x0: 'Power Pulsing'");
+    const long long int time = m_block.times[i];
+    DEBUG("Calculated timestamp: ", time, ", ",
+          ((double)time / (4096. * 40000000.)));
+
+    // If events are loaded based on time intervals, take all hits where the
+    // time is within this window
+
+    // Stop looking at data if the pixel is after the current event window
+    // (and push it back so that we start with this pixel next event)
+    if (event_length_time > 0. &&
+        ((double)time / (4096. * 40000000.)) >
+            ((m_eventNumber + 1) * event_length_time)) {
+      DEBUG("Configured event length reached: ",
+            ((double)time / (4096. * 40000000.)), " > ",
+            ((m_eventNumber + 1) * event_length_time));
+      m_block.next = i;
+      m_nextEventTimestamp = time;
+      isComplete = true;
+      break;
     }
 
-    // Header 0xA and 0xB indicate pixel data
-    if (header == 0xA || header == 0xB) {
-      DEBUG("Header 0xA | 0xB: 'Pixel Data'");
-      // Decode the pixel information from the relevant bits
-      const uint16_t dcol = ((pixdata & 0x0FE0000000000000) >> 52);
-      const uint16_t spix = ((pixdata & 0x001F800000000000) >> 45);
-      const uint16_t pix = ((pixdata & 0x0000700000000000) >> 44);
-      const uint16_t col = (dcol + pix / 4);
-      const uint16_t row = (spix + (pix & 0x3));
-
-      // Get the rest of the data from the pixel
-      const uint32_t data = ((pixdata & 0x00000FFFFFFF0000) >> 16);
-      const unsigned int tot = (data & 0x00003FF0) >> 4;
-      const uint64_t spidrTime(pixdata & 0x000000000000FFFF);
-      const uint64_t ftoa(data & 0x0000000F);
-      const uint64_t toa((data & 0x0FFFC000) >> 14);
-
-      // Calculate the timestamp.
-      long long int time =
-          (((spidrTime << 18) + (toa << 4) + (15 - ftoa)) << 8) +
-          (m_syncTime & 0xFFFFFC0000000000);
-      DEBUG("Calculated timestamp: ", time, ", ",
-            ((double)time / (4096. * 40000000.)));
-
-      // Add the timing offset from the coniditions file (if any)
-      // FIXME re-add if necessary
-
-      // The time from the pixels has a maximum value of ~26 seconds. We compare
-      // the pixel time to the "heartbeat" signal (which has an overflow of ~4
-      // years) and check if the pixel time has wrapped back around to 0
-
-      // If the counter overflow happens before reading the new heartbeat
-      while (m_syncTime - time > 0x0000020000000000) {
-        time += 0x0000040000000000;
-        DEBUG("Adjusting timestamp to account for pixel timestamp overflow");
-      }
-
-      // If events are loaded based on time intervals, take all hits where the
-      // time is within this window
-
-      // Stop looking at data if the pixel is after the current event window
-      // (and rewind the file reader so that we start with this pixel next
-      // event)
-      if (event_length_time > 0. &&
-          ((double)time / (4096. * 40000000.)) >
-              ((m_eventNumber + 1) * event_length_time)) {
-        DEBUG("Configured event length reached: ",
-              ((double)time / (4096. * 40000000.)), " > ",
-              ((m_eventNumber + 1) * event_length_time));
-        m_file.seekg(-1 * sizeof(pixdata), std::ios_base::cur);
-        m_nextEventTimestamp = time;
-        break;
-      }
-
-      // Otherwise create a new pixel object
-      Hit& hit = sensorEvent.addHit(col, row,
-                                    ((float)time / (4096. * 40000000.)), tot);
-
-      DEBUG("Pixel #", npixels, ": ", hit);
-      npixels++;
-      m_prevTime = time;
-    }
+    // Otherwise create a new pixel object
+    const unsigned int tot = m_block.tots[i];
+    Hit& hit =
+        sensorEvent.addHit(m_block.cols[i], m_block.rows[i],
+                           ((float)time / (4096. * 40000000.)), tot);
+
+    DEBUG("Pixel #", npixels, ": ", hit);
+    npixels++;
+    m_prevTime = time;
   }
 
   // Clear the event if we have more than 10% chip occupancy
@@ -254,11 +365,7 @@ bool Timepix3Reader::getSensorEvent(SensorEvent& sensorEvent)
   // Increment global time stamp:
   m_eventNumber++;
 
-  if (m_file.eof()) {
-    return false;
-  } else {
-    return true;
-  }
+  return isComplete;
 }
 
 } // namespace proteus
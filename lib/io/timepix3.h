@@ -17,7 +17,15 @@ class Value;
 }
 namespace proteus {
 
-/** Read events from a Timepix3 raw data file. */
+/** Read events from a Timepix3 raw data file.
+ *
+ * The raw data words are read in large blocks that are split into chunks at
+ * packet boundaries. The pixel packets in all chunks are decoded in parallel
+ * w/ a provisional time base. Only the heartbeat packets are processed
+ * serially to determine the time base at the start of each chunk, which
+ * is then used to repair the pixel timestamps again in parallel. The
+ * decoded hits are split into time-based events in file order.
+ */
 class Timepix3Reader : public Reader {
 public:
   /** Return a score of how likely the given path is an Timepix3 SPDR data file.
@@ -28,7 +36,7 @@ public:
                                               const toml::Value& /* unused */);
 
   Timepix3Reader(const std::string& path);
-  ~Timepix3Reader(){};
+  ~Timepix3Reader();
 
   std::string name() const;
   uint64_t numEvents() const { return UINT64_MAX; };
@@ -38,6 +46,36 @@ public:
   bool read(Event& event);
 
 private:
+  /** Independently decoded part of a block. */
+  struct Chunk {
+    // position of the heartbeat packets within the block
+    std::vector<size_t> heartbeats;
+    // heartbeat state at the start of the chunk
+    long long int syncTime = 0;
+    bool clearedHeader = false;
+  };
+  /** Raw data words w/ their pixel content decoded independent of the type. */
+  struct Block {
+    std::vector<uint64_t> words;
+    std::vector<uint8_t> headers;
+    std::vector<uint16_t> cols;
+    std::vector<uint16_t> rows;
+    std::vector<uint16_t> tots;
+    // full pixel timestamps including the heartbeat time base
+    std::vector<long long int> times;
+    // whether the word is a pixel packet that should be used
+    std::vector<uint8_t> accepted;
+    std::vector<Chunk> chunks;
+    // number of valid words and position of the next unprocessed word
+    size_t size = 0;
+    size_t next = 0;
+  };
+
+  /** Read and decode the next block of data words in parallel.
+   *
+   * \returns false if no more data is available
+   */
+  bool readBlock();
   /** Returns one decoded sensorEvent for the current detector
    *
    * \returns SensorEvent for the current detector
@@ -46,6 +84,10 @@ private:
 
   /** File stream for the binary data file */
   std::ifstream m_file;
+  Block m_block;
+  // decoding statistics
+  uint64_t m_decodedBytes;
+  double m_decodeSeconds;
 
   long long int m_syncTime;
   long long int m_prevTime;
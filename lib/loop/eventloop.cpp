@@ -287,6 +287,11 @@ void EventLoop::run()
     progress.update(processed + 1);
   }
   progress.clear();
+  size_t iprocessor = timing.processors.size() - m_processors.size();
+  for (const auto& processor : m_processors) {
+    StopWatch sw(timing.processors[iprocessor++]);
+    processor->finalize();
+  }
   size_t ianalyzer = 0;
   for (const auto& analyzer : m_analyzers) {
     StopWatch sw(timing.analyzers[ianalyzer++]);
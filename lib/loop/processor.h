@@ -19,6 +19,8 @@ public:
   virtual ~Processor() = default;
   virtual std::string name() const = 0;
   virtual void execute(Event&) const = 0;
+  /** The finalize method is optional. */
+  virtual void finalize() {}
 };
 
 } // namespace proteus
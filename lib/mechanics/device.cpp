@@ -184,6 +184,7 @@ void Device::setGeometry(const Geometry& geometry)
   for (auto& sensor : m_sensors) {
     sensor.updateGeometry(m_geometry);
   }
+  m_compiledGeometry = CompiledGeometry(m_geometry, numSensors());
   // TODO 2016-08-18 msmk: check number of sensors / id consistency
 }
 
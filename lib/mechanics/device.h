@@ -47,6 +47,11 @@ public:
   /** Store the geometry and apply it to all configured sensors. */
   void setGeometry(const Geometry& geometry);
   const Geometry& geometry() const { return m_geometry; }
+  /** Precomputed geometry view; rebuilt whenever the geometry is set. */
+  const CompiledGeometry& compiledGeometry() const
+  {
+    return m_compiledGeometry;
+  }
 
   /** Store the pixel masks, merging it with the already existing one,
    *  and apply to all configured sensors. */
@@ -62,6 +67,7 @@ private:
   std::vector<Index> m_sensorIds;
   std::vector<Sensor> m_sensors;
   Geometry m_geometry;
+  CompiledGeometry m_compiledGeometry;
   PixelMasks m_pixelMasks;
 };
 
@@ -489,6 +489,25 @@ void Geometry::print(std::ostream& os, const std::string& prefix) const
   os.flush();
 }
 
+CompiledGeometry::CompiledGeometry(const Geometry& geometry, Index numSensors)
+{
+  m_planes.reserve(numSensors);
+  m_beamSlopes.reserve(numSensors);
+  for (Index sensorId = 0; sensorId < numSensors; ++sensorId) {
+    m_planes.push_back(geometry.getPlane(sensorId));
+    m_beamSlopes.push_back(geometry.getBeamSlope(sensorId));
+  }
+  m_linearTransforms.reserve(numSensors * numSensors);
+  m_sourceOrigins.reserve(numSensors * numSensors);
+  for (const auto& source : m_planes) {
+    for (const auto& target : m_planes) {
+      m_linearTransforms.push_back(target.linearToLocal() *
+                                   source.linearToGlobal());
+      m_sourceOrigins.push_back(target.toLocal(source.origin()));
+    }
+  }
+}
+
 void sortAlongBeam(const Geometry& geo, std::vector<Index>& sensorIds)
 {
   // TODO 2017-10 msmk: actually sort along beam direction and not just along
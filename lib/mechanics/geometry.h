@@ -3,9 +3,11 @@
 
 #pragma once
 
+#include <cassert>
 #include <iosfwd>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <Eigen/SVD>
 
@@ -221,6 +223,59 @@ public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
+/** Flat, precomputed view of the geometry for all sensors of a device.
+ *
+ * Planes are stored contiguously and are indexed directly by the sensor id,
+ * i.e. w/o a map lookup. The transformations between all pairs of sensors
+ * and the beam slopes in the local systems are precomputed. The view is a
+ * snapshot and does not follow later changes of the source geometry.
+ */
+class CompiledGeometry {
+public:
+  /** Construct an empty view w/o any sensors. */
+  CompiledGeometry() = default;
+  /** Precompute the view for the sensors w/ ids `0 <= id < numSensors`. */
+  CompiledGeometry(const Geometry& geometry, Index numSensors);
+
+  Index numSensors() const { return static_cast<Index>(m_planes.size()); }
+  /** The local sensor plane object. */
+  const Plane& getPlane(Index sensorId) const
+  {
+    assert((sensorId < m_planes.size()) and "Invalid sensor id");
+    return m_planes[sensorId];
+  }
+  /** Linear transformation from the source to the target sensor system. */
+  const Matrix4& getLinearTransform(Index sourceId, Index targetId) const
+  {
+    return m_linearTransforms[pairIndex(sourceId, targetId)];
+  }
+  /** Origin of the source sensor system in the target sensor system. */
+  const Vector4& getSourceOrigin(Index sourceId, Index targetId) const
+  {
+    return m_sourceOrigins[pairIndex(sourceId, targetId)];
+  }
+  /** Beam direction in the local coordinate system of the sensor. */
+  const Vector2& getBeamSlope(Index sensorId) const
+  {
+    assert((sensorId < m_planes.size()) and "Invalid sensor id");
+    return m_beamSlopes[sensorId];
+  }
+
+private:
+  size_t pairIndex(Index sourceId, Index targetId) const
+  {
+    assert((sourceId < m_planes.size()) and "Invalid source sensor id");
+    assert((targetId < m_planes.size()) and "Invalid target sensor id");
+    return sourceId * m_planes.size() + targetId;
+  }
+
+  std::vector<Plane> m_planes;
+  // source-major matrices of transformations between all sensor pairs
+  std::vector<Matrix4> m_linearTransforms;
+  std::vector<Vector4> m_sourceOrigins;
+  std::vector<Vector2> m_beamSlopes;
+};
+
 /** Sort the sensor indices by their position along the beam direction. */
 void sortAlongBeam(const Geometry& geo, std::vector<Index>& sensorIds);
 /** Return a copy of the indices sorted along the beam direction. */
@@ -9,8 +9,16 @@
 namespace proteus {
 
 ApplyLocalTransformCartesian::ApplyLocalTransformCartesian(const Sensor& sensor)
-    : m_sensor(sensor)
 {
+  Vector4 scale = sensor.pitch();
+  // the local origin corresponds to the digital pixel center
+  Vector4 center = sensor.transformLocalToPixel(Vector4::Zero());
+  m_scaleU = scale[kU];
+  m_scaleV = scale[kV];
+  m_scaleS = scale[kS];
+  m_centerU = center[kU];
+  m_centerV = center[kV];
+  m_centerS = center[kS];
 }
 
 std::string ApplyLocalTransformCartesian::name() const
@@ -20,19 +28,24 @@ std::string ApplyLocalTransformCartesian::name() const
 
 void ApplyLocalTransformCartesian::execute(SensorEvent& sensorEvent) const
 {
-  DiagMatrix4 scalePitch = m_sensor.pitch().asDiagonal();
+  // the pitch scaling is diagonal. every element is scaled independently
+  // and only the non-zero covariance elements need to be computed.
+  Vector4 pos;
+  SymMatrix4 cov = SymMatrix4::Zero();
+  pos[kW] = 0;
 
   for (Index icluster = 0; icluster < sensorEvent.numClusters(); icluster++) {
     Cluster& cluster = sensorEvent.getCluster(icluster);
 
-    SymMatrix4 cov = SymMatrix4::Zero();
-    cov(kU, kU) = cluster.colVar();
-    cov(kV, kU) = cov(kU, kV) = cluster.colRowCov();
-    cov(kV, kV) = cluster.rowVar();
-    cov(kS, kS) = cluster.timestampVar();
-    cluster.setLocal(m_sensor.transformPixelToLocal(
-                         cluster.col(), cluster.row(), cluster.timestamp()),
-                     transformCovariance(scalePitch, cov));
+    pos[kU] = m_scaleU * (cluster.col() - m_centerU);
+    pos[kV] = m_scaleV * (cluster.row() - m_centerV);
+    pos[kS] = m_scaleS * (cluster.timestamp() - m_centerS);
+    cov(kU, kU) = m_scaleU * cluster.colVar() * m_scaleU;
+    cov(kV, kU) = m_scaleV * cluster.colRowCov() * m_scaleU;
+    cov(kV, kV) = m_scaleV * cluster.rowVar() * m_scaleV;
+    cov(kS, kS) = m_scaleS * cluster.timestampVar() * m_scaleS;
+    // only the lower triangular part is used
+    cluster.setLocal(pos, cov);
   }
 }
 
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "loop/sensorprocessor.h"
+#include "utils/definitions.h"
 
 namespace proteus {
 
@@ -13,7 +14,9 @@ class Sensor;
  *
  * Assumes the two digital coordinates are defined in a Cartesian coordinate
  * system, i.e. with orthogonal axes, with the scaling defined by the sensor
- * pitch.
+ * pitch. The pitch and the pixel center are extracted once during
+ * construction and all clusters of an event are transformed w/ the
+ * resulting per-axis affine map.
  */
 class ApplyLocalTransformCartesian : public SensorProcessor {
 public:
@@ -23,7 +26,9 @@ public:
   void execute(SensorEvent& sensorEvent) const;
 
 private:
-  const Sensor& m_sensor;
+  // per-axis scale and center of the digital-to-local transformation
+  Scalar m_scaleU, m_scaleV, m_scaleS;
+  Scalar m_centerU, m_centerV, m_centerS;
 };
 
 } // namespace proteus
@@ -160,9 +160,10 @@ void BinaryClusterizer::execute(SensorEvent& sensorEvent) const
     auto tsVar = kVar;
     return Cluster(col, row, ts, value, colVar, rowVar, tsVar);
   };
-  auto hitsEnd = maskHits(m_sensor.pixelMask(), sensorEvent.m_hits.begin(),
-                          sensorEvent.m_hits.end());
-  clusterize(sensorEvent, sensorEvent.m_hits.begin(), hitsEnd, makeCluster);
+  auto hitsBegin = sensorEvent.m_hits.begin();
+  auto hitsEnd = maskHits(m_sensor.pixelMask(), hitsBegin,
+                          hitsBegin + sensorEvent.numHits());
+  clusterize(sensorEvent, hitsBegin, hitsEnd, makeCluster);
 }
 
 std::string ValueWeightedClusterizer::name() const
@@ -198,9 +199,10 @@ void ValueWeightedClusterizer::execute(SensorEvent& sensorEvent) const
     auto tsVar = kVar;
     return Cluster(col, row, ts, value, colVar, rowVar, tsVar);
   };
-  auto hitsEnd = maskHits(m_sensor.pixelMask(), sensorEvent.m_hits.begin(),
-                          sensorEvent.m_hits.end());
-  clusterize(sensorEvent, sensorEvent.m_hits.begin(), hitsEnd, makeCluster);
+  auto hitsBegin = sensorEvent.m_hits.begin();
+  auto hitsEnd = maskHits(m_sensor.pixelMask(), hitsBegin,
+                          hitsBegin + sensorEvent.numHits());
+  clusterize(sensorEvent, hitsBegin, hitsEnd, makeCluster);
 }
 
 std::string FastestHitClusterizer::name() const
@@ -228,9 +230,10 @@ void FastestHitClusterizer::execute(SensorEvent& sensorEvent) const
 
     return Cluster(col, row, ts, value, kVar, kVar, kVar);
   };
-  auto hitsEnd = maskHits(m_sensor.pixelMask(), sensorEvent.m_hits.begin(),
-                          sensorEvent.m_hits.end());
-  clusterize(sensorEvent, sensorEvent.m_hits.begin(), hitsEnd, makeCluster);
+  auto hitsBegin = sensorEvent.m_hits.begin();
+  auto hitsEnd = maskHits(m_sensor.pixelMask(), hitsBegin,
+                          hitsBegin + sensorEvent.numHits());
+  clusterize(sensorEvent, hitsBegin, hitsEnd, makeCluster);
 }
 
 } // namespace proteus
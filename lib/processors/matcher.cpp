@@ -5,18 +5,26 @@
 
 #include <algorithm>
 #include <cassert>
-#include <set>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
 #include <vector>
 
 #include "mechanics/device.h"
 #include "storage/event.h"
+#include "utils/threadpool.h"
 
 namespace proteus {
 
-Matcher::Matcher(const Device& device, Index sensorId, double distanceSigmaMax)
+Matcher::Matcher(const Device& device,
+                 Index sensorId,
+                 double distanceSigmaMax,
+                 bool optimalAssignment)
     : m_sensorId(sensorId)
     , m_distSquaredMax(
           (distanceSigmaMax < 0) ? -1 : (distanceSigmaMax * distanceSigmaMax))
+    , m_optimalAssignment(optimalAssignment)
     , m_name("Matcher(" + device.getSensor(sensorId).name() + ')')
 {
 }
@@ -24,50 +32,333 @@ Matcher::Matcher(const Device& device, Index sensorId, double distanceSigmaMax)
 std::string Matcher::name() const { return m_name; }
 
 namespace {
+
 struct PossibleMatch {
   Index cluster;
   Index track;
   double d2;
 };
+
+/** Minimum cost assignment of rows to distinct columns.
+ *
+ * Implements the Hungarian algorithm w/ row and column potentials in
+ * O(rows^2 * cols). Requires at least as many columns as rows. The working
+ * storage is kept between calls.
+ */
+class Assignment {
+public:
+  /** Compute the assigned column for each row. */
+  void solve(const Eigen::MatrixXd& cost, std::vector<int>& assigned);
+
+private:
+  // potentials, minimum slack, and the augmenting path w/ 1-based indices
+  std::vector<double> m_u, m_v, m_minSlack;
+  std::vector<int> m_rowOf, m_way;
+  std::vector<bool> m_used;
+};
+
+void Assignment::solve(const Eigen::MatrixXd& cost, std::vector<int>& assigned)
+{
+  constexpr double kInf = std::numeric_limits<double>::infinity();
+  int numRows = cost.rows();
+  int numCols = cost.cols();
+
+  assert((numRows <= numCols) and "Assignment needs more columns than rows");
+
+  m_u.assign(numRows + 1, 0);
+  m_v.assign(numCols + 1, 0);
+  m_rowOf.assign(numCols + 1, 0);
+  m_way.assign(numCols + 1, 0);
+  for (int row = 1; row <= numRows; ++row) {
+    // find an augmenting path starting at the new row via the virtual column
+    m_rowOf[0] = row;
+    m_minSlack.assign(numCols + 1, kInf);
+    m_used.assign(numCols + 1, false);
+    int col0 = 0;
+    do {
+      m_used[col0] = true;
+      int row0 = m_rowOf[col0];
+      int col1 = 0;
+      double delta = kInf;
+      for (int col = 1; col <= numCols; ++col) {
+        if (m_used[col]) {
+          continue;
+        }
+        double slack = cost(row0 - 1, col - 1) - m_u[row0] - m_v[col];
+        if (slack < m_minSlack[col]) {
+          m_minSlack[col] = slack;
+          m_way[col] = col0;
+        }
+        if (m_minSlack[col] < delta) {
+          delta = m_minSlack[col];
+          col1 = col;
+        }
+      }
+      for (int col = 0; col <= numCols; ++col) {
+        if (m_used[col]) {
+          m_u[m_rowOf[col]] += delta;
+          m_v[col] -= delta;
+        } else {
+          m_minSlack[col] -= delta;
+        }
+      }
+      col0 = col1;
+    } while (m_rowOf[col0] != 0);
+    // flip the assignments along the augmenting path
+    do {
+      int col1 = m_way[col0];
+      m_rowOf[col0] = m_rowOf[col1];
+      col0 = col1;
+    } while (col0 != 0);
+  }
+
+  assigned.assign(numRows, -1);
+  for (int col = 1; col <= numCols; ++col) {
+    if (m_rowOf[col] != 0) {
+      assigned[m_rowOf[col] - 1] = col - 1;
+    }
+  }
+}
+
 } // namespace
 
+struct Matcher::Buffers {
+  // cluster indices sorted by the u coordinate
+  std::vector<Index> sortedClusters;
+  // cluster positions and covariances in sorted order
+  std::vector<Scalar> clusterU;
+  std::vector<Scalar> clusterV;
+  std::vector<Scalar> clusterVarU;
+  std::vector<Scalar> clusterCovUV;
+  std::vector<Scalar> clusterVarV;
+  std::vector<PossibleMatch> possibleMatches;
+  // possible matches and distances for each block of track states
+  struct Block {
+    std::vector<PossibleMatch> matches;
+    std::vector<double> d2;
+  };
+  std::vector<Block> blocks;
+  // flat sets of already matched tracks and clusters
+  std::vector<bool> matchedTracks;
+  std::vector<bool> matchedClusters;
+  // compact numbering of tracks and clusters for the optimal assignment
+  std::vector<int> rowOf;
+  std::vector<int> colOf;
+  std::vector<Index> rowTracks;
+  std::vector<Index> colClusters;
+  Eigen::MatrixXd cost;
+  std::vector<int> assigned;
+  Assignment assignment;
+};
+
+// number of track states that are preselected together in one parallel task
+static constexpr size_t kPreselectBlockSize = 32;
+
 void Matcher::execute(Event& event) const
 {
+  using ArrayMap = Eigen::Map<const Eigen::ArrayXd>;
+
   SensorEvent& sensorEvent = event.getSensorEvent(m_sensorId);
+  const auto& states = sensorEvent.localStates();
+  Index numClusters = sensorEvent.numClusters();
+  bool useGate = (0 <= m_distSquaredMax);
 
-  std::vector<PossibleMatch> possibleMatches;
-  std::set<Index> matchedClusters;
-  std::set<Index> matchedStates;
-
-  // preselect possible track state / cluster pairs
-  for (const auto& state : sensorEvent.localStates()) {
-    for (Index icluster = 0; icluster < sensorEvent.numClusters(); ++icluster) {
-      const Cluster& cluster = sensorEvent.getCluster(icluster);
-
-      // compute mahalanobis distance between state/cluster
-      Vector2 delta(cluster.u() - state.loc0(), cluster.v() - state.loc1());
-      SymMatrix2 cov = cluster.uvCov() + state.loc01Cov();
-      double d2 = mahalanobisSquared(cov, delta);
-
-      if ((m_distSquaredMax < 0) || (d2 < m_distSquaredMax))
-        possibleMatches.emplace_back(
-            PossibleMatch{icluster, state.track(), d2});
+  // temporary (resuable) storage
+  auto& buffers = m_buffers.local();
+  auto& sortedClusters = buffers.sortedClusters;
+  auto& clusterU = buffers.clusterU;
+  auto& clusterV = buffers.clusterV;
+  auto& clusterVarU = buffers.clusterVarU;
+  auto& clusterCovUV = buffers.clusterCovUV;
+  auto& clusterVarV = buffers.clusterVarV;
+  auto& possibleMatches = buffers.possibleMatches;
+  auto& blocks = buffers.blocks;
+
+  // store clusters sorted along u in contiguous arrays. w/ a distance cut,
+  // only clusters within a window in u are considered. the significance
+  // along u alone is never larger than the full significance and the window
+  // is derived from the largest cluster variance.
+  sortedClusters.resize(numClusters);
+  std::iota(sortedClusters.begin(), sortedClusters.end(), Index(0));
+  std::sort(sortedClusters.begin(), sortedClusters.end(),
+            [&](Index a, Index b) {
+              return std::make_pair(sensorEvent.getCluster(a).u(), a) <
+                     std::make_pair(sensorEvent.getCluster(b).u(), b);
+            });
+  clusterU.resize(numClusters);
+  clusterV.resize(numClusters);
+  clusterVarU.resize(numClusters);
+  clusterCovUV.resize(numClusters);
+  clusterVarV.resize(numClusters);
+  for (Index i = 0; i < numClusters; ++i) {
+    const Cluster& cluster = sensorEvent.getCluster(sortedClusters[i]);
+    clusterU[i] = cluster.u();
+    clusterV[i] = cluster.v();
+    clusterVarU[i] = cluster.uvCov()(0, 0);
+    clusterCovUV[i] = cluster.uvCov()(1, 0);
+    clusterVarV[i] = cluster.uvCov()(1, 1);
+  }
+  Scalar clusterVarUMax = 0;
+  if (0 < numClusters) {
+    clusterVarUMax = *std::max_element(clusterVarU.begin(), clusterVarU.end());
+  }
+
+  // preselect possible track state / cluster pairs in parallel
+  size_t numBlocks =
+      (states.size() + kPreselectBlockSize - 1) / kPreselectBlockSize;
+  if (blocks.size() < numBlocks) {
+    blocks.resize(numBlocks);
+  }
+  globalThreadPool().parallelFor(numBlocks, [&](size_t, size_t iblock) {
+    auto& block = blocks[iblock];
+    size_t end = std::min(states.size(), (iblock + 1) * kPreselectBlockSize);
+
+    block.matches.clear();
+    for (size_t istate = iblock * kPreselectBlockSize; istate < end;
+         ++istate) {
+      const auto& state = states[istate];
+      const SymMatrix2& stateCov = state.loc01Cov();
+
+      // range of sorted clusters that need to be considered
+      size_t first = 0;
+      size_t last = numClusters;
+      if (useGate) {
+        Scalar window =
+            std::sqrt(m_distSquaredMax * (clusterVarUMax + stateCov(0, 0)));
+        first = std::lower_bound(clusterU.begin(), clusterU.end(),
+                                 state.loc0() - window) -
+                clusterU.begin();
+        last = std::upper_bound(clusterU.begin() + first, clusterU.end(),
+                                state.loc0() + window) -
+               clusterU.begin();
+      }
+      if (last <= first) {
+        continue;
+      }
+
+      // compute mahalanobis distances between state/clusters in one batch
+      size_t size = last - first;
+      block.d2.resize(size);
+      Eigen::Map<Eigen::ArrayXd>(block.d2.data(), size) =
+          mahalanobisSquaredBatch2(
+              ArrayMap(clusterVarU.data() + first, size) + stateCov(0, 0),
+              ArrayMap(clusterCovUV.data() + first, size) + stateCov(1, 0),
+              ArrayMap(clusterVarV.data() + first, size) + stateCov(1, 1),
+              ArrayMap(clusterU.data() + first, size) - state.loc0(),
+              ArrayMap(clusterV.data() + first, size) - state.loc1());
+      for (size_t i = 0; i < size; ++i) {
+        double d2 = block.d2[i];
+        if (not useGate or (d2 < m_distSquaredMax))
+          block.matches.emplace_back(
+              PossibleMatch{sortedClusters[first + i], state.track(), d2});
+      }
     }
+  });
+  // combine in the original order to be independent of the scheduling
+  possibleMatches.clear();
+  for (size_t iblock = 0; iblock < numBlocks; ++iblock) {
+    possibleMatches.insert(possibleMatches.end(),
+                           blocks[iblock].matches.begin(),
+                           blocks[iblock].matches.end());
+  }
+
+  if (m_optimalAssignment) {
+    matchOptimal(event.numTracks(), buffers, sensorEvent);
+  } else {
+    matchClosest(event.numTracks(), buffers, sensorEvent);
   }
-  // sort by pair distance, closest distance first
+}
+
+void Matcher::matchClosest(Index numTracks,
+                           Buffers& buffers,
+                           SensorEvent& sensorEvent) const
+{
+  auto& possibleMatches = buffers.possibleMatches;
+  auto& matchedTracks = buffers.matchedTracks;
+  auto& matchedClusters = buffers.matchedClusters;
+
+  // sort by pair distance, closest distance first. ties are resolved by the
+  // indices to be independent of the preselection order.
   std::sort(possibleMatches.begin(), possibleMatches.end(),
             [](const PossibleMatch& a, const PossibleMatch& b) {
-              return (a.d2 < b.d2);
+              return std::tie(a.d2, a.track, a.cluster) <
+                     std::tie(b.d2, b.track, b.cluster);
             });
   // select unique matches, closest distance first
+  matchedTracks.assign(numTracks, false);
+  matchedClusters.assign(sensorEvent.numClusters(), false);
   for (const auto& match : possibleMatches) {
-    if ((0 < matchedClusters.count(match.cluster)) ||
-        (0 < matchedStates.count(match.track)))
+    if (matchedClusters[match.cluster] or matchedTracks[match.track])
       continue;
-    matchedClusters.insert(match.cluster);
-    matchedStates.insert(match.track);
+    matchedClusters[match.cluster] = true;
+    matchedTracks[match.track] = true;
     sensorEvent.addMatch(match.cluster, match.track);
   }
 }
 
+void Matcher::matchOptimal(Index numTracks,
+                           Buffers& buffers,
+                           SensorEvent& sensorEvent) const
+{
+  const auto& possibleMatches = buffers.possibleMatches;
+  auto& rowOf = buffers.rowOf;
+  auto& colOf = buffers.colOf;
+  auto& rowTracks = buffers.rowTracks;
+  auto& colClusters = buffers.colClusters;
+  auto& cost = buffers.cost;
+  auto& assigned = buffers.assigned;
+
+  // only tracks and clusters w/ at least one possible match are considered
+  rowOf.assign(numTracks, -1);
+  colOf.assign(sensorEvent.numClusters(), -1);
+  rowTracks.clear();
+  colClusters.clear();
+  double d2Max = 0;
+  for (const auto& match : possibleMatches) {
+    if (rowOf[match.track] < 0) {
+      rowOf[match.track] = rowTracks.size();
+      rowTracks.push_back(match.track);
+    }
+    if (colOf[match.cluster] < 0) {
+      colOf[match.cluster] = colClusters.size();
+      colClusters.push_back(match.cluster);
+    }
+    d2Max = std::max(d2Max, match.d2);
+  }
+  if (possibleMatches.empty()) {
+    return;
+  }
+
+  // incompatible pairs cost as much as the distance cut, i.e. the same as
+  // leaving the track unmatched. the assignment requires rows <= columns.
+  double penalty = (0 <= m_distSquaredMax) ? m_distSquaredMax : (d2Max + 1);
+  bool transposed = (colClusters.size() < rowTracks.size());
+  if (transposed) {
+    cost.setConstant(colClusters.size(), rowTracks.size(), penalty);
+  } else {
+    cost.setConstant(rowTracks.size(), colClusters.size(), penalty);
+  }
+  for (const auto& match : possibleMatches) {
+    int row = rowOf[match.track];
+    int col = colOf[match.cluster];
+    if (transposed) {
+      cost(col, row) = match.d2;
+    } else {
+      cost(row, col) = match.d2;
+    }
+  }
+  buffers.assignment.solve(cost, assigned);
+
+  for (int i = 0; i < static_cast<int>(assigned.size()); ++i) {
+    int j = assigned[i];
+    // assignments to incompatible pairs correspond to unmatched tracks
+    if ((j < 0) or (penalty <= cost(i, j))) {
+      continue;
+    }
+    int row = transposed ? j : i;
+    int col = transposed ? i : j;
+    sensorEvent.addMatch(colClusters[col], rowTracks[row]);
+  }
+}
+
 } // namespace proteus
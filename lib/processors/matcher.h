@@ -7,17 +7,26 @@
 
 #include "loop/processor.h"
 #include "utils/definitions.h"
+#include "utils/scratch.h"
 
 namespace proteus {
 
 class Device;
+class SensorEvent;
 
 /** Match tracks and clusters on a sensor plane.
  *
  * This matches the closest track/cluster pair together. The track must have
  * a local state on the selected sensor to be considered for matching. The
  * matching is unique, i.e. every track and every cluster is matched at most
- * once.
+ * once. Possible track/cluster pairs are preselected in parallel using the
+ * global thread pool. With a distance cut, only clusters within a window
+ * along the first local axis are considered for each track.
+ *
+ * Optionally, the matches are selected by a global assignment that
+ * minimizes the sum of the squared distances of all matched pairs. Tracks
+ * that remain unmatched contribute the distance cut to the sum. This can
+ * find more or better matches in dense events.
  *
  * \note This algorithm processes only a single sensor, but it can not be
  *       implemented as a `SensorProcessor`. It needs to run after the tracking,
@@ -30,16 +39,33 @@ public:
    * \param device The device setup.
    * \param sensorId The sensor for which matching should be calculated.
    * \param distanceSigmaMax Maximum matching significance, negativ disables.
+   * \param optimalAssignment Minimize the total distance of all matches
+   *                          instead of matching the closest pairs first.
    */
-  Matcher(const Device& device, Index sensorId, double distanceSigmaMax = -1);
+  Matcher(const Device& device,
+          Index sensorId,
+          double distanceSigmaMax = -1,
+          bool optimalAssignment = false);
 
   std::string name() const;
   void execute(Event& event) const;
 
 private:
+  // Temporary storage that is reused between events
+  struct Buffers;
+
+  void matchClosest(Index numTracks,
+                    Buffers& buffers,
+                    SensorEvent& sensorEvent) const;
+  void matchOptimal(Index numTracks,
+                    Buffers& buffers,
+                    SensorEvent& sensorEvent) const;
+
   Index m_sensorId;
   double m_distSquaredMax;
+  bool m_optimalAssignment;
   std::string m_name;
+  mutable Scratch<Buffers> m_buffers;
 };
 
 } // namespace proteus
@@ -5,24 +5,59 @@
 
 #include <algorithm>
 #include <ostream>
+#include <stdexcept>
 
 #include "storage/track.h"
 
 namespace proteus {
 
-SensorEvent::SensorEvent() : m_frame(UINT64_MAX), m_timestamp(UINT64_MAX) {}
+SensorEvent::SensorEvent()
+    : m_frame(UINT64_MAX)
+    , m_timestamp(UINT64_MAX)
+    , m_numHits(0)
+    , m_numClusters(0)
+{
+}
 
 void SensorEvent::clear(uint64_t frame, uint64_t timestamp)
 {
   m_frame = frame;
   m_timestamp = timestamp;
-  m_hits.clear();
-  m_clusters.clear();
+  // keep the hit and cluster objects for the next event
+  m_numHits = 0;
+  m_numClusters = 0;
   m_states.clear();
 }
 
+Index SensorEvent::checkHit(Index ihit) const
+{
+  if (m_numHits <= ihit) {
+    throw std::out_of_range("Invalid hit index");
+  }
+  return ihit;
+}
+
+Index SensorEvent::checkCluster(Index icluster) const
+{
+  if (m_numClusters <= icluster) {
+    throw std::out_of_range("Invalid cluster index");
+  }
+  return icluster;
+}
+
+void SensorEvent::allocateLocalStates(Index numTracks)
+{
+  m_states.assign(numTracks, TrackState());
+  for (Index itrack = 0; itrack < numTracks; ++itrack) {
+    m_states[itrack].m_track = itrack;
+  }
+}
+
 bool SensorEvent::hasLocalState(Index itrack) const
 {
+  if ((itrack < m_states.size()) and (m_states[itrack].track() == itrack)) {
+    return true;
+  }
   return (std::find_if(m_states.begin(), m_states.end(),
                        [=](const TrackState& state) {
                          return (state.track() == itrack);
@@ -31,6 +66,10 @@ bool SensorEvent::hasLocalState(Index itrack) const
 
 const TrackState& SensorEvent::getLocalState(Index itrack) const
 {
+  // states are usually stored in track order
+  if ((itrack < m_states.size()) and (m_states[itrack].track() == itrack)) {
+    return m_states[itrack];
+  }
   auto it = std::find_if(
       m_states.begin(), m_states.end(),
       [=](const TrackState& state) { return (state.track() == itrack); });
@@ -45,7 +84,7 @@ void SensorEvent::addMatch(Index icluster, Index itrack)
   auto isInTrack = [=](const TrackState& state) {
     return (state.track() == itrack);
   };
-  auto& cluster = m_clusters.at(icluster);
+  auto& cluster = m_clusters.at(checkCluster(icluster));
   auto state = std::find_if(m_states.begin(), m_states.end(), isInTrack);
   if (state == m_states.end()) {
     throw std::out_of_range("Invalid track index");
@@ -71,14 +110,14 @@ void SensorEvent::print(std::ostream& os, const std::string& prefix) const
 {
   os << prefix << "frame: " << m_frame << '\n';
   os << prefix << "timestamp: " << m_timestamp << '\n';
-  if (!m_hits.empty()) {
+  if (0 < m_numHits) {
     os << prefix << "hits:\n";
-    for (size_t ihit = 0; ihit < m_hits.size(); ++ihit)
+    for (Index ihit = 0; ihit < m_numHits; ++ihit)
       os << prefix << "  " << ihit << ": " << *m_hits[ihit] << '\n';
   }
-  if (!m_clusters.empty()) {
+  if (0 < m_numClusters) {
     os << prefix << "clusters:\n";
-    for (size_t icluster = 0; icluster < m_clusters.size(); ++icluster) {
+    for (Index icluster = 0; icluster < m_numClusters; ++icluster) {
       os << prefix << "  " << icluster << ": " << *m_clusters[icluster] << '\n';
     }
   }
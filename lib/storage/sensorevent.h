@@ -21,7 +21,9 @@ class FastestHitClusterizer;
 
 /** An event for a single sensor containing only local information.
  *
- * Contains hits, clusters, and local track states.
+ * Contains hits, clusters, and local track states. Hit and cluster objects
+ * are kept when the event is cleared and are reused by subsequent events to
+ * avoid one allocation per object and event.
  */
 class SensorEvent {
 public:
@@ -34,22 +36,32 @@ public:
 
   template <typename... Params>
   Hit& addHit(Params&&... params);
-  Index numHits() const { return static_cast<Index>(m_hits.size()); }
-  Hit& getHit(Index ihit) { return *m_hits.at(ihit); }
-  const Hit& getHit(Index ihit) const { return *m_hits.at(ihit); }
+  Index numHits() const { return m_numHits; }
+  Hit& getHit(Index ihit) { return *m_hits.at(checkHit(ihit)); }
+  const Hit& getHit(Index ihit) const { return *m_hits.at(checkHit(ihit)); }
 
   template <typename... Params>
   Cluster& addCluster(Params&&... params);
-  Index numClusters() const { return static_cast<Index>(m_clusters.size()); }
-  Cluster& getCluster(Index icluster) { return *m_clusters.at(icluster); }
+  Index numClusters() const { return m_numClusters; }
+  Cluster& getCluster(Index icluster)
+  {
+    return *m_clusters.at(checkCluster(icluster));
+  }
   const Cluster& getCluster(Index icluster) const
   {
-    return *m_clusters.at(icluster);
+    return *m_clusters.at(checkCluster(icluster));
   }
 
   /** Set a local track state for the given track. */
   template <typename... Params>
   void setLocalState(Index itrack, Params&&... params);
+  /** Allocate one local state slot for each of the given number of tracks.
+   *
+   * Existing local states are removed. The local states of all tracks must
+   * be set afterwards. Setting the local states of different tracks can then
+   * be done concurrently, e.g. from multiple threads.
+   */
+  void allocateLocalStates(Index numTracks);
   /** Check if a local state is available for a specific track. */
   bool hasLocalState(Index itrack) const;
   const TrackState& getLocalState(Index itrack) const;
@@ -65,10 +77,17 @@ public:
   void print(std::ostream& os, const std::string& prefix = std::string()) const;
 
 private:
+  Index checkHit(Index ihit) const;
+  Index checkCluster(Index icluster) const;
+
   uint64_t m_frame;
   uint64_t m_timestamp;
+  // only the first `m_num...` objects are valid. the remaining ones are
+  // left over from previous events and can be reused.
   std::vector<std::unique_ptr<Hit>> m_hits;
   std::vector<std::unique_ptr<Cluster>> m_clusters;
+  Index m_numHits;
+  Index m_numClusters;
   std::vector<TrackState> m_states;
 
   friend class Event;
@@ -82,23 +101,37 @@ private:
 template <typename... HitParams>
 inline Hit& SensorEvent::addHit(HitParams&&... params)
 {
-  m_hits.emplace_back(
-      std::make_unique<Hit>(std::forward<HitParams>(params)...));
-  return *m_hits.back();
+  if (m_numHits < m_hits.size()) {
+    *m_hits[m_numHits] = Hit(std::forward<HitParams>(params)...);
+  } else {
+    m_hits.emplace_back(
+        std::make_unique<Hit>(std::forward<HitParams>(params)...));
+  }
+  return *m_hits[m_numHits++];
 }
 
 template <typename... Params>
 inline Cluster& SensorEvent::addCluster(Params&&... params)
 {
-  m_clusters.emplace_back(
-      std::make_unique<Cluster>(std::forward<Params>(params)...));
-  m_clusters.back()->m_index = m_clusters.size() - 1;
-  return *m_clusters.back();
+  if (m_numClusters < m_clusters.size()) {
+    *m_clusters[m_numClusters] = Cluster(std::forward<Params>(params)...);
+  } else {
+    m_clusters.emplace_back(
+        std::make_unique<Cluster>(std::forward<Params>(params)...));
+  }
+  m_clusters[m_numClusters]->m_index = m_numClusters;
+  return *m_clusters[m_numClusters++];
 }
 
 template <typename... Params>
 inline void SensorEvent::setLocalState(Index itrack, Params&&... params)
 {
+  // states are usually stored in track order, e.g. for preallocated slots
+  if ((itrack < m_states.size()) and (m_states[itrack].track() == itrack)) {
+    m_states[itrack] = TrackState(std::forward<Params>(params)...);
+    m_states[itrack].m_track = itrack;
+    return;
+  }
   auto it = std::find_if(
       m_states.begin(), m_states.end(),
       [=](const TrackState& state) { return (state.track() == itrack); });
@@ -0,0 +1,326 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#include "brokenlinefitter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "storage/event.h"
+#include "utils/logger.h"
+
+namespace proteus {
+
+namespace {
+
+/** Symmetric, positive-definite band matrix w/ fixed-capacity storage.
+ *
+ * Only the lower band is stored w/ `band(i, d) = matrix(i, i - d)`. The
+ * Cholesky decomposition is computed in-place.
+ */
+template <int kMaxSize, int kBandwidth>
+class BandCholesky {
+public:
+  using Band = Eigen::Matrix<Scalar,
+                             Eigen::Dynamic,
+                             kBandwidth + 1,
+                             Eigen::RowMajor,
+                             kMaxSize,
+                             kBandwidth + 1>;
+  using Vec =
+      Eigen::Matrix<Scalar, Eigen::Dynamic, 1, Eigen::ColMajor, kMaxSize, 1>;
+
+  explicit BandCholesky(int size)
+      : m_band(Band::Zero(size, kBandwidth + 1)), m_size(size)
+  {
+  }
+
+  /** Add a symmetric matrix block on the diagonal starting at `offset`. */
+  template <typename Block>
+  void add(int offset, const Eigen::MatrixBase<Block>& block)
+  {
+    for (int i = 0; i < block.rows(); ++i) {
+      for (int j = 0; j <= i; ++j) {
+        m_band(offset + i, i - j) += block(i, j);
+      }
+    }
+  }
+  /** Decompose the matrix; returns false if it is not positive-definite. */
+  bool decompose()
+  {
+    for (int i = 0; i < m_size; ++i) {
+      int first = std::max(0, i - kBandwidth);
+      for (int j = first; j <= i; ++j) {
+        Scalar sum = m_band(i, i - j);
+        for (int k = first; k < j; ++k) {
+          sum -= m_band(i, i - k) * m_band(j, j - k);
+        }
+        if (i != j) {
+          m_band(i, i - j) = sum / m_band(j, 0);
+        } else if (0 < sum) {
+          m_band(i, 0) = std::sqrt(sum);
+        } else {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+  /** Solve the linear system w/ the decomposed matrix in-place. */
+  void solveInPlace(Vec& x) const
+  {
+    // forward substitution w/ the lower triangular matrix
+    for (int i = 0; i < m_size; ++i) {
+      for (int k = std::max(0, i - kBandwidth); k < i; ++k) {
+        x[i] -= m_band(i, i - k) * x[k];
+      }
+      x[i] /= m_band(i, 0);
+    }
+    // backward substitution w/ the transposed matrix
+    for (int i = m_size - 1; 0 <= i; --i) {
+      for (int k = i + 1; k < std::min(m_size, i + kBandwidth + 1); ++k) {
+        x[i] -= m_band(k, k - i) * x[k];
+      }
+      x[i] /= m_band(i, 0);
+    }
+  }
+  /** Elements of the inverse matrix within the band in band storage.
+   *
+   * Uses the recurrence `L^T A^-1 = L^-1` starting from the last row. Only
+   * elements within the band are needed to compute the next ones. This
+   * requires a previous decomposition.
+   */
+  Band inverseBand() const
+  {
+    Band inv = Band::Zero(m_size, kBandwidth + 1);
+    auto at = [&](int i, int j) -> Scalar& {
+      return (i < j) ? inv(j, j - i) : inv(i, i - j);
+    };
+    for (int i = m_size - 1; 0 <= i; --i) {
+      int last = std::min(m_size - 1, i + kBandwidth);
+      for (int j = last; i <= j; --j) {
+        Scalar sum = (i == j) ? (1 / m_band(i, 0)) : 0;
+        for (int k = i + 1; k <= last; ++k) {
+          sum -= m_band(k, k - i) * at(j, k);
+        }
+        at(j, i) = sum / m_band(i, 0);
+      }
+    }
+    return inv;
+  }
+
+private:
+  Band m_band;
+  int m_size;
+};
+
+// Spatial propagation between two neighbouring sensors as a function of the
+// local offsets on both sensors.
+struct Segment {
+  // offset on the previous sensor to offset on the current sensor
+  Matrix2 offsetOffset;
+  // offset difference to the outgoing slope on the previous sensor
+  Matrix2 slopeOut;
+  // offset difference to the incoming slope on the current sensor
+  Matrix2 slopeIn;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+} // namespace
+
+BrokenLineFitter::BrokenLineFitter(const Device& device,
+                                   const std::vector<Index>& targetIds)
+    : m_steps(buildFitterSteps(device, targetIds))
+{
+  if (kMaxSensors < m_steps.size()) {
+    throw std::runtime_error("Too many sensors for the broken line fitter");
+  }
+}
+
+std::string BrokenLineFitter::name() const { return "BrokenLineFitter"; }
+
+void BrokenLineFitter::execute(Event& event) const
+{
+  // select the smallest storage that fits all sensors
+  for (Index itrack = 0; itrack < event.numTracks(); ++itrack) {
+    if (m_steps.size() <= 8) {
+      fitTrack<8>(event, itrack);
+    } else if (m_steps.size() <= 16) {
+      fitTrack<16>(event, itrack);
+    } else {
+      fitTrack<kMaxSensors>(event, itrack);
+    }
+  }
+}
+
+template <int kMaxSteps>
+void BrokenLineFitter::fitTrack(Event& event, Index itrack) const
+{
+  // offsets on a sensor and its neighbours are coupled via the kinks
+  using System = BandCholesky<2 * kMaxSteps, 5>;
+  using Offsets = typename System::Vec;
+
+  Track& track = event.getTrack(itrack);
+  Vector4 globalPos = track.globalState().position();
+  Vector4 globalTan = track.globalState().tangent();
+  int numSteps = m_steps.size();
+  int numParams = 2 * numSteps;
+
+  Vector6 references[kMaxSteps];
+  Segment segments[kMaxSteps];
+  // measurement residuals and precisions w.r.t. the reference
+  Vector2 residuals[kMaxSteps];
+  SymMatrix2 weights[kMaxSteps];
+  bool hasMeasurement[kMaxSteps];
+  int numMeasurements = 0;
+
+  // 1. Intersect the reference track with all sensors
+
+  for (int istep = 0; istep < numSteps; ++istep) {
+    const auto& step = m_steps[istep];
+
+    // propagate the reference track to the plane intersection
+    Vector4 pos = step.fromGlobal.toTarget() * globalPos +
+                  step.fromGlobal.sourceOrigin();
+    Vector4 tan = step.fromGlobal.toTarget() * globalTan;
+    tan /= tan[kW];
+    pos -= pos[kW] * tan;
+    references[istep][kLoc0] = pos[kU];
+    references[istep][kLoc1] = pos[kV];
+    references[istep][kTime] = pos[kS];
+    references[istep][kSlopeLoc0] = tan[kU];
+    references[istep][kSlopeLoc1] = tan[kV];
+    references[istep][kSlopeTime] = tan[kS];
+
+    // spatial propagation from the previous sensor linearized at the reference
+    if (0 < istep) {
+      const auto& propagator = step.fromPrevious;
+      const auto& prev = references[istep - 1];
+      Vector4 prevPos(prev[kLoc0], prev[kLoc1], 0, prev[kTime]);
+      Vector4 prevTan(prev[kSlopeLoc0], prev[kSlopeLoc1], 1, prev[kSlopeTime]);
+      Scalar w0 =
+          (propagator.toTarget() * prevPos + propagator.sourceOrigin())[kW];
+      Matrix6 jac = propagator.jacobian(prevTan, w0);
+      // offset(i) = A * offset(i - 1) + B * slope(i - 1)
+      // slope(i) = D * slope(i - 1)
+      Matrix2 invB = jac.block<2, 2>(kLoc0, kSlopeLoc0).inverse();
+      auto& segment = segments[istep];
+      segment.offsetOffset = jac.block<2, 2>(kLoc0, kLoc0);
+      segment.slopeOut = invB;
+      segment.slopeIn = jac.block<2, 2>(kSlopeLoc0, kSlopeLoc0) * invB;
+    }
+
+    hasMeasurement[istep] = track.hasClusterOn(step.sensorId);
+    if (hasMeasurement[istep]) {
+      const Cluster& cluster =
+          event.getSensorEvent(step.sensorId)
+              .getCluster(track.getClusterOn(step.sensorId));
+      residuals[istep] = Vector2(cluster.u() - pos[kU], cluster.v() - pos[kV]);
+      weights[istep] = symmetricInverse(cluster.uvCov());
+      numMeasurements += 1;
+    }
+  }
+
+  // 2. Build and solve the normal equations for the offset corrections
+
+  System system(numParams);
+  Offsets rhs = Offsets::Zero(numParams);
+  // kink on each inner sensor as a function of the three adjacent offsets
+  Matrix<Scalar, 2, 6> kinks[kMaxSteps];
+  for (int istep = 0; istep < numSteps; ++istep) {
+    const auto& step = m_steps[istep];
+
+    if (hasMeasurement[istep]) {
+      system.add(2 * istep, weights[istep]);
+      rhs.template segment<2>(2 * istep) += weights[istep] * residuals[istep];
+    }
+    if (step.hasScatterer) {
+      const auto& in = segments[istep];
+      const auto& out = segments[istep + 1];
+      auto& kink = kinks[istep];
+      kink.template leftCols<2>() = in.slopeIn * in.offsetOffset;
+      kink.template middleCols<2>(2) =
+          -in.slopeIn - out.slopeOut * out.offsetOffset;
+      kink.template rightCols<2>() = out.slopeOut;
+      system.add(2 * (istep - 1),
+                 kink.transpose() * step.scatteringPrecision * kink);
+    }
+  }
+  if (not system.decompose()) {
+    WARN("track ", itrack, " has no valid broken line solution");
+    // mark the fit as failed; no local states are estimated
+    track.setGoodnessOfFit(std::numeric_limits<Scalar>::quiet_NaN(), -1);
+    return;
+  }
+  Offsets offsets = rhs;
+  system.solveInPlace(offsets);
+
+  // 3. Compute the goodness-of-fit
+
+  Scalar chi2 = 0;
+  for (int istep = 0; istep < numSteps; ++istep) {
+    if (hasMeasurement[istep]) {
+      Vector2 r = residuals[istep] - offsets.template segment<2>(2 * istep);
+      chi2 += r.dot(weights[istep] * r);
+    }
+    if (m_steps[istep].hasScatterer) {
+      Vector2 k = kinks[istep] * offsets.template segment<6>(2 * (istep - 1));
+      chi2 += k.dot(m_steps[istep].scatteringPrecision * k);
+    }
+  }
+  // four parameters of the straight reference line
+  track.setGoodnessOfFit(chi2, 2 * numMeasurements - 4);
+
+  // 4. Extract the local track states on the target sensors
+
+  // all required covariances are within the band of the inverse
+  auto inverse = system.inverseBand();
+
+  for (int istep = 0; istep < numSteps; ++istep) {
+    const auto& step = m_steps[istep];
+    if (not step.isTarget) {
+      continue;
+    }
+
+    // slope after the scatterer is given by the outgoing segment
+    // except for the last sensor which has no outgoing segment.
+    bool isLast = ((istep + 1) == numSteps);
+    int iprev = isLast ? (istep - 1) : istep;
+    const auto& segment = segments[iprev + 1];
+    Matrix2 toSlope = isLast ? segment.slopeIn : segment.slopeOut;
+    // spatial parameters as a function of the offsets on both sensors
+    Matrix4 jac = Matrix4::Zero();
+    jac.block<2, 2>(0, 2 * (istep - iprev)) = Matrix2::Identity();
+    jac.block<2, 2>(2, 0) = -toSlope * segment.offsetOffset;
+    jac.block<2, 2>(2, 2) = toSlope;
+
+    // covariance of the four offsets from the inverse normal matrix
+    SymMatrix4 offsetsCov;
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j <= i; ++j) {
+        offsetsCov(i, j) = offsetsCov(j, i) = inverse(2 * iprev + i, i - j);
+      }
+    }
+    Vector4 correction = jac * offsets.template segment<4>(2 * iprev);
+    SymMatrix4 correctionCov = transformCovariance(jac, offsetsCov);
+
+    Vector6 params = references[istep];
+    SymMatrix6 cov = SymMatrix6::Zero();
+    constexpr int kIndices[4] = {kLoc0, kLoc1, kSlopeLoc0, kSlopeLoc1};
+    for (int i = 0; i < 4; ++i) {
+      params[kIndices[i]] += correction[i];
+      for (int j = 0; j < 4; ++j) {
+        cov(kIndices[i], kIndices[j]) = correctionCov(i, j);
+      }
+    }
+    event.getSensorEvent(step.sensorId).setLocalState(itrack, params, cov);
+  }
+
+  DEBUG("track ", itrack, " chi2/dof: ", chi2, " / ",
+        track.degreesOfFreedom());
+}
+
+} // namespace proteus
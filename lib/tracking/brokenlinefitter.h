@@ -0,0 +1,57 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <vector>
+
+#include "loop/processor.h"
+#include "tracking/fittersteps.h"
+#include "utils/definitions.h"
+
+namespace proteus {
+
+class Device;
+
+/** Estimate local track parameters using a straight broken line fit.
+ *
+ * This solves the same track model as the ``GblFitter`` w/o curvature
+ * directly, i.e. w/o the generic GBL library. The fit parameters are the
+ * spatial offset corrections to a straight reference trajectory on all
+ * sensors. Measurements constrain the offsets on their sensors and the kinks
+ * between neighbouring segments on all intermediate sensors are constrained
+ * by the expected multiple scattering. The resulting band-structured normal
+ * equations are solved w/ a band Cholesky decomposition in fixed-capacity,
+ * stack-allocated storage.
+ *
+ * Goodness-of-fit and the local states on the target sensors are identical
+ * to the ``GblFitter`` results. Only the spatial track parameters are
+ * estimated and time measurements are not used. The global track parameters
+ * are not modified. Tracks w/o a valid solution get a NaN chi2, negative
+ * degrees-of-freedom, and no local states.
+ */
+class BrokenLineFitter : public Processor {
+public:
+  /** Maximum number of sensors that can be fitted. */
+  static constexpr size_t kMaxSensors = 64;
+
+  /**
+   * \param targetIds Sensors for which local track states are estimated
+   *
+   * All sensors are always part of the fitted trajectory, e.g. to account
+   * for their scattering material.
+   */
+  BrokenLineFitter(const Device& device, const std::vector<Index>& targetIds);
+
+  std::string name() const;
+  void execute(Event& event) const;
+
+private:
+  /** Fit a single track w/ storage for up to `kMaxSteps` sensors. */
+  template <int kMaxSteps>
+  void fitTrack(Event& event, Index itrack) const;
+
+  std::vector<FitterStep> m_steps;
+};
+
+} // namespace proteus
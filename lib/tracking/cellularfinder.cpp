@@ -0,0 +1,362 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#include "cellularfinder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include "mechanics/device.h"
+#include "storage/event.h"
+#include "utils/logger.h"
+#include "utils/threadpool.h"
+
+namespace proteus {
+
+// number of segments or candidates that are processed in one parallel task
+static constexpr size_t kBlockSize = 1024;
+
+CellularFinder::CellularFinder(const Device& device,
+                               std::vector<Index> trackingIds,
+                               double searchSpatialSigmaMax,
+                               size_t sizeMin,
+                               double redChi2Max,
+                               double slopeSigmaMax)
+    : m_sensorIds(std::move(trackingIds))
+    , m_beamSlope(device.geometry().beamSlope())
+    , m_beamSlopeVar(device.geometry().beamSlopeCovariance().diagonal())
+    , m_slopeSigmaMax(slopeSigmaMax)
+    // 2-d Mahalanobis distance peaks at 2 and not at 1
+    , m_d2LocMax((0 < searchSpatialSigmaMax)
+                     ? (2 * searchSpatialSigmaMax * searchSpatialSigmaMax)
+                     : -1)
+    // a single segment consists already of two clusters
+    , m_sizeMin(std::max<size_t>(sizeMin, 2))
+    , m_reducedChi2Max(redChi2Max)
+{
+  checkTrackingIds(device, m_sensorIds, sizeMin);
+  if (not(0 < slopeSigmaMax)) {
+    throw std::runtime_error("Slope search range must be positive");
+  }
+
+  const auto& geo = device.compiledGeometry();
+  for (auto id : m_sensorIds) {
+    m_planes.push_back(geo.getPlane(id));
+  }
+  // segments between neighbouring sensors and skipping one sensor
+  m_linksTo.resize(m_sensorIds.size());
+  for (size_t inner = 0; inner < m_sensorIds.size(); ++inner) {
+    for (size_t outer = inner + 1;
+         (outer <= inner + 2) and (outer < m_sensorIds.size()); ++outer) {
+      m_linksTo[outer].push_back(m_links.size());
+      m_links.push_back({inner, outer});
+    }
+  }
+
+  for (auto id : m_sensorIds) {
+    const auto& sensor = device.getSensor(id);
+    VERBOSE(sensor.name(), " id=", sensor.id(), " is a tracking plane");
+  }
+}
+
+std::string CellularFinder::name() const { return "CellularFinder"; }
+
+void CellularFinder::buildSegments(size_t ilink, Buffers& buffers) const
+{
+  const Link& link = m_links[ilink];
+  const auto& inner = buffers.points[link.innerSensor];
+  const auto& outer = buffers.points[link.outerSensor];
+  auto& segments = buffers.links[ilink].segments;
+  auto& outerBegin = buffers.links[ilink].outerBegin;
+  // nominal distance to define the search window along x
+  Scalar dz = m_planes[link.outerSensor].origin()[kZ] -
+              m_planes[link.innerSensor].origin()[kZ];
+  Scalar k2 = m_slopeSigmaMax * m_slopeSigmaMax;
+
+  segments.clear();
+  for (uint32_t ia = 0; ia < inner.size(); ++ia) {
+    const GlobalPoint& a = inner[ia];
+    Scalar x = a.position[kX] + m_beamSlope[0] * dz;
+    Scalar window = m_slopeSigmaMax *
+                    std::sqrt(m_beamSlopeVar[0] * dz * dz + 1 / a.weight[kX] +
+                              buffers.varianceMax[link.outerSensor][0]);
+    auto first = std::lower_bound(
+        outer.begin(), outer.end(), x - window,
+        [](const GlobalPoint& p, Scalar v) { return p.position[kX] < v; });
+    auto last = std::upper_bound(
+        first, outer.end(), x + window,
+        [](Scalar v, const GlobalPoint& p) { return v < p.position[kX]; });
+    for (auto b = first; b != last; ++b) {
+      // compare the segment direction to the beam divergence
+      Scalar dzab = b->position[kZ] - a.position[kZ];
+      Scalar dx = b->position[kX] - a.position[kX] - m_beamSlope[0] * dzab;
+      Scalar dy = b->position[kY] - a.position[kY] - m_beamSlope[1] * dzab;
+      Scalar varX = m_beamSlopeVar[0] * dzab * dzab + 1 / a.weight[kX] +
+                    1 / b->weight[kX];
+      Scalar varY = m_beamSlopeVar[1] * dzab * dzab + 1 / a.weight[kY] +
+                    1 / b->weight[kY];
+      if ((k2 * varX < dx * dx) or (k2 * varY < dy * dy)) {
+        continue;
+      }
+      Segment segment;
+      segment.link = ilink;
+      segment.inner = ia;
+      segment.outer = std::distance(outer.begin(), b);
+      segment.neighboursBegin = 0;
+      segment.neighboursEnd = 0;
+      segments.push_back(segment);
+    }
+  }
+
+  // segments are generated by inner point; reorder by outer point so that
+  // all segments ending in one point are contiguous.
+  std::stable_sort(segments.begin(), segments.end(),
+                   [](const Segment& s0, const Segment& s1) {
+                     return s0.outer < s1.outer;
+                   });
+  outerBegin.assign(outer.size() + 1, 0);
+  for (const auto& segment : segments) {
+    outerBegin[segment.outer + 1] += 1;
+  }
+  for (size_t i = 0; i < outer.size(); ++i) {
+    outerBegin[i + 1] += outerBegin[i];
+  }
+}
+
+void CellularFinder::buildNeighbours(size_t ilink, Buffers& buffers) const
+{
+  const Link& link = m_links[ilink];
+  const auto& inner = buffers.points[link.innerSensor];
+  const auto& outer = buffers.points[link.outerSensor];
+  auto& current = buffers.links[ilink];
+
+  current.neighbours.clear();
+  current.neighboursD2.clear();
+  for (auto& segment : current.segments) {
+    const GlobalPoint& a = inner[segment.inner];
+    const GlobalPoint& b = outer[segment.outer];
+
+    segment.neighboursBegin = current.neighbours.size();
+    // inner neighbours end in the inner point of this segment
+    for (auto jlink : m_linksTo[link.innerSensor]) {
+      const auto& points = buffers.points[m_links[jlink].innerSensor];
+      const auto& other = buffers.links[jlink];
+      for (uint32_t j = other.outerBegin[segment.inner];
+           j < other.outerBegin[segment.inner + 1]; ++j) {
+        const GlobalPoint& c = points[other.segments[j].inner];
+        // extrapolate the line through the neighbour to the outer point
+        Scalar f = (b.position[kZ] - a.position[kZ]) /
+                   (a.position[kZ] - c.position[kZ]);
+        Scalar rx = b.position[kX] - a.position[kX] -
+                    f * (a.position[kX] - c.position[kX]);
+        Scalar ry = b.position[kY] - a.position[kY] -
+                    f * (a.position[kY] - c.position[kY]);
+        Scalar varX = 1 / b.weight[kX] + (1 + f) * (1 + f) / a.weight[kX] +
+                      f * f / c.weight[kX];
+        Scalar varY = 1 / b.weight[kY] + (1 + f) * (1 + f) / a.weight[kY] +
+                      f * f / c.weight[kY];
+        Scalar d2 = rx * rx / varX + ry * ry / varY;
+        // negative value disables the cut
+        if ((0 < m_d2LocMax) and (m_d2LocMax < d2)) {
+          continue;
+        }
+        current.neighbours.push_back(other.offset + j);
+        current.neighboursD2.push_back(d2);
+      }
+    }
+    segment.neighboursEnd = current.neighbours.size();
+  }
+}
+
+void CellularFinder::evolve(Buffers& buffers) const
+{
+  const auto& segments = buffers.segments;
+  const auto& neighbours = buffers.neighbours;
+  auto& states = buffers.states;
+  auto& statesNext = buffers.statesNext;
+  size_t numSegments = segments.size();
+  size_t numBlocks = (numSegments + kBlockSize - 1) / kBlockSize;
+
+  states.assign(numSegments, 1);
+  statesNext.resize(numSegments);
+  // segments are ordered along the beam and the evolution terminates after
+  // at most one step per sensor.
+  while (true) {
+    std::atomic<bool> isChanged(false);
+    globalThreadPool().parallelFor(numBlocks, [&](size_t, size_t iblock) {
+      size_t end = std::min(numSegments, (iblock + 1) * kBlockSize);
+      bool isBlockChanged = false;
+      for (size_t i = iblock * kBlockSize; i < end; ++i) {
+        const Segment& segment = segments[i];
+        uint32_t state = 1;
+        for (auto j = segment.neighboursBegin; j < segment.neighboursEnd;
+             ++j) {
+          state = std::max(state, states[neighbours[j]] + 1);
+        }
+        statesNext[i] = state;
+        isBlockChanged |= (state != states[i]);
+      }
+      if (isBlockChanged) {
+        isChanged.store(true, std::memory_order_relaxed);
+      }
+    });
+    std::swap(states, statesNext);
+    if (not isChanged) {
+      break;
+    }
+  }
+}
+
+bool CellularFinder::makeCandidate(const Buffers& buffers,
+                                   uint32_t iroot,
+                                   PointChain& chain,
+                                   Track& track) const
+{
+  const auto& segments = buffers.segments;
+  const auto& neighbours = buffers.neighbours;
+  const auto& neighboursD2 = buffers.neighboursD2;
+  const auto& states = buffers.states;
+
+  // collect the points of the chain, starting w/ the outermost one
+  chain.clear();
+  uint32_t i = iroot;
+  const Link* link = &m_links[segments[i].link];
+  chain.emplace_back(link->outerSensor,
+                     &buffers.points[link->outerSensor][segments[i].outer]);
+  while (true) {
+    const Segment& segment = segments[i];
+    link = &m_links[segment.link];
+    chain.emplace_back(link->innerSensor,
+                       &buffers.points[link->innerSensor][segment.inner]);
+    if (segment.neighboursBegin == segment.neighboursEnd) {
+      break;
+    }
+    // follow the longest chain; the most compatible one for equal length
+    auto best = segment.neighboursBegin;
+    for (auto j = segment.neighboursBegin + 1; j < segment.neighboursEnd;
+         ++j) {
+      uint32_t state = states[neighbours[j]];
+      uint32_t bestState = states[neighbours[best]];
+      bool isCloser = (neighboursD2[j] < neighboursD2[best]);
+      if ((bestState < state) or ((bestState == state) and isCloser)) {
+        best = j;
+      }
+    }
+    i = neighbours[best];
+  }
+
+  // neighbour compatibility is only checked locally. remove clusters that
+  // are incompatible w/ the full chain.
+  return fitStraightCandidate(m_sensorIds, m_d2LocMax, m_sizeMin,
+                              m_reducedChi2Max, chain, track);
+}
+
+void CellularFinder::execute(Event& event) const
+{
+  auto& pool = globalThreadPool();
+  auto& buffers = m_buffers.local();
+  auto& segments = buffers.segments;
+  auto& neighbours = buffers.neighbours;
+  auto& roots = buffers.roots;
+  auto& candidates = buffers.candidates;
+  auto& isCandidate = buffers.isCandidate;
+
+  // no-op after the first event
+  buffers.points.resize(m_sensorIds.size());
+  buffers.varianceMax.resize(m_sensorIds.size());
+  buffers.links.resize(m_links.size());
+
+  // collect free clusters in the global system ordered along x
+  for (size_t isensor = 0; isensor < m_sensorIds.size(); ++isensor) {
+    auto& points = buffers.points[isensor];
+    auto& varianceMax = buffers.varianceMax[isensor];
+
+    collectFreePoints(m_planes[isensor],
+                      event.getSensorEvent(m_sensorIds[isensor]), points);
+    varianceMax.setZero();
+    for (const auto& point : points) {
+      varianceMax[0] = std::max(varianceMax[0], 1 / point.weight[kX]);
+      varianceMax[1] = std::max(varianceMax[1], 1 / point.weight[kY]);
+    }
+  }
+
+  // segments for each sensor pair are independent
+  pool.parallelFor(m_links.size(), [&](size_t, size_t ilink) {
+    buildSegments(ilink, buffers);
+  });
+  // global segment numbering follows the link order
+  uint32_t numSegments = 0;
+  for (auto& link : buffers.links) {
+    link.offset = numSegments;
+    numSegments += link.segments.size();
+  }
+  pool.parallelFor(m_links.size(), [&](size_t, size_t ilink) {
+    buildNeighbours(ilink, buffers);
+  });
+  // merge into global arrays for the evolution
+  segments.clear();
+  neighbours.clear();
+  buffers.neighboursD2.clear();
+  for (const auto& link : buffers.links) {
+    uint32_t offset = neighbours.size();
+    for (auto segment : link.segments) {
+      segment.neighboursBegin += offset;
+      segment.neighboursEnd += offset;
+      segments.push_back(segment);
+    }
+    neighbours.insert(neighbours.end(), link.neighbours.begin(),
+                      link.neighbours.end());
+    buffers.neighboursD2.insert(buffers.neighboursD2.end(),
+                                link.neighboursD2.begin(),
+                                link.neighboursD2.end());
+  }
+
+  evolve(buffers);
+
+  // candidates start at segments that are not an inner neighbour themselves
+  buffers.hasOuter.assign(segments.size(), 0);
+  for (auto i : neighbours) {
+    buffers.hasOuter[i] = 1;
+  }
+  roots.clear();
+  for (uint32_t i = 0; i < segments.size(); ++i) {
+    // a chain of n segments contains n + 1 clusters
+    if (not buffers.hasOuter[i] and (m_sizeMin <= (buffers.states[i] + 1))) {
+      roots.push_back(i);
+    }
+  }
+  // fit each candidate into its own slot
+  if (candidates.size() < roots.size()) {
+    candidates.resize(roots.size());
+  }
+  isCandidate.assign(roots.size(), 0);
+  size_t numBlocks = (roots.size() + kBlockSize - 1) / kBlockSize;
+  buffers.chains.resize(pool.numThreads());
+  pool.parallelFor(numBlocks, [&](size_t ithread, size_t iblock) {
+    size_t end = std::min(roots.size(), (iblock + 1) * kBlockSize);
+    for (size_t i = iblock * kBlockSize; i < end; ++i) {
+      isCandidate[i] =
+          makeCandidate(buffers, roots[i], buffers.chains[ithread],
+                        candidates[i]);
+    }
+  });
+  // compact valid candidates while keeping the deterministic order
+  size_t numCandidates = 0;
+  for (size_t i = 0; i < roots.size(); ++i) {
+    if (isCandidate[i]) {
+      std::swap(candidates[numCandidates++], candidates[i]);
+    }
+  }
+
+  // resolve ambiguities in the same way as the combinatorial track finder.
+  size_t numAddedTracks =
+      addExclusiveTracks(candidates, numCandidates, buffers.order, event);
+
+  DEBUG(segments.size(), " segments, ", neighbours.size(), " neighbours, ",
+        numCandidates, " candidates, ", numAddedTracks,
+        " tracks added to event");
+}
+
+} // namespace proteus
@@ -0,0 +1,135 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "loop/processor.h"
+#include "mechanics/geometry.h"
+#include "storage/track.h"
+#include "tracking/findertools.h"
+#include "utils/definitions.h"
+#include "utils/scratch.h"
+
+namespace proteus {
+
+class Device;
+
+/** Find straight tracks using a cellular automaton.
+ *
+ * Free clusters on neighbouring tracking sensors are combined into segments
+ * if their direction is compatible with the beam divergence. To allow for
+ * sensor inefficiencies, segments that skip a single sensor are also
+ * built. Two segments that share a cluster are neighbours if the outer
+ * cluster is compatible with the line defined by the inner segment.
+ *
+ * Each segment starts with a state of one. In each evolution step, the state
+ * of a segment is set to one more than the largest state of its inner
+ * neighbours until no state changes anymore. The state is then the length of
+ * the longest chain of segments that ends in the segment. Track candidates
+ * are extracted from the outermost segments by following the inner
+ * neighbours with the largest state and are fitted with a straight line.
+ * Ambiguities between candidates are resolved as in the ``TrackFinder``.
+ *
+ * Segment building for each sensor pair, the evolution steps, and the
+ * candidate fits are independent and are distributed over the global
+ * thread pool.
+ *
+ * Like for the ``TrackFinder``, only the global track parameters are
+ * estimated. Local track states must be computed using one of the fitter
+ * processors.
+ */
+class CellularFinder : public Processor {
+public:
+  /**
+   * \param trackingIds           Ids of tracking sensors
+   * \param searchSpatialSigmaMax Cluster compatibility cut, negative to disable
+   * \param sizeMin               Selection cut on number of clusters
+   * \param redChi2Max            Cut on track chi2/d.o.f, negative to disable
+   * \param slopeSigmaMax         Segment slope range in units of the beam
+   *                              divergence
+   */
+  CellularFinder(const Device& device,
+                 std::vector<Index> trackingIds,
+                 double searchSpatialSigmaMax,
+                 size_t sizeMin,
+                 double redChi2Max,
+                 double slopeSigmaMax = 3);
+
+  std::string name() const;
+  /** Find tracks and add them to the event. */
+  void execute(Event& event) const;
+
+private:
+  // Compatible pair of clusters on two different sensors
+  struct Segment {
+    // index of the sensor pair
+    uint32_t link;
+    // point indices on the inner and the outer sensor
+    uint32_t inner;
+    uint32_t outer;
+    // range of inner neighbours
+    uint32_t neighboursBegin;
+    uint32_t neighboursEnd;
+  };
+  // Sensor pair that is connected by segments
+  struct Link {
+    size_t innerSensor;
+    size_t outerSensor;
+  };
+  // Segments of one sensor pair ordered by the outer point
+  struct LinkSegments {
+    std::vector<Segment> segments;
+    // segments[outerBegin[i]:outerBegin[i + 1]] end in outer point i
+    std::vector<uint32_t> outerBegin;
+    // global indices of inner neighbours and the compatibility
+    std::vector<uint32_t> neighbours;
+    std::vector<float> neighboursD2;
+    // offset of the segments in the global segment numbering
+    uint32_t offset = 0;
+  };
+  // Temporary storage that is reused between events
+  struct Buffers {
+    std::vector<std::vector<GlobalPoint>> points;
+    std::vector<Vector2> varianceMax;
+    std::vector<LinkSegments> links;
+    // segments and neighbours of all links in the global numbering
+    std::vector<Segment> segments;
+    std::vector<uint32_t> neighbours;
+    std::vector<float> neighboursD2;
+    std::vector<uint32_t> states;
+    std::vector<uint32_t> statesNext;
+    std::vector<char> hasOuter;
+    std::vector<uint32_t> roots;
+    std::vector<Track> candidates;
+    std::vector<char> isCandidate;
+    std::vector<size_t> order;
+    // one chain for each thread of the candidate extraction
+    std::vector<PointChain> chains;
+  };
+
+  void buildSegments(size_t ilink, Buffers& buffers) const;
+  void buildNeighbours(size_t ilink, Buffers& buffers) const;
+  void evolve(Buffers& buffers) const;
+  bool makeCandidate(const Buffers& buffers,
+                     uint32_t iroot,
+                     PointChain& chain,
+                     Track& track) const;
+
+  std::vector<Index> m_sensorIds;
+  Vector2 m_beamSlope;
+  Vector2 m_beamSlopeVar;
+  double m_slopeSigmaMax;
+  double m_d2LocMax;
+  size_t m_sizeMin;
+  double m_reducedChi2Max;
+  std::vector<Plane> m_planes;
+  std::vector<Link> m_links;
+  // for each sensor, the links that end on it
+  std::vector<std::vector<size_t>> m_linksTo;
+  mutable Scratch<Buffers> m_buffers;
+};
+
+} // namespace proteus
@@ -0,0 +1,149 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#include "findertools.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include "mechanics/device.h"
+#include "mechanics/geometry.h"
+#include "storage/event.h"
+#include "storage/sensorevent.h"
+#include "storage/track.h"
+#include "tracking/linefitter.h"
+
+namespace proteus {
+
+void checkTrackingIds(const Device& device,
+                      std::vector<Index>& sensorIds,
+                      size_t sizeMin)
+{
+  if (sensorIds.size() < 2) {
+    throw std::runtime_error("Need at least two sensors to find tracks");
+  }
+  if (sensorIds.size() < sizeMin) {
+    throw std::runtime_error(
+        "Number of tracking sensors < minimum number of clusters");
+  }
+  // ensure the requested tracking sensors are unique
+  std::sort(sensorIds.begin(), sensorIds.end());
+  if (std::unique(sensorIds.begin(), sensorIds.end()) != sensorIds.end()) {
+    throw std::runtime_error("Found duplicate tracking sensor ids");
+  }
+  // ensure the requested tracking sensors are valid
+  std::vector<Index> allIds = device.sensorIds();
+  std::sort(allIds.begin(), allIds.end());
+  if (!std::includes(allIds.begin(), allIds.end(), sensorIds.begin(),
+                     sensorIds.end())) {
+    throw std::runtime_error("Found invalid tracking sensor ids");
+  }
+  sortAlongBeam(device.geometry(), sensorIds);
+}
+
+void collectFreePoints(const Plane& plane,
+                       const SensorEvent& sensorEvent,
+                       std::vector<GlobalPoint>& points)
+{
+  points.clear();
+  for (Index icluster = 0; icluster < sensorEvent.numClusters(); ++icluster) {
+    const auto& cluster = sensorEvent.getCluster(icluster);
+    if (cluster.isInTrack()) {
+      continue;
+    }
+    GlobalPoint point;
+    point.position = plane.toGlobal(cluster.position());
+    point.weight =
+        transformCovariance(plane.linearToGlobal(), cluster.positionCov())
+            .diagonal()
+            .cwiseInverse();
+    point.cluster = icluster;
+    points.push_back(point);
+  }
+  std::sort(points.begin(), points.end(),
+            [](const GlobalPoint& a, const GlobalPoint& b) {
+              return a.position[kX] < b.position[kX];
+            });
+}
+
+bool fitStraightCandidate(const std::vector<Index>& sensorIds,
+                          Scalar d2Max,
+                          size_t sizeMin,
+                          Scalar reducedChi2Max,
+                          PointChain& chain,
+                          Track& track)
+{
+  LineFitter3D fitter;
+  bool isCompatible = false;
+  while (sizeMin <= chain.size()) {
+    fitter = LineFitter3D();
+    for (const auto& link : chain) {
+      fitter.addPoint(link.second->position, link.second->weight);
+    }
+    fitter.fit();
+    // negative value disables the cut
+    if (d2Max < 0) {
+      isCompatible = true;
+      break;
+    }
+    auto worst = std::max_element(
+        chain.begin(), chain.end(), [&](const auto& l0, const auto& l1) {
+          return lineDistance(fitter.params(), *l0.second) <
+                 lineDistance(fitter.params(), *l1.second);
+        });
+    if (lineDistance(fitter.params(), *worst->second) <= d2Max) {
+      isCompatible = true;
+      break;
+    }
+    chain.erase(worst);
+  }
+  if (not isCompatible) {
+    return false;
+  }
+  if (not isGoodCandidate(fitter.dof(), fitter.chi2(), reducedChi2Max)) {
+    return false;
+  }
+  track = Track(TrackState(fitter.params(), fitter.cov()), fitter.chi2(),
+                fitter.dof());
+  for (const auto& link : chain) {
+    track.addCluster(sensorIds[link.first], link.second->cluster);
+  }
+  return true;
+}
+
+size_t addExclusiveTracks(const std::vector<Track>& candidates,
+                          size_t numCandidates,
+                          std::vector<size_t>& order,
+                          Event& event)
+{
+  // only the lightweight handles are sorted
+  order.resize(numCandidates);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+    const auto& a = candidates[i];
+    const auto& b = candidates[j];
+    return isBetterCandidate(a.size(), a.chi2(), i, b.size(), b.chi2(), j);
+  });
+
+  size_t numAddedTracks = 0;
+  for (auto icandidate : order) {
+    const auto& track = candidates[icandidate];
+    // all clusters of the track must be unused
+    bool hasUsedClusters = std::any_of(
+        track.clusters().begin(), track.clusters().end(), [&](const auto& c) {
+          return event.getSensorEvent(c.sensor)
+              .getCluster(c.cluster)
+              .isInTrack();
+        });
+    if (hasUsedClusters) {
+      continue;
+    }
+    // also fixes cluster-track association
+    event.addTrack(track);
+    numAddedTracks += 1;
+  }
+  return numAddedTracks;
+}
+
+} // namespace proteus
@@ -0,0 +1,148 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+/**
+ * \file
+ * \brief Common building blocks for the track finders
+ */
+
+#pragma once
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "utils/definitions.h"
+
+namespace proteus {
+
+class Device;
+class Event;
+class Plane;
+class SensorEvent;
+class Track;
+
+/** Check the requested tracking sensors and sort them along the beam.
+ *
+ * \param sizeMin Minimum number of clusters per track
+ * \exception std::runtime_error For less than two or less than `sizeMin`
+ *                               sensors, and for duplicate or invalid ids
+ */
+void checkTrackingIds(const Device& device,
+                      std::vector<Index>& sensorIds,
+                      size_t sizeMin);
+
+/** Cluster in the global system w/ the inverse variances of its position. */
+struct GlobalPoint {
+  Vector4 position;
+  Vector4 weight;
+  Index cluster;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/** Sensor index and point for each cluster of a track candidate. */
+using PointChain = std::vector<std::pair<size_t, const GlobalPoint*>>;
+
+/** Collect all clusters that are not yet in a track ordered along global x.
+ */
+void collectFreePoints(const Plane& plane,
+                       const SensorEvent& sensorEvent,
+                       std::vector<GlobalPoint>& points);
+
+/** Weighted squared distance of a point to a global straight line. */
+inline Scalar lineDistance(const Vector6& params, const GlobalPoint& point)
+{
+  Scalar z = point.position[kZ];
+  Scalar dx = point.position[kX] - (params[kLoc0] + params[kSlopeLoc0] * z);
+  Scalar dy = point.position[kY] - (params[kLoc1] + params[kSlopeLoc1] * z);
+  return dx * dx * point.weight[kX] + dy * dy * point.weight[kY];
+}
+
+/** Check the track quality w/ the same cuts for all finders.
+ *
+ * \param reducedChi2Max Cut on chi2/d.o.f, negative to disable
+ */
+inline bool isGoodCandidate(Scalar dof, Scalar chi2, Scalar reducedChi2Max)
+{
+  // numerical crosschecks
+  if ((dof < 0) or not std::isfinite(chi2)) {
+    return false;
+  }
+  // negative value disables the cut
+  // we check (dof * cut < chi2) instead of (cut < chi2/dof) so the case
+  // of 2-hit tracks w/ dof=0 does not lead to numerical issues due to the
+  // division by zero. also means that 2-hit tracks are only accepted if
+  // chi2=0 or the chi2 cut is disabled altogether.
+  return not((0 < reducedChi2Max) and ((dof * reducedChi2Max) <= chi2));
+}
+
+/** Fit a straight track to a candidate and remove incompatible clusters.
+ *
+ * Clusters are removed one at a time, worst first, until all remaining
+ * clusters are compatible with the refitted line.
+ *
+ * \param sensorIds      Sensor ids for the sensor indices of the chain
+ * \param d2Max          Cluster compatibility cut, negative to disable
+ * \param sizeMin        Minimum number of compatible clusters
+ * \param reducedChi2Max Cut on chi2/d.o.f, negative to disable
+ * \param[in,out] chain  Incompatible clusters are removed
+ * \param[out] track     Fitted track; only valid on success
+ * \returns true if a good track was found
+ */
+bool fitStraightCandidate(const std::vector<Index>& sensorIds,
+                          Scalar d2Max,
+                          size_t sizeMin,
+                          Scalar reducedChi2Max,
+                          PointChain& chain,
+                          Track& track);
+
+/** Rank track candidates for the ambiguity resolution.
+ *
+ * Longer candidates come first and candidates w/ smaller chi2 for equal
+ * length. The candidate index breaks remaining ties so the ranking does not
+ * depend on the sort implementation.
+ *
+ * WARNING
+ * This has to be a strict weak ordering (from C++ standard)
+ *   1. compare(a, a) == false
+ *   2. compare(a, b) == true -> compare(b, a) == false
+ *   3. compare(a, b) == true && compare(b, c) == true -> compare(a, c) ==
+ *   true
+ * if it is not, std::sort will corrupt the heap.
+ * NOTE to future self:
+ * do not try to be smart or optimize this. you got burnt once already.
+ */
+inline bool isBetterCandidate(size_t sizeA,
+                              Scalar chi2A,
+                              size_t indexA,
+                              size_t sizeB,
+                              Scalar chi2B,
+                              size_t indexB)
+{
+  // first sort by length, longest first
+  if (sizeA != sizeB)
+    return (sizeB < sizeA);
+  // second sort by chi2, smallest first
+  if (chi2A < chi2B)
+    return true;
+  if (chi2B < chi2A)
+    return false;
+  // use the index to break ties consistently
+  return (indexA < indexB);
+}
+
+/** Add the best candidates w/ exclusive cluster association to the event.
+ *
+ * Candidates are ranked using `isBetterCandidate` and a candidate is only
+ * added if none of its clusters are already used by another track.
+ *
+ * \param numCandidates Only the first candidates are considered
+ * \param order         Buffer for the candidate ranking
+ * \returns Number of tracks added to the event
+ */
+size_t addExclusiveTracks(const std::vector<Track>& candidates,
+                          size_t numCandidates,
+                          std::vector<size_t>& order,
+                          Event& event);
+
+} // namespace proteus
@@ -0,0 +1,50 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#include "fittersteps.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "mechanics/device.h"
+#include "mechanics/geometry.h"
+#include "mechanics/sensor.h"
+
+namespace proteus {
+
+std::vector<FitterStep> buildFitterSteps(const Device& device,
+                                         const std::vector<Index>& targetIds)
+{
+  const auto& geo = device.compiledGeometry();
+  // sensor ids sorted along the expected propagation order
+  auto sensorIds = sortedAlongBeam(device.geometry(), device.sensorIds());
+  if (sensorIds.size() < 2) {
+    throw std::runtime_error("Need at least two sensors to fit tracks");
+  }
+
+  std::vector<FitterStep> steps;
+  for (size_t i = 0; i < sensorIds.size(); ++i) {
+    FitterStep step;
+
+    // default plane constructor yields the global plane
+    step.fromGlobal = Propagator(Plane{}, geo.getPlane(sensorIds[i]));
+    // first step has no predecessor and no propagation
+    if (0 < i) {
+      step.fromPrevious = Propagator(geo, sensorIds[i - 1], sensorIds[i]);
+    }
+    // scatterer for all inner sensors
+    if ((0 < i) and ((i + 1) < sensorIds.size())) {
+      const auto& sensor = device.getSensor(sensorIds[i]);
+      step.scatteringCovariance = sensor.scatteringSlopeCovariance();
+      step.scatteringPrecision = sensor.scatteringSlopePrecision();
+      step.hasScatterer = true;
+    }
+    step.sensorId = sensorIds[i];
+    step.isTarget = (std::find(targetIds.begin(), targetIds.end(),
+                               step.sensorId) != targetIds.end());
+    steps.push_back(std::move(step));
+  }
+  return steps;
+}
+
+} // namespace proteus
@@ -0,0 +1,47 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+/**
+ * \file
+ * \brief Precomputed trajectory steps shared by the track fitters
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "tracking/propagation.h"
+#include "utils/definitions.h"
+
+namespace proteus {
+
+class Device;
+
+/** Geometry-dependent parts of the fitted trajectory on one sensor. */
+struct FitterStep {
+  // Precomputed transformation from the global to the local system
+  Propagator fromGlobal;
+  // Precomputed propagation from the previous step
+  Propagator fromPrevious;
+  // Scattering slope covariance and precision, only set for a scatterer
+  SymMatrix2 scatteringCovariance = SymMatrix2::Zero();
+  SymMatrix2 scatteringPrecision = SymMatrix2::Zero();
+  bool hasScatterer = false;
+  // Corresponding sensor
+  Index sensorId = kInvalidIndex;
+  // Whether the local state should be stored
+  bool isTarget = false;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/** Build the steps for all sensors along the expected propagation order.
+ *
+ * \param targetIds Sensors for which local track states are estimated
+ * \exception std::runtime_error For less than two sensors
+ *
+ * All sensors are part of the trajectory and all inner sensors scatter.
+ */
+std::vector<FitterStep> buildFitterSteps(const Device& device,
+                                         const std::vector<Index>& targetIds);
+
+} // namespace proteus
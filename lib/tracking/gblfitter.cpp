@@ -8,6 +8,7 @@
 
 #include "gblfitter.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -20,19 +21,10 @@
 #include "storage/event.h"
 #include "tracking/propagation.h"
 #include "utils/logger.h"
+#include "utils/threadpool.h"
 
 namespace proteus {
 
-GblFitter::GblFitter(const Device& device)
-    : m_device(device)
-    // sensor ids sorted along the expected propagation order
-    , m_propagationIds(
-          sortedAlongBeam(m_device.geometry(), m_device.sensorIds()))
-{
-}
-
-std::string GblFitter::name() const { return "GBLFitter"; }
-
 namespace {
 
 /// Mapping matrices between the proteus and the GBL parameter ordering
@@ -62,23 +54,77 @@ struct Reorder {
 
 } // namespace
 
+GblFitter::GblFitter(const Device& device, const std::vector<Index>& targetIds)
+    : m_steps(buildFitterSteps(device, targetIds))
+{
+}
+
+std::string GblFitter::name() const { return "GBLFitter"; }
+
+struct GblFitter::Buffers {
+  Eigen::MatrixXd referenceParams;
+  std::vector<gbl::GblPoint> gblPoints;
+  Eigen::VectorXd gblCorrection;
+  Eigen::MatrixXd gblCovariance;
+  Eigen::VectorXd gblResiduals;
+  Eigen::VectorXd gblErrorsMeasurements;
+  Eigen::VectorXd gblErrorsResiduals;
+  Eigen::VectorXd gblDownWeights;
+};
+
+// number of tracks that are fitted together in one parallel task
+static constexpr Index kFitBlockSize = 8;
+
 void GblFitter::execute(Event& event) const
+{
+  Index numTracks = event.numTracks();
+  Index numBlocks = (numTracks + kFitBlockSize - 1) / kFitBlockSize;
+
+  // each task writes only to the preallocated states of its own tracks
+  for (const auto& step : m_steps) {
+    if (step.isTarget) {
+      event.getSensorEvent(step.sensorId).allocateLocalStates(numTracks);
+    }
+  }
+#ifndef NDEBUG
+  // per-track debug output from multiple threads would be interleaved
+  if (globalLogger().isActive(Logger::Level::Verbose)) {
+    fitBlock(0, numTracks, event);
+    return;
+  }
+#endif
+  globalThreadPool().parallelFor(numBlocks, [&](size_t, size_t iblock) {
+    Index begin = iblock * kFitBlockSize;
+    Index end = std::min(numTracks, begin + kFitBlockSize);
+    fitBlock(begin, end, event);
+  });
+}
+
+void GblFitter::fitBlock(Index begin, Index end, Event& event) const
 {
   using gbl::GblPoint;
   using gbl::GblTrajectory;
 
   Reorder reorder;
-  // temporary (resuable) storage
-  Eigen::MatrixXd referenceParams(6, m_propagationIds.size());
-  std::vector<GblPoint> gblPoints(m_propagationIds.size(), {Matrix5::Zero()});
-  Eigen::VectorXd gblCorrection(5);
-  Eigen::MatrixXd gblCovariance(5, 5);
-  Eigen::VectorXd gblResiduals(2);
-  Eigen::VectorXd gblErrorsMeasurements(2);
-  Eigen::VectorXd gblErrorsResiduals(2);
-  Eigen::VectorXd gblDownWeights(2);
-
-  for (Index itrack = 0; itrack < event.numTracks(); ++itrack) {
+  // temporary (resuable) storage; resizing is a no-op after the first event
+  auto& buffers = m_buffers.local();
+  auto& referenceParams = buffers.referenceParams;
+  auto& gblPoints = buffers.gblPoints;
+  auto& gblCorrection = buffers.gblCorrection;
+  auto& gblCovariance = buffers.gblCovariance;
+  auto& gblResiduals = buffers.gblResiduals;
+  auto& gblErrorsMeasurements = buffers.gblErrorsMeasurements;
+  auto& gblErrorsResiduals = buffers.gblErrorsResiduals;
+  auto& gblDownWeights = buffers.gblDownWeights;
+  referenceParams.resize(6, m_steps.size());
+  gblCorrection.resize(5);
+  gblCovariance.resize(5, 5);
+  gblResiduals.resize(2);
+  gblErrorsMeasurements.resize(2);
+  gblErrorsResiduals.resize(2);
+  gblDownWeights.resize(2);
+
+  for (Index itrack = begin; itrack < end; ++itrack) {
     Track& track = event.getTrack(itrack);
 
     // Reference track in global coordinates
@@ -86,21 +132,22 @@ void GblFitter::execute(Event& event) const
     Vector4 globalTan = track.globalState().tangent();
 
     // Propagate reference track through all sensor to define GBL trajectory
-    for (size_t ipoint = 0; ipoint < m_propagationIds.size(); ++ipoint) {
-      auto sensorId = m_propagationIds[ipoint];
-      const auto& plane = m_device.geometry().getPlane(sensorId);
+    gblPoints.clear();
+    Vector4 prevPos;
+    Vector4 prevTan;
+    for (size_t ipoint = 0; ipoint < m_steps.size(); ++ipoint) {
+      const auto& step = m_steps[ipoint];
 
       // 1. Propagate track state to the plane intersection
 
       // equivalent state in local parameters
-      Vector4 localPos = plane.toLocal(globalPos);
-      Vector4 localTan = plane.linearToLocal() * globalTan;
-      // distance of initial point to the intersection along the plane normal
-      Scalar w0 = localPos[kW];
+      Vector4 localPos = step.fromGlobal.toTarget() * globalPos +
+                         step.fromGlobal.sourceOrigin();
+      Vector4 localTan = step.fromGlobal.toTarget() * globalTan;
       // convert tangent to slope parametrization
       localTan /= localTan[kW];
       // propagate position to the intersection, tangent is invariant
-      localPos -= w0 * localTan;
+      localPos -= localPos[kW] * localTan;
 
       // 2. Compute local track parameters to be used as reference later on
 
@@ -119,45 +166,43 @@ void GblFitter::execute(Event& event) const
         // first point has no predecessor and no propagation Jacobian.
         jac = Matrix6::Identity();
       } else {
-        auto prevSensorId = m_propagationIds[ipoint - 1];
-        const auto& prev = m_device.geometry().getPlane(prevSensorId);
-        Vector4 prevTan = prev.linearToLocal() * globalTan;
-        Matrix4 prevToLocal = plane.linearToLocal() * prev.linearToGlobal();
-        jac = jacobianState(prevTan, prevToLocal, w0);
+        const auto& propagator = step.fromPrevious;
+        // distance of previous point to the intersection along the normal
+        Scalar w0 = (propagator.toTarget() * prevPos +
+                     propagator.sourceOrigin())[kW];
+        jac = propagator.jacobian(prevTan, w0);
       }
+      prevPos = localPos;
+      prevTan = localTan;
 
       // 4. Create a GBL point for this step
 
-      auto& point = gblPoints[ipoint];
-      point = GblPoint(reorder.toGbl * jac * reorder.toProteus);
+      gblPoints.emplace_back(reorder.toGbl * jac * reorder.toProteus);
+      auto& point = gblPoints.back();
 
       // 4a. Add a scatterer for all inner points
 
-      if ((0 < ipoint) and ((ipoint + 1) < m_propagationIds.size())) {
-        const auto& sensor = m_device.getSensor(sensorId);
+      if (step.hasScatterer) {
         // Define scattering in the local system w/ vanishing initial kink
-        point.addScatterer(Vector2::Zero(), sensor.scatteringSlopePrecision());
+        point.addScatterer(Vector2::Zero(), step.scatteringPrecision);
       }
 
       // 4b. If available, add a measurement
-      if (track.hasClusterOn(sensorId)) {
-        const Cluster& cluster = event.getSensorEvent(sensorId).getCluster(
-            track.getClusterOn(sensorId));
+
+      if (track.hasClusterOn(step.sensorId)) {
+        const Cluster& cluster =
+            event.getSensorEvent(step.sensorId)
+                .getCluster(track.getClusterOn(step.sensorId));
 
         // Get the measurement (residuals)
         Vector2 meas(cluster.u() - localPos[kU], cluster.v() - localPos[kV]);
         // Get the measurement precision
-        Matrix2 measPrec = cluster.uvCov().inverse();
+        Matrix2 measPrec = symmetricInverse(cluster.uvCov());
 
         // Add measurement to the point, measurements and track parameters
         // are defined in the same coordinates and no projection is required.
         point.addMeasurement(meas, measPrec);
       }
-
-      // 5. Update starting point for the next step
-
-      globalPos = plane.toGlobal(localPos);
-      // the tangent is a constant of the motion and remains unchanged
     }
 
     // fit the GBL trajectory w/o track curvature
@@ -171,10 +216,13 @@ void GblFitter::execute(Event& event) const
     track.setGoodnessOfFit(chi2, dof);
     DEBUG("fit ret: ", ret);
 
-    // extract fitted local track states for all sensors
+    // extract fitted local track states for the target sensors
 
-    for (size_t ipoint = 0; ipoint < m_propagationIds.size(); ++ipoint) {
-      auto sensorId = m_propagationIds[ipoint];
+    for (size_t ipoint = 0; ipoint < m_steps.size(); ++ipoint) {
+      if (not m_steps[ipoint].isTarget) {
+        continue;
+      }
+      auto sensorId = m_steps[ipoint].sensorId;
       // GBL label starts counting at 1, w/ positive values indicating that
       // we want to get the parameters before the scatterer.
       auto label = ipoint + 1;
@@ -193,7 +241,7 @@ void GblFitter::execute(Event& event) const
     DEBUG("global reference: ", track.globalState());
 
     for (unsigned int ipoint = 0; ipoint < gblPoints.size(); ++ipoint) {
-      auto sensorId = m_propagationIds[ipoint];
+      auto sensorId = m_steps[ipoint].sensorId;
       auto label = ipoint + 1;
       const auto& point = gblPoints[ipoint];
 
@@ -205,11 +253,14 @@ void GblFitter::execute(Event& event) const
       // track parameters
 
       const auto& reference = referenceParams.col(ipoint);
-      const auto& state = event.getSensorEvent(sensorId).getLocalState(itrack);
       DEBUG("  params:");
       DEBUG("    reference: ", format(reference));
-      DEBUG("    correction: ", format(state.params() - reference));
-      DEBUG("    covariance:\n", format(state.cov()));
+      if (m_steps[ipoint].isTarget) {
+        const auto& state =
+            event.getSensorEvent(sensorId).getLocalState(itrack);
+        DEBUG("    correction: ", format(state.params() - reference));
+        DEBUG("    covariance:\n", format(state.cov()));
+      }
 
       // measurement
 
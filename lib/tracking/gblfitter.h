@@ -11,7 +11,9 @@
 #include <vector>
 
 #include "loop/processor.h"
+#include "tracking/fittersteps.h"
 #include "utils/definitions.h"
+#include "utils/scratch.h"
 
 namespace proteus {
 
@@ -21,17 +23,34 @@ class Device;
  *
  * This calculates new global track parameters and goodness-of-fit and
  * calculates the local track parameters on the selected sensor planes.
+ *
+ * The transformations between all planes and the scattering precisions are
+ * computed once. Only the reference trajectory, its jacobians, and the
+ * measurements are computed separately for each track. Blocks of tracks are
+ * fitted in parallel using the global thread pool.
  */
 class GblFitter : public Processor {
 public:
-  GblFitter(const Device& device);
+  /**
+   * \param targetIds Sensors for which local track states are estimated
+   *
+   * All sensors are always part of the fitted trajectory, e.g. to account
+   * for their scattering material.
+   */
+  GblFitter(const Device& device, const std::vector<Index>& targetIds);
 
   std::string name() const;
   void execute(Event& event) const;
 
 private:
-  const Device& m_device;
-  std::vector<Index> m_propagationIds;
+  // Temporary storage that is reused between events
+  struct Buffers;
+
+  /** Fit the tracks in [begin, end). */
+  void fitBlock(Index begin, Index end, Event& event) const;
+
+  std::vector<FitterStep> m_steps;
+  mutable Scratch<Buffers> m_buffers;
 };
 
 } // namespace proteus
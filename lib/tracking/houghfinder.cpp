@@ -0,0 +1,355 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#include "houghfinder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "mechanics/device.h"
+#include "storage/event.h"
+#include "tracking/linefitter.h"
+#include "utils/logger.h"
+
+namespace proteus {
+
+HoughFinder::Accumulator::Accumulator(Scalar offsetMin,
+                                      Scalar offsetMax,
+                                      Scalar offsetBinWidth,
+                                      Scalar slopeMin,
+                                      Scalar slopeMax,
+                                      Scalar slopeBinWidth)
+    : m_offsetMin(offsetMin)
+    , m_offsetBinWidth(offsetBinWidth)
+    , m_slopeBinWidth(slopeBinWidth)
+    , m_numOffsetBins(
+          std::max(1, static_cast<int>(std::ceil((offsetMax - offsetMin) /
+                                                 offsetBinWidth))))
+    , m_numSlopeBins(
+          std::max(1, static_cast<int>(
+                          std::ceil((slopeMax - slopeMin) / slopeBinWidth))))
+    , m_cells(m_numOffsetBins * m_numSlopeBins)
+    , m_positions(m_numSlopeBins)
+{
+  // center the slope bins on the requested range
+  m_slopeMin = (slopeMin + slopeMax - m_numSlopeBins * m_slopeBinWidth) / 2;
+}
+
+void HoughFinder::Accumulator::clear()
+{
+  m_touched.clear();
+  // restart the round counter long before it could overflow
+  if ((std::numeric_limits<uint32_t>::max() - 1) <= m_round) {
+    for (auto& cell : m_cells) {
+      cell.round = 0;
+    }
+    m_round = 0;
+  }
+  // all cells w/ an earlier round are considered empty
+  m_roundCleared = m_round + 1;
+}
+
+void HoughFinder::Accumulator::nextSensor() { m_round += 1; }
+
+void HoughFinder::Accumulator::fill(Scalar position, Scalar distance)
+{
+  // continuous offset bin position for the first slope bin and its change
+  // for each additional slope bin.
+  Scalar u0 =
+      (position - (m_slopeMin + m_slopeBinWidth / 2) * distance - m_offsetMin) /
+      m_offsetBinWidth;
+  Scalar du = m_slopeBinWidth * distance / m_offsetBinWidth;
+  // independent for each slope bin and can be vectorized
+  for (int islope = 0; islope < m_numSlopeBins; ++islope) {
+    m_positions[islope] = u0 - du * islope;
+  }
+  for (int islope = 0; islope < m_numSlopeBins; ++islope) {
+    // vote for the two bins closest to the position. points that are less
+    // than one bin apart always share at least one cell.
+    Scalar lower = std::floor(m_positions[islope] - Scalar(0.5));
+    if ((lower < -1) or (m_numOffsetBins <= lower)) {
+      continue;
+    }
+    vote(static_cast<int>(lower), islope);
+    vote(static_cast<int>(lower) + 1, islope);
+  }
+}
+
+void HoughFinder::Accumulator::vote(int ioffset, int islope)
+{
+  if ((ioffset < 0) or (m_numOffsetBins <= ioffset)) {
+    return;
+  }
+  int icell = islope * m_numOffsetBins + ioffset;
+  Cell& cell = m_cells[icell];
+  // first vote since the last clear
+  if (cell.round < m_roundCleared) {
+    cell.votes = 0;
+    m_touched.push_back(icell);
+  }
+  // first vote from the current sensor
+  if (cell.round != m_round) {
+    cell.votes += 1;
+    cell.round = m_round;
+  }
+}
+
+void HoughFinder::Accumulator::findPeaks(uint32_t votesMin,
+                                         bool localMaxima,
+                                         std::vector<Peak>& peaks) const
+{
+  // votes of a cell; stale cells from a previous fill are empty
+  auto votes = [&](int ioffset, int islope) -> uint32_t {
+    if ((ioffset < 0) or (m_numOffsetBins <= ioffset) or (islope < 0) or
+        (m_numSlopeBins <= islope)) {
+      return 0;
+    }
+    const Cell& cell = m_cells[islope * m_numOffsetBins + ioffset];
+    return (cell.round < m_roundCleared) ? 0 : cell.votes;
+  };
+
+  peaks.clear();
+  for (auto icell : m_touched) {
+    const Cell& cell = m_cells[icell];
+    if (cell.votes < votesMin) {
+      continue;
+    }
+    int ioffset = icell % m_numOffsetBins;
+    int islope = icell / m_numOffsetBins;
+    // a single point always votes for two neighbouring cells; for local
+    // maxima w/ equal votes only the first cell is used.
+    bool isMaximum = true;
+    for (int jslope = islope - 1; localMaxima and (jslope <= islope + 1);
+         ++jslope) {
+      for (int joffset = ioffset - 1; joffset <= ioffset + 1; ++joffset) {
+        int jcell = jslope * m_numOffsetBins + joffset;
+        uint32_t other = votes(joffset, jslope);
+        if ((cell.votes < other) or
+            ((cell.votes == other) and (jcell < icell))) {
+          isMaximum = false;
+        }
+      }
+    }
+    if (not isMaximum) {
+      continue;
+    }
+    Peak peak;
+    peak.offset = m_offsetMin + (ioffset + Scalar(0.5)) * m_offsetBinWidth;
+    peak.slope = m_slopeMin + (islope + Scalar(0.5)) * m_slopeBinWidth;
+    peak.votes = cell.votes;
+    peaks.push_back(peak);
+  }
+  // stable sort keeps a deterministic order for peaks w/ equal votes
+  std::stable_sort(
+      peaks.begin(), peaks.end(),
+      [](const Peak& a, const Peak& b) { return (b.votes < a.votes); });
+}
+
+HoughFinder::HoughFinder(const Device& device,
+                         std::vector<Index> trackingIds,
+                         double searchSpatialSigmaMax,
+                         size_t sizeMin,
+                         double redChi2Max,
+                         double slopeSigmaMax)
+    : m_sensorIds(std::move(trackingIds))
+    // 2-d Mahalanobis distance peaks at 2 and not at 1
+    , m_d2LocMax((0 < searchSpatialSigmaMax)
+                     ? (2 * searchSpatialSigmaMax * searchSpatialSigmaMax)
+                     : -1)
+    // a single vote can not define a line
+    , m_sizeMin(std::max<size_t>(sizeMin, 2))
+    , m_reducedChi2Max(redChi2Max)
+    // the accumulators are only configured in the constructor body
+    , m_buffers([this] {
+      auto buffers = std::make_shared<Buffers>();
+      buffers->xz = m_xz;
+      buffers->yz = m_yz;
+      buffers->points.resize(m_sensorIds.size());
+      return buffers;
+    })
+{
+  checkTrackingIds(device, m_sensorIds, sizeMin);
+
+  const auto& geo = device.geometry();
+  Scalar zMin = std::numeric_limits<Scalar>::max();
+  Scalar zMax = std::numeric_limits<Scalar>::lowest();
+  for (auto id : m_sensorIds) {
+    m_planes.push_back(geo.getPlane(id));
+    zMin = std::min(zMin, m_planes.back().origin()[kZ]);
+    zMax = std::max(zMax, m_planes.back().origin()[kZ]);
+  }
+  if (not(zMin < zMax)) {
+    throw std::runtime_error("Tracking sensors must be separated along z");
+  }
+  // offsets are defined in the middle to minimize the slope lever arm
+  m_reference = (zMin + zMax) / 2;
+
+  auto makeAccumulator = [&](int axis, Scalar slope, Scalar slopeStdev) {
+    Scalar pitchMax = 0;
+    Sensor::Volume box = Sensor::Volume::Empty();
+    for (auto id : m_sensorIds) {
+      const auto& sensor = device.getSensor(id);
+      pitchMax = std::max(pitchMax, sensor.projectedPitch()[axis]);
+      box.enclose(sensor.projectedBoundingBox());
+    }
+    // votes are spread over two offset bins
+    Scalar offsetBinWidth = 2 * pitchMax;
+    // one slope bin changes the offset by at most half an offset bin
+    Scalar slopeBinWidth = offsetBinWidth / (zMax - zMin);
+    Scalar slopeMin = slope - slopeSigmaMax * slopeStdev;
+    Scalar slopeMax = slope + slopeSigmaMax * slopeStdev;
+    // extend the offset range to the reference position
+    Scalar pad = std::max(std::abs(slopeMin), std::abs(slopeMax)) *
+                 (zMax - zMin) / 2;
+    return Accumulator(box.min(axis) - pad, box.max(axis) + pad,
+                       offsetBinWidth, slopeMin, slopeMax, slopeBinWidth);
+  };
+  Vector2 slopeStdev = geo.beamSlopeCovariance().diagonal().cwiseSqrt();
+  m_xz = makeAccumulator(kX, geo.beamSlope()[0], slopeStdev[0]);
+  m_yz = makeAccumulator(kY, geo.beamSlope()[1], slopeStdev[1]);
+
+  for (auto id : m_sensorIds) {
+    const auto& sensor = device.getSensor(id);
+    VERBOSE(sensor.name(), " id=", sensor.id(), " is a tracking plane");
+  }
+}
+
+std::string HoughFinder::name() const { return "HoughFinder"; }
+
+void HoughFinder::execute(Event& event) const
+{
+  auto& buffers = m_buffers.local();
+  auto& xz = buffers.xz;
+  auto& yz = buffers.yz;
+  auto& candidates = buffers.candidates;
+
+  // collect free clusters in the global system ordered along x
+  for (size_t isensor = 0; isensor < m_sensorIds.size(); ++isensor) {
+    collectFreePoints(m_planes[isensor],
+                      event.getSensorEvent(m_sensorIds[isensor]),
+                      buffers.points[isensor]);
+  }
+
+  // fill the xz-accumulator with all clusters
+  xz.clear();
+  for (const auto& points : buffers.points) {
+    xz.nextSensor();
+    for (const auto& point : points) {
+      xz.fill(point.position[kX], point.position[kZ] - m_reference);
+    }
+  }
+  // the xz-projection can be crowded in busy events so that neighbouring
+  // cells belong to different tracks. all cells above threshold are used and
+  // duplicated candidates are removed by the final ambiguity resolution.
+  xz.findPeaks(m_sizeMin, false, buffers.peaksXZ);
+
+  // points within the x window for the given xz-line
+  Scalar windowX = 1.5 * xz.offsetBinWidth();
+  Scalar windowY = 1.5 * yz.offsetBinWidth();
+  auto findCompatibleX = [&](size_t isensor,
+                             const Accumulator::Peak& peakXZ) {
+    const auto& points = buffers.points[isensor];
+    Scalar x = peakXZ.offset + peakXZ.slope * (m_planes[isensor].origin()[kZ] -
+                                               m_reference);
+    // add some margin for tilted sensors; the exact check comes later
+    Scalar margin = 2 * windowX;
+    auto first = std::lower_bound(
+        points.begin(), points.end(), x - margin,
+        [](const GlobalPoint& p, Scalar v) { return p.position[kX] < v; });
+    auto last = std::upper_bound(
+        first, points.end(), x + margin,
+        [](Scalar v, const GlobalPoint& p) { return v < p.position[kX]; });
+    return std::make_pair(first, last);
+  };
+  auto residual = [&](const Accumulator::Peak& peak, int axis,
+                      const GlobalPoint& point) {
+    return point.position[axis] -
+           (peak.offset + peak.slope * (point.position[kZ] - m_reference));
+  };
+
+  auto& selected = buffers.selected;
+  candidates.clear();
+  for (const auto& peakXZ : buffers.peaksXZ) {
+    // resolve y using only clusters compatible with the xz-line
+    yz.clear();
+    for (size_t isensor = 0; isensor < m_sensorIds.size(); ++isensor) {
+      auto range = findCompatibleX(isensor, peakXZ);
+      yz.nextSensor();
+      for (auto point = range.first; point != range.second; ++point) {
+        if (std::abs(residual(peakXZ, kX, *point)) <= windowX) {
+          yz.fill(point->position[kY], point->position[kZ] - m_reference);
+        }
+      }
+    }
+    // only few clusters remain and local maxima are sufficient
+    yz.findPeaks(m_sizeMin, true, buffers.peaksYZ);
+
+    for (const auto& peakYZ : buffers.peaksYZ) {
+      // select the closest cluster on each sensor for an initial fit
+      LineFitter3D fitter;
+      for (size_t isensor = 0; isensor < m_sensorIds.size(); ++isensor) {
+        auto range = findCompatibleX(isensor, peakXZ);
+        auto best = range.second;
+        Scalar bestDistance = std::numeric_limits<Scalar>::max();
+        for (auto point = range.first; point != range.second; ++point) {
+          Scalar dx = residual(peakXZ, kX, *point) / windowX;
+          Scalar dy = residual(peakYZ, kY, *point) / windowY;
+          if ((1 < std::abs(dx)) or (1 < std::abs(dy))) {
+            continue;
+          }
+          if ((dx * dx + dy * dy) < bestDistance) {
+            best = point;
+            bestDistance = dx * dx + dy * dy;
+          }
+        }
+        if (best != range.second) {
+          fitter.addPoint(best->position, best->weight);
+        }
+      }
+      if (static_cast<size_t>(fitter.numPoints) < m_sizeMin) {
+        continue;
+      }
+      fitter.fit();
+      Vector6 initial = fitter.params();
+
+      // the accumulator bins are coarse compared to the resolution and
+      // nearby tracks can be mixed. reselect the clusters closest to the
+      // initial fit and refit w/ the compatible ones to obtain the track.
+      selected.clear();
+      for (size_t isensor = 0; isensor < m_sensorIds.size(); ++isensor) {
+        auto range = findCompatibleX(isensor, peakXZ);
+        auto best = range.second;
+        Scalar bestDistance = std::numeric_limits<Scalar>::max();
+        for (auto point = range.first; point != range.second; ++point) {
+          if ((windowX < std::abs(residual(peakXZ, kX, *point))) or
+              (windowY < std::abs(residual(peakYZ, kY, *point)))) {
+            continue;
+          }
+          if (lineDistance(initial, *point) < bestDistance) {
+            best = point;
+            bestDistance = lineDistance(initial, *point);
+          }
+        }
+        if (best != range.second) {
+          selected.emplace_back(isensor, &*best);
+        }
+      }
+      Track track;
+      if (fitStraightCandidate(m_sensorIds, m_d2LocMax, m_sizeMin,
+                               m_reducedChi2Max, selected, track)) {
+        candidates.push_back(std::move(track));
+      }
+    }
+  }
+
+  // resolve ambiguities between candidates from different peaks, e.g.
+  // neighbouring bins, in the same way as the combinatorial track finder.
+  size_t numAddedTracks = addExclusiveTracks(candidates, candidates.size(),
+                                             buffers.order, event);
+
+  DEBUG(buffers.peaksXZ.size(), " peaks in xz, ", candidates.size(),
+        " candidates, ", numAddedTracks, " tracks added to event");
+}
+
+} // namespace proteus
@@ -0,0 +1,153 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "loop/processor.h"
+#include "mechanics/geometry.h"
+#include "storage/track.h"
+#include "tracking/findertools.h"
+#include "utils/definitions.h"
+#include "utils/scratch.h"
+
+namespace proteus {
+
+class Device;
+
+/** Find straight tracks using a Hough transform.
+ *
+ * All free clusters on the tracking sensors vote in a binned accumulator
+ * over the offset and the slope of the track projection onto the global
+ * xz-plane. Peaks with votes from at least the minimum number of different
+ * sensors define track candidates. For each candidate, the same procedure
+ * is repeated in the yz-plane using only the clusters close to the
+ * xz-line. For each peak pair, at most one cluster per sensor is selected
+ * and a straight line is fitted. Since the bins are coarse compared to the
+ * resolution, the clusters closest to this initial fit are reselected and
+ * clusters that are incompatible with the refitted line are removed to form
+ * a track candidate. Ambiguities between candidates are
+ * resolved as in the ``TrackFinder``: the longest candidates with the
+ * smallest chi2 are accepted first and clusters are used by at most one
+ * track.
+ *
+ * The runtime scales linearly with the number of clusters and does not
+ * depend on the combinatorics, which makes it suitable for high occupancy
+ * events. The bin sizes are derived from the sensor pitch and the slope
+ * range from the beam divergence.
+ *
+ * Like for the ``TrackFinder``, only the global track parameters are
+ * estimated. Local track states must be computed using one of the fitter
+ * processors.
+ */
+class HoughFinder : public Processor {
+public:
+  /**
+   * \param trackingIds           Ids of tracking sensors
+   * \param searchSpatialSigmaMax Cluster compatibility cut, negative to disable
+   * \param sizeMin               Selection cut on number of clusters
+   * \param redChi2Max            Cut on track chi2/d.o.f, negative to disable
+   * \param slopeSigmaMax         Slope search range in units of the beam
+   *                              divergence
+   */
+  HoughFinder(const Device& device,
+              std::vector<Index> trackingIds,
+              double searchSpatialSigmaMax,
+              size_t sizeMin,
+              double redChi2Max,
+              double slopeSigmaMax = 3);
+
+  std::string name() const;
+  /** Find tracks and add them to the event. */
+  void execute(Event& event) const;
+
+private:
+  /** Binned votes over offset and slope of a projected line.
+   *
+   * Each cell counts the number of different sensors that voted for it.
+   * Cells are marked with the fill round instead of being reset so that the
+   * accumulator can be reused with a cost that only depends on the number
+   * of votes and not on the number of cells.
+   */
+  class Accumulator {
+  public:
+    struct Peak {
+      Scalar offset;
+      Scalar slope;
+      uint32_t votes;
+    };
+
+    Accumulator() = default;
+    Accumulator(Scalar offsetMin,
+                Scalar offsetMax,
+                Scalar offsetBinWidth,
+                Scalar slopeMin,
+                Scalar slopeMax,
+                Scalar slopeBinWidth);
+
+    Scalar offsetBinWidth() const { return m_offsetBinWidth; }
+    /** Remove all votes. */
+    void clear();
+    /** Start a new sensor; each sensor votes at most once per cell. */
+    void nextSensor();
+    /** Add votes for a point at the given distance to the reference. */
+    void fill(Scalar position, Scalar distance);
+    /** Find cells w/ a minimum number of votes, most votes first.
+     *
+     * \param localMaxima Only use cells that are local maxima
+     */
+    void findPeaks(uint32_t votesMin,
+                   bool localMaxima,
+                   std::vector<Peak>& peaks) const;
+
+  private:
+    struct Cell {
+      // fill round of the last vote
+      uint32_t round = 0;
+      uint32_t votes = 0;
+    };
+
+    void vote(int ioffset, int islope);
+
+    Scalar m_offsetMin = 0;
+    Scalar m_offsetBinWidth = 1;
+    Scalar m_slopeMin = 0;
+    Scalar m_slopeBinWidth = 1;
+    int m_numOffsetBins = 0;
+    int m_numSlopeBins = 0;
+    std::vector<Cell> m_cells;
+    // cells that have received votes since the last clear
+    std::vector<int> m_touched;
+    // bin positions along the offset axis for all slope bins
+    std::vector<Scalar> m_positions;
+    // round of the current sensor and of the last clear
+    uint32_t m_round = 0;
+    uint32_t m_roundCleared = 1;
+  };
+  // Temporary storage that is reused between events
+  struct Buffers {
+    Accumulator xz;
+    Accumulator yz;
+    std::vector<std::vector<GlobalPoint>> points;
+    std::vector<Accumulator::Peak> peaksXZ;
+    std::vector<Accumulator::Peak> peaksYZ;
+    PointChain selected;
+    std::vector<Track> candidates;
+    std::vector<size_t> order;
+  };
+
+  std::vector<Index> m_sensorIds;
+  std::vector<Plane> m_planes;
+  Scalar m_reference;
+  double m_d2LocMax;
+  size_t m_sizeMin;
+  double m_reducedChi2Max;
+  // Empty accumulators w/ the configured binning
+  Accumulator m_xz;
+  Accumulator m_yz;
+  mutable Scratch<Buffers> m_buffers;
+};
+
+} // namespace proteus
@@ -0,0 +1,206 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#include "kalmanfitter.h"
+
+#include "storage/event.h"
+#include "utils/logger.h"
+
+namespace proteus {
+
+namespace {
+
+// The filter only estimates corrections to the spatial track parameters.
+// Time parameters are kept at their reference values.
+constexpr int kNumParams = 4;
+using Params = Vector<Scalar, kNumParams>;
+using Covariance = SymMatrix<Scalar, kNumParams>;
+using Jacobian = Matrix<Scalar, kNumParams, kNumParams>;
+using Gain = Matrix<Scalar, kNumParams, 2>;
+// position of the estimated parameters in the full parameter vector
+constexpr int kFullIndices[kNumParams] = {kLoc0, kLoc1, kSlopeLoc0,
+                                          kSlopeLoc1};
+// position of the slope block in the estimated parameter vector
+constexpr int kReducedSlope = 2;
+// Initial uncertainties of the corrections to the reference trajectory.
+// They must be large compared to the measurement uncertainties so that the
+// result does not depend on them, but not so large that the first filter
+// updates lose precision.
+constexpr Scalar kInitialLocVar = 1e4;
+constexpr Scalar kInitialSlopeVar = 1e1;
+
+// Measured residuals w.r.t. the reference and the current correction.
+Vector2 residual(const Cluster& cluster,
+                 const TrackState& reference,
+                 const Params& correction)
+{
+  return {cluster.u() - reference.params()[kLoc0] - correction[0],
+          cluster.v() - reference.params()[kLoc1] - correction[1]};
+}
+
+} // namespace
+
+struct KalmanFitter::Buffers {
+  // reference states and transport jacobians from the previous step
+  std::vector<TrackState> references;
+  std::vector<Jacobian> jacobians;
+  // corrections predicted from the previous step
+  std::vector<Params> predicted;
+  std::vector<Covariance> predictedCovs;
+  // corrections after the filter and, later, after the smoother
+  std::vector<Params> corrections;
+  std::vector<Covariance> correctionCovs;
+  // measurement for each step; nullptr if there is none
+  std::vector<const Cluster*> clusters;
+};
+
+KalmanFitter::KalmanFitter(const Device& device,
+                           const std::vector<Index>& targetIds,
+                           bool fitUnbiased)
+    : m_steps(buildFitterSteps(device, targetIds)), m_fitUnbiased(fitUnbiased)
+{
+}
+
+std::string KalmanFitter::name() const { return "KalmanFitter"; }
+
+void KalmanFitter::execute(Event& event) const
+{
+  // temporary (resuable) storage; resizing is a no-op after the first event
+  auto& buffers = m_buffers.local();
+  auto& references = buffers.references;
+  auto& jacobians = buffers.jacobians;
+  auto& predicted = buffers.predicted;
+  auto& predictedCovs = buffers.predictedCovs;
+  auto& corrections = buffers.corrections;
+  auto& correctionCovs = buffers.correctionCovs;
+  auto& clusters = buffers.clusters;
+  size_t numSteps = m_steps.size();
+  references.resize(numSteps);
+  jacobians.resize(numSteps);
+  predicted.resize(numSteps);
+  predictedCovs.resize(numSteps);
+  corrections.resize(numSteps);
+  correctionCovs.resize(numSteps);
+  clusters.resize(numSteps);
+
+  for (Index itrack = 0; itrack < event.numTracks(); ++itrack) {
+    Track& track = event.getTrack(itrack);
+
+    // 1. Propagate the reference track through all sensors
+
+    references[0] = m_steps[0].fromGlobal(
+        TrackState(track.globalState().params(), SymMatrix6::Zero()));
+    for (size_t istep = 1; istep < numSteps; ++istep) {
+      const auto& propagator = m_steps[istep].fromPrevious;
+      const auto& prev = references[istep - 1];
+      // distance of the previous state to the plane along the plane normal
+      Scalar w0 = (propagator.toTarget() * prev.position() +
+                   propagator.sourceOrigin())[kW];
+      Matrix6 jac = propagator.jacobian(prev.tangent(), w0);
+      for (int i = 0; i < kNumParams; ++i) {
+        for (int j = 0; j < kNumParams; ++j) {
+          jacobians[istep](i, j) = jac(kFullIndices[i], kFullIndices[j]);
+        }
+      }
+      references[istep] = propagator(prev);
+    }
+
+    // 2. Forward filter for the corrections to the reference
+
+    Scalar chi2 = 0;
+    int numMeasurements = 0;
+    for (size_t istep = 0; istep < numSteps; ++istep) {
+      const auto& step = m_steps[istep];
+
+      if (istep == 0) {
+        predicted[0].setZero();
+        predictedCovs[0].setZero();
+        predictedCovs[0].diagonal() << kInitialLocVar, kInitialLocVar,
+            kInitialSlopeVar, kInitialSlopeVar;
+      } else {
+        predicted[istep] = jacobians[istep] * corrections[istep - 1];
+        predictedCovs[istep] =
+            transformCovariance(jacobians[istep], correctionCovs[istep - 1]);
+        // scattering on the sensor only affects the slopes. the local state
+        // is defined after the scattering as in the GBL fitter.
+        predictedCovs[istep].block<2, 2>(kReducedSlope, kReducedSlope) +=
+            step.scatteringCovariance;
+      }
+      corrections[istep] = predicted[istep];
+      correctionCovs[istep] = predictedCovs[istep];
+      clusters[istep] = nullptr;
+
+      if (not track.hasClusterOn(step.sensorId)) {
+        continue;
+      }
+      const Cluster& cluster =
+          event.getSensorEvent(step.sensorId)
+              .getCluster(track.getClusterOn(step.sensorId));
+      clusters[istep] = &cluster;
+
+      // predicted residuals and covariance
+      Vector2 r = residual(cluster, references[istep], predicted[istep]);
+      SymMatrix2 R =
+          cluster.uvCov() + predictedCovs[istep].topLeftCorner<2, 2>();
+      // optimal Kalman gain matrix
+      Gain K = predictedCovs[istep].leftCols<2>() * symmetricInverse(R);
+      corrections[istep] += K * r;
+      correctionCovs[istep] -= K * predictedCovs[istep].topRows<2>();
+      // the predicted residuals sum up to the total chi2
+      chi2 += mahalanobisSquared(R, r);
+      numMeasurements += 1;
+    }
+    track.setGoodnessOfFit(chi2, 2 * numMeasurements - kNumParams);
+
+    // 3. Rauch-Tung-Striebel smoother; updates the corrections in-place
+
+    for (size_t istep = numSteps - 1; 0 < istep--;) {
+      const auto& F = jacobians[istep + 1];
+      const auto& cov = predictedCovs[istep + 1];
+      // smoother gain `P_k F^T (P_{k+1|k})^-1`; uses the filtered covariance
+      Jacobian A = cov.ldlt().solve(F * correctionCovs[istep]).transpose();
+      corrections[istep] +=
+          A * (corrections[istep + 1] - predicted[istep + 1]);
+      correctionCovs[istep] +=
+          A * (correctionCovs[istep + 1] - cov) * A.transpose();
+    }
+
+    // 4. Extract the local track states on the target sensors
+
+    for (size_t istep = 0; istep < numSteps; ++istep) {
+      const auto& step = m_steps[istep];
+      if (not step.isTarget) {
+        continue;
+      }
+
+      Params correction = corrections[istep];
+      Covariance cov = correctionCovs[istep];
+      // remove the measurement from the smoothed state, i.e. a filter update
+      // w/ negative measurement covariance.
+      if (m_fitUnbiased and clusters[istep]) {
+        const Cluster& cluster = *clusters[istep];
+        Vector2 r = residual(cluster, references[istep], correction);
+        SymMatrix2 R = cov.topLeftCorner<2, 2>() - cluster.uvCov();
+        Gain K = cov.leftCols<2>() * symmetricInverse(R);
+        correction += K * r;
+        cov -= K * cov.topRows<2>();
+      }
+
+      Vector6 params = references[istep].params();
+      SymMatrix6 fullCov = SymMatrix6::Zero();
+      for (int i = 0; i < kNumParams; ++i) {
+        params[kFullIndices[i]] += correction[i];
+        for (int j = 0; j < kNumParams; ++j) {
+          fullCov(kFullIndices[i], kFullIndices[j]) = cov(i, j);
+        }
+      }
+      event.getSensorEvent(step.sensorId)
+          .setLocalState(itrack, params, fullCov);
+    }
+
+    DEBUG("track ", itrack, " chi2/dof: ", chi2, " / ",
+          track.degreesOfFreedom());
+  }
+}
+
+} // namespace proteus
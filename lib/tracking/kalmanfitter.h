@@ -0,0 +1,55 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <vector>
+
+#include "loop/processor.h"
+#include "tracking/fittersteps.h"
+#include "utils/definitions.h"
+#include "utils/scratch.h"
+
+namespace proteus {
+
+class Device;
+
+/** Estimate local track parameters using a Kalman filter and smoother.
+ *
+ * The track is described by corrections to a straight reference trajectory
+ * defined by the global track state. A forward Kalman filter over all sensors
+ * along the beam is followed by a Rauch-Tung-Striebel smoother to obtain the
+ * optimal local track parameters on each plane. Multiple scattering is
+ * included as process noise on all intermediate sensors and sensors without
+ * measurements are treated as dead material. This uses the same track model
+ * as the ``GblFitter`` w/ fixed-size matrices only. Only the spatial track
+ * parameters are estimated and time measurements are not used.
+ *
+ * For the unbiased fit, the measurement on each target sensor is removed
+ * from the smoothed state on that sensor.
+ *
+ * The global track parameters are not modified.
+ */
+class KalmanFitter : public Processor {
+public:
+  /**
+   * \param targetIds   Sensors for which local track states are estimated
+   * \param fitUnbiased Exclude the measurement on each target sensor
+   */
+  KalmanFitter(const Device& device,
+               const std::vector<Index>& targetIds,
+               bool fitUnbiased = false);
+
+  std::string name() const;
+  void execute(Event& event) const;
+
+private:
+  // Temporary storage that is reused between events
+  struct Buffers;
+
+  std::vector<FitterStep> m_steps;
+  bool m_fitUnbiased;
+  mutable Scratch<Buffers> m_buffers;
+};
+
+} // namespace proteus
@@ -129,6 +129,105 @@ struct LineFitter4D : LineFitterND<kZ, kX, kY, kT> {
   SymMatrix6 cov() const { return getCov(OutputIndices{}); }
 };
 
+/** Fit lines in multiple dimensions for a batch of tracks at once.
+ *
+ * \tparam I  Index of the independent coordinate
+ * \tparam Ds Indices of the dependent coordinates
+ *
+ * This is the batch equivalent of `LineFitterND`. The weighted sums of each
+ * track are stored in a separate lane of structure-of-arrays columns, i.e.
+ * one row per track, so that adding points for all tracks at once is
+ * vectorized over the tracks. Tracks w/o a point in a given call are masked
+ * and do not change their sums.
+ */
+template <size_t I, size_t... Ds>
+struct LineFitterBatchND {
+  enum {
+    kIndependent = I,
+    kNDependents = sizeof...(Ds),
+    kNParameters = 2 * sizeof...(Ds),
+  };
+  using Column = Eigen::Array<double, Eigen::Dynamic, 1>;
+  // weighted sums and input variance for all tracks, see `LineFitter`
+  struct Lines {
+    Column s, sx, sy, sxx, sxy, syy, cxx;
+  };
+
+  std::array<Lines, kNDependents> lines;
+  Eigen::Array<int, Eigen::Dynamic, 1> numPoints;
+
+  /** Reset the fitter for a new batch w/ the given number of tracks. */
+  void reset(Eigen::Index numTracks);
+  /** Add one point for each track in the batch.
+   *
+   * \param points  N-dimensional points w/ one row per track
+   * \param weights N-dimensional weights w/ one row per track
+   * \param mask    One for tracks w/ a valid point and zero otherwise
+   *
+   * Points and weights of masked tracks must still be finite.
+   */
+  template <typename Points, typename Weights>
+  void addPoints(const Eigen::MatrixBase<Points>& points,
+                 const Eigen::MatrixBase<Weights>& weights,
+                 const Column& mask);
+  /** Fit the lines for all tracks from all previously added points. */
+  void fit();
+
+  /** Fitted sum of squared, weighted residuals for one track. */
+  double chi2(Eigen::Index itrack) const;
+  /** Fit degrees-of-freedom for one track. */
+  int dof(Eigen::Index itrack) const
+  {
+    return kNDependents * numPoints[itrack] - kNParameters;
+  }
+  /** Get fit parameters for one track.
+   *
+   * \see LineFitterND::getParams for details on indices
+   */
+  template <size_t... Os>
+  Vector<double, sizeof...(Os)> getParams(Eigen::Index itrack,
+                                          std::index_sequence<Os...>) const;
+  /** Get fit parameter covariance for one track.
+   *
+   * \see LineFitterND::getParams for details on indices
+   */
+  template <size_t... Os>
+  SymMatrix<double, sizeof...(Os)> getCov(Eigen::Index itrack,
+                                          std::index_sequence<Os...>) const;
+};
+
+/** Fit lines in x,y as a function of z for a batch of tracks. */
+struct LineFitterBatch3D : LineFitterBatchND<kZ, kX, kY> {
+  using Single = LineFitter3D;
+
+  /** Fitted track parameters for one track. */
+  Vector6 params(Eigen::Index itrack) const
+  {
+    return getParams(itrack, Single::OutputIndices{});
+  }
+  /** Fitted track parameter covariance for one track. */
+  SymMatrix6 cov(Eigen::Index itrack) const
+  {
+    return getCov(itrack, Single::OutputIndices{});
+  }
+};
+
+/** Fit lines in x,y,t as a function of z for a batch of tracks. */
+struct LineFitterBatch4D : LineFitterBatchND<kZ, kX, kY, kT> {
+  using Single = LineFitter4D;
+
+  /** Fitted track parameters for one track. */
+  Vector6 params(Eigen::Index itrack) const
+  {
+    return getParams(itrack, Single::OutputIndices{});
+  }
+  /** Fitted track parameter covariance for one track. */
+  SymMatrix6 cov(Eigen::Index itrack) const
+  {
+    return getCov(itrack, Single::OutputIndices{});
+  }
+};
+
 // inline implementations
 
 template <size_t I, size_t... Ds>
@@ -206,4 +305,111 @@ LineFitterND<I, Ds...>::getCov(std::index_sequence<Os...>) const
   return out;
 }
 
+template <size_t I, size_t... Ds>
+inline void LineFitterBatchND<I, Ds...>::reset(Eigen::Index numTracks)
+{
+  // resizing is a no-op if the size does not change
+  for (auto& line : lines) {
+    line.s.setZero(numTracks);
+    line.sx.setZero(numTracks);
+    line.sy.setZero(numTracks);
+    line.sxx.setZero(numTracks);
+    line.sxy.setZero(numTracks);
+    line.syy.setZero(numTracks);
+    line.cxx.setZero(numTracks);
+  }
+  numPoints.setZero(numTracks);
+}
+
+template <size_t I, size_t... Ds>
+template <typename Points, typename Weights>
+inline void LineFitterBatchND<I, Ds...>::addPoints(
+    const Eigen::MatrixBase<Points>& points,
+    const Eigen::MatrixBase<Weights>& weights,
+    const Column& mask)
+{
+  auto x = points.col(kIndependent).array();
+  size_t j = 0;
+  for (auto d : std::array<size_t, kNDependents>{Ds...}) {
+    auto y = points.col(d).array();
+    // masked tracks get a vanishing weight and their sums are unchanged
+    Column w = mask * weights.col(d).array();
+    auto& line = lines[j++];
+    line.s += w;
+    line.sx += w * x;
+    line.sy += w * y;
+    line.sxx += w * x * x;
+    line.sxy += w * x * y;
+    line.syy += w * y * y;
+  }
+  numPoints += mask.template cast<int>();
+}
+
+template <size_t I, size_t... Ds>
+inline void LineFitterBatchND<I, Ds...>::fit()
+{
+  for (auto& line : lines) {
+    line.cxx = line.s * line.sxx - line.sx * line.sx;
+  }
+}
+
+template <size_t I, size_t... Ds>
+inline double LineFitterBatchND<I, Ds...>::chi2(Eigen::Index i) const
+{
+  double ret = 0.0;
+  for (const auto& l : lines) {
+    ret += l.syy[i] + (l.sxy[i] * (2 * l.sx[i] * l.sy[i] - l.s[i] * l.sxy[i]) -
+                       l.sxx[i] * l.sy[i] * l.sy[i]) /
+                          l.cxx[i];
+  }
+  return ret;
+}
+
+template <size_t I, size_t... Ds>
+template <size_t... Os>
+inline Vector<double, sizeof...(Os)>
+LineFitterBatchND<I, Ds...>::getParams(Eigen::Index i,
+                                       std::index_sequence<Os...>) const
+{
+  static_assert(2 * sizeof...(Ds) <= sizeof...(Os), "Output too small");
+
+  using Output = Vector<double, sizeof...(Os)>;
+  using Indices = std::array<size_t, sizeof...(Os)>;
+
+  Output out = Output::Zero();
+  // map interal order [offset0, slope0, offset1, slope1, ...] to output
+  Indices idx = {Os...};
+  for (size_t j = 0; j < kNDependents; ++j) {
+    const auto& l = lines[j];
+    out[idx[2 * j + 0]] = (l.sy[i] * l.sxx[i] - l.sx[i] * l.sxy[i]) / l.cxx[i];
+    out[idx[2 * j + 1]] = (l.s[i] * l.sxy[i] - l.sx[i] * l.sy[i]) / l.cxx[i];
+  }
+  return out;
+}
+
+template <size_t I, size_t... Ds>
+template <size_t... Os>
+inline SymMatrix<double, sizeof...(Os)>
+LineFitterBatchND<I, Ds...>::getCov(Eigen::Index i,
+                                    std::index_sequence<Os...>) const
+{
+  static_assert(2 * sizeof...(Ds) <= sizeof...(Os), "Output too small");
+
+  using Indices = std::array<size_t, sizeof...(Os)>;
+  using Output = SymMatrix<double, sizeof...(Os)>;
+
+  Output out = Output::Zero();
+  // map interal order [offset0, slope0, offset1, slope1, ...] to output
+  Indices idx = {Os...};
+  for (size_t j = 0; j < kNDependents; ++j) {
+    const auto& l = lines[j];
+    auto ioff = idx[2 * j + 0];
+    auto islp = idx[2 * j + 1];
+    out(ioff, ioff) = l.sxx[i] / l.cxx[i];
+    out(islp, islp) = l.s[i] / l.cxx[i];
+    out(ioff, islp) = out(islp, ioff) = -l.sx[i] / l.cxx[i];
+  }
+  return out;
+}
+
 } // namespace proteus
@@ -77,13 +77,60 @@ jacobianState(const Vector4& tangent, const Matrix4& toTarget, Scalar w0)
 TrackState
 propagateTo(const TrackState& state, const Plane& source, const Plane& target)
 {
-  // combined transformation matrix from source to target system
-  Matrix4 toTarget = target.linearToLocal() * source.linearToGlobal();
+  return Propagator(source, target)(state);
+}
+
+Propagator::Propagator() : Propagator(Plane(), Plane()) {}
+
+Propagator::Propagator(const Plane& source, const Plane& target)
+    : m_toTarget(target.linearToLocal() * source.linearToGlobal())
+    , m_sourceOrigin(target.toLocal(source.origin()))
+{
+  computeUnrestricted();
+}
+
+Propagator::Propagator(const CompiledGeometry& geo,
+                       Index sourceId,
+                       Index targetId)
+    : m_toTarget(geo.getLinearTransform(sourceId, targetId))
+    , m_sourceOrigin(geo.getSourceOrigin(sourceId, targetId))
+{
+  computeUnrestricted();
+}
+
+void Propagator::computeUnrestricted()
+{
+  // see `jacobianState` for the definitions
+  m_toUnrestricted.col(kLoc0) = m_toTarget.col(kU);
+  m_toUnrestricted.col(kLoc1) = m_toTarget.col(kV);
+  m_toUnrestricted.col(kTime) = m_toTarget.col(kS);
+}
+
+Matrix6 Propagator::jacobian(const Vector4& tangent, Scalar w0) const
+{
+  const auto& R = m_toUnrestricted;
+  // target tangent derived from the source tangent in slope normalization
+  Vector4 S = m_toTarget * tangent * (1 / tangent[kW]);
+  // equivalent to `F * R` in `jacobianState` w/o the explicit zeros in F
+  Matrix3 FR;
+  FR.row(kLoc0) = R.row(kU) - (S[kU] / S[kW]) * R.row(kW);
+  FR.row(kLoc1) = R.row(kV) - (S[kV] / S[kW]) * R.row(kW);
+  FR.row(kTime) = R.row(kS) - (S[kS] / S[kW]) * R.row(kW);
+  Matrix6 jac;
+  // clang-format off
+  jac <<              FR, (-w0 / S[kW]) * FR,
+         Matrix3::Zero(), (  1 / S[kW]) * FR;
+  // clang-format on
+  return jac;
+}
+
+TrackState Propagator::operator()(const TrackState& state) const
+{
   // initial unrestricted track state in the target system
-  Vector4 pos = target.toLocal(source.toGlobal(state.position()));
-  Vector4 tan = toTarget * state.tangent();
+  Vector4 pos = m_toTarget * state.position() + m_sourceOrigin;
+  Vector4 tan = m_toTarget * state.tangent();
   // build propagation jacobian
-  Matrix6 jacobian = jacobianState(state.tangent(), toTarget, pos[kW]);
+  Matrix6 jacobian = this->jacobian(state.tangent(), pos[kW]);
   // scale target tangent to slope parametrization
   tan /= tan[kW];
   // move position to intersection w/ the target plane
@@ -99,4 +146,60 @@ propagateTo(const TrackState& state, const Plane& source, const Plane& target)
   return {params, transformCovariance(jacobian, state.cov())};
 }
 
+void Propagator::propagate(
+    Eigen::Ref<Matrix<Scalar, Eigen::Dynamic, 6>> params,
+    SymMatrix6* covs) const
+{
+  const Matrix4& T = m_toTarget;
+  const Vector4& r0 = m_sourceOrigin;
+
+  // the covariance propagation needs the initial parameters
+  for (Eigen::Index i = 0; i < params.rows(); ++i) {
+    Vector4 tan;
+    tan[kU] = params(i, kSlopeLoc0);
+    tan[kV] = params(i, kSlopeLoc1);
+    tan[kW] = 1;
+    tan[kS] = params(i, kSlopeTime);
+    // initial distance to the target plane; initial position is on-plane
+    Scalar w0 = T(kW, kU) * params(i, kLoc0) + T(kW, kV) * params(i, kLoc1) +
+                T(kW, kS) * params(i, kTime) + r0[kW];
+    covs[i] = transformCovariance(jacobian(tan, w0), covs[i]);
+  }
+  // the parameter propagation has no dependencies between different states
+  // and operates on contiguous columns; this is easy to vectorize.
+  for (Eigen::Index i = 0; i < params.rows(); ++i) {
+    Scalar loc0 = params(i, kLoc0);
+    Scalar loc1 = params(i, kLoc1);
+    Scalar time = params(i, kTime);
+    Scalar slope0 = params(i, kSlopeLoc0);
+    Scalar slope1 = params(i, kSlopeLoc1);
+    Scalar slopeTime = params(i, kSlopeTime);
+    // initial unrestricted position in the target system
+    Scalar u = T(kU, kU) * loc0 + T(kU, kV) * loc1 + T(kU, kS) * time + r0[kU];
+    Scalar v = T(kV, kU) * loc0 + T(kV, kV) * loc1 + T(kV, kS) * time + r0[kV];
+    Scalar w = T(kW, kU) * loc0 + T(kW, kV) * loc1 + T(kW, kS) * time + r0[kW];
+    Scalar s = T(kS, kU) * loc0 + T(kS, kV) * loc1 + T(kS, kS) * time + r0[kS];
+    // initial tangent in the target system w/ source slope normalization
+    Scalar du = T(kU, kU) * slope0 + T(kU, kV) * slope1 + T(kU, kW) +
+                T(kU, kS) * slopeTime;
+    Scalar dv = T(kV, kU) * slope0 + T(kV, kV) * slope1 + T(kV, kW) +
+                T(kV, kS) * slopeTime;
+    Scalar dw = T(kW, kU) * slope0 + T(kW, kV) * slope1 + T(kW, kW) +
+                T(kW, kS) * slopeTime;
+    Scalar ds = T(kS, kU) * slope0 + T(kS, kV) * slope1 + T(kS, kW) +
+                T(kS, kS) * slopeTime;
+    // scale target tangent to slope parametrization
+    du /= dw;
+    dv /= dw;
+    ds /= dw;
+    // move position to the intersection w/ the target plane
+    params(i, kLoc0) = u - du * w;
+    params(i, kLoc1) = v - dv * w;
+    params(i, kTime) = s - ds * w;
+    params(i, kSlopeLoc0) = du;
+    params(i, kSlopeLoc1) = dv;
+    params(i, kSlopeTime) = ds;
+  }
+}
+
 } // namespace proteus
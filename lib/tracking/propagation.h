@@ -13,6 +13,7 @@
 
 namespace proteus {
 
+class CompiledGeometry;
 class Plane;
 
 /** Spatial slope [slope0,slope1] transport jacobian between two systems.
@@ -40,4 +41,61 @@ jacobianState(const Vector4& tangent, const Matrix4& toTarget, Scalar w0);
 TrackState
 propagateTo(const TrackState& state, const Plane& source, const Plane& target);
 
+/** Straight propagation between two fixed planes.
+ *
+ * The relative transformation between the two planes and the slope-independent
+ * parts of the propagation Jacobian are computed once during construction.
+ * This avoids recomputing them when many states are propagated between the
+ * same planes, e.g. for all track candidates during the track finding.
+ */
+class Propagator {
+public:
+  /** Construct an identity propagation within the global system. */
+  Propagator();
+  /** Construct the propagation from the source to the target plane. */
+  Propagator(const Plane& source, const Plane& target);
+  /** Construct the propagation between two sensors w/ the precomputed
+   * transformation from the compiled geometry. */
+  Propagator(const CompiledGeometry& geo, Index sourceId, Index targetId);
+
+  /** Linear transformation from the source to the target system. */
+  const Matrix4& toTarget() const { return m_toTarget; }
+  /** Origin of the source system in the target system. */
+  const Vector4& sourceOrigin() const { return m_sourceOrigin; }
+  /** Full parameter transport jacobian.
+   *
+   * \param tangent Initial track tangent in slope parametrization
+   * \param w0      Initial distance to the plane along the target normal
+   */
+  Matrix6 jacobian(const Vector4& tangent, Scalar w0) const;
+
+  /** Propagate a single state from the source to the target plane. */
+  TrackState operator()(const TrackState& state) const;
+  /** Propagate multiple states from the source to the target plane.
+   *
+   * \param params Parameters w/ one row per state, i.e. column-wise storage
+   * \param covs   Covariance matrices w/ one entry per row in `params`
+   *
+   * The parameters are stored as a structure-of-arrays where each column
+   * contains one parameter for all states. This allows the parameter
+   * propagation to be vectorized over all states.
+   */
+  void propagate(Eigen::Ref<Matrix<Scalar, Eigen::Dynamic, 6>> params,
+                 SymMatrix6* covs) const;
+
+private:
+  void computeUnrestricted();
+
+  // linear transformation from the source to the target system
+  Matrix4 m_toTarget;
+  // source origin in the target system
+  Vector4 m_sourceOrigin;
+  // unrestricted target coordinates change w/ source track parameters; only
+  // depends on the transformation and not on the track state.
+  Matrix<Scalar, 4, 3> m_toUnrestricted;
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
 } // namespace proteus
@@ -11,7 +11,9 @@
 #include <memory>
 
 #include "loop/eventloop.h"
+#include "tracking/brokenlinefitter.h"
 #include "tracking/gblfitter.h"
+#include "tracking/kalmanfitter.h"
 #include "tracking/straightfitter.h"
 #include "utils/logger.h"
 
@@ -19,16 +21,24 @@ namespace proteus {
 
 void setupTrackFitter(const Device& device,
                       const std::string& type,
+                      const std::vector<Index>& targetIds,
                       EventLoop& loop)
 {
   if (type.empty()) {
     INFO("no track fitter is configured");
+  } else if (type == "brokenline") {
+    loop.addProcessor(std::make_shared<BrokenLineFitter>(device, targetIds));
   } else if (type == "gbl3d") {
-    loop.addProcessor(std::make_shared<GblFitter>(device));
+    loop.addProcessor(std::make_shared<GblFitter>(device, targetIds));
+  } else if (type == "kalman") {
+    loop.addProcessor(std::make_shared<KalmanFitter>(device, targetIds));
+  } else if (type == "kalman_unbiased") {
+    loop.addProcessor(
+        std::make_shared<KalmanFitter>(device, targetIds, true));
   } else if (type == "straight3d") {
-    loop.addProcessor(std::make_shared<Straight3dFitter>(device));
+    loop.addProcessor(std::make_shared<Straight3dFitter>(device, targetIds));
   } else if (type == "straight4d") {
-    loop.addProcessor(std::make_shared<Straight4dFitter>(device));
+    loop.addProcessor(std::make_shared<Straight4dFitter>(device, targetIds));
   } else {
     FAIL("unknown configured track fitter '", type, "'");
   }
@@ -9,15 +9,22 @@
 #pragma once
 
 #include <string>
+#include <vector>
+
+#include "utils/definitions.h"
 
 namespace proteus {
 
 class Device;
 class EventLoop;
 
-/** Select a track fitter implementation by name. */
+/** Select a track fitter implementation by name.
+ *
+ * \param targetIds Sensors for which local track states are estimated
+ */
 void setupTrackFitter(const Device& device,
                       const std::string& type,
+                      const std::vector<Index>& targetIds,
                       EventLoop& loop);
 
 } // namespace proteus
@@ -8,100 +8,238 @@
 
 #include "straightfitter.h"
 
+#include <algorithm>
 #include <limits>
+#include <utility>
 
 #include "mechanics/device.h"
 #include "storage/event.h"
 #include "tracking/linefitter.h"
+#include "utils/threadpool.h"
 
 namespace proteus {
 
-template <typename Fitter>
-static inline void
-executeImpl(const Geometry& geo, bool fitUnbiased, Event& event)
+// transformations from each sensor into the global system
+static std::vector<Propagator> makeToGlobal(const Device& device)
 {
-  for (Index itrack = 0; itrack < event.numTracks(); ++itrack) {
-    Track& track = event.getTrack(itrack);
-
-    // global fit for common goodness-of-fit and common global parameters
-    {
-      Fitter fitter;
-      // add all clusters in the global system
-      for (const auto& c : track.clusters()) {
-        const Plane& source = geo.getPlane(c.sensor);
-        const Cluster& cluster =
-            event.getSensorEvent(c.sensor).getCluster(c.cluster);
-        Vector4 global = source.toGlobal(cluster.position());
-        Vector4 weight =
-            transformCovariance(source.linearToGlobal(), cluster.positionCov())
-                .diagonal()
-                .cwiseInverse();
-        fitter.addPoint(global, weight);
+  const auto& geo = device.compiledGeometry();
+  std::vector<Propagator> toGlobal;
+  for (Index isource = 0; isource < device.numSensors(); ++isource) {
+    toGlobal.emplace_back(geo.getPlane(isource), Plane());
+  }
+  return toGlobal;
+}
+
+// transformations from all sensors to the target sensors, target-major
+static std::vector<Propagator> makeToLocal(const Device& device,
+                                           const std::vector<Index>& targetIds)
+{
+  const auto& geo = device.compiledGeometry();
+  std::vector<Propagator> toLocal;
+  for (auto targetId : targetIds) {
+    for (Index isource = 0; isource < device.numSensors(); ++isource) {
+      toLocal.emplace_back(geo, isource, targetId);
+    }
+  }
+  return toLocal;
+}
+
+// unique elements of a symmetric 4x4 matrix, diagonal first
+static constexpr int kCovRows[10] = {0, 1, 2, 3, 0, 0, 0, 1, 1, 2};
+static constexpr int kCovCols[10] = {0, 1, 2, 3, 1, 2, 3, 2, 3, 3};
+
+// clusters of all tracks as structure-of-arrays w/ one row per track
+template <typename Batch>
+struct StraightBuffers {
+  using Positions = Matrix<Scalar, Eigen::Dynamic, 4>;
+  using Covariances = Matrix<Scalar, Eigen::Dynamic, 10>;
+
+  // cluster positions, covariances, and availability for each sensor
+  std::vector<Positions> positions;
+  std::vector<Covariances> covs;
+  std::vector<typename Batch::Column> masks;
+  std::vector<char> hasClusters;
+  // clusters of one sensor in the target system
+  Positions transformed;
+  Positions weights;
+  Batch fitter;
+};
+
+// add the clusters on one sensor for all tracks in the target system
+template <typename Batch>
+static inline void addPoints(const Propagator& transform,
+                             Index sensor,
+                             StraightBuffers<Batch>& buffers)
+{
+  const Matrix4& jac = transform.toTarget();
+  const auto& positions = buffers.positions[sensor];
+  const auto& covs = buffers.covs[sensor];
+  auto& transformed = buffers.transformed;
+  auto& weights = buffers.weights;
+
+  // resizing is a no-op after the first sensor
+  weights.resize(positions.rows(), 4);
+  transformed.noalias() = positions * jac.transpose();
+  transformed.rowwise() += transform.sourceOrigin().transpose();
+  // diagonal of `jac * cov * jac^T` from the unique covariance elements.
+  // the independent coordinate has no weight
+  for (int d = 0; d < 4; ++d) {
+    auto var = weights.col(d).array();
+    if (d == Batch::kIndependent) {
+      var.setOnes();
+      continue;
+    }
+    var.setZero();
+    for (int k = 0; k < 10; ++k) {
+      int a = kCovRows[k];
+      int b = kCovCols[k];
+      Scalar factor = (a == b) ? 1 : 2;
+      var += (factor * jac(d, a) * jac(d, b)) * covs.col(k).array();
+    }
+    var = var.inverse();
+  }
+  buffers.fitter.addPoints(transformed, weights, buffers.masks[sensor]);
+}
+
+// fit the tracks in [begin, end) as one batch
+template <typename Batch>
+static inline void fitBlock(const std::vector<Index>& targetIds,
+                            const std::vector<Propagator>& toGlobal,
+                            const std::vector<Propagator>& toLocal,
+                            bool fitUnbiased,
+                            Index begin,
+                            Index end,
+                            StraightBuffers<Batch>& buffers,
+                            Event& event)
+{
+  Index numSensors = event.numSensorEvents();
+  Index numTracks = end - begin;
+
+  // collect the clusters of all tracks for each sensor; sensors w/o cluster
+  // use a finite, masked placeholder so they can be processed uniformly.
+  buffers.positions.resize(numSensors);
+  buffers.covs.resize(numSensors);
+  buffers.masks.resize(numSensors);
+  buffers.hasClusters.assign(numSensors, false);
+  for (Index isensor = 0; isensor < numSensors; ++isensor) {
+    buffers.positions[isensor].setZero(numTracks, 4);
+    buffers.covs[isensor].setZero(numTracks, 10);
+    buffers.covs[isensor].template leftCols<4>().setOnes();
+    buffers.masks[isensor].setZero(numTracks);
+  }
+  for (Index itrack = 0; itrack < numTracks; ++itrack) {
+    for (const auto& c : event.getTrack(begin + itrack).clusters()) {
+      const Cluster& cluster =
+          event.getSensorEvent(c.sensor).getCluster(c.cluster);
+      const SymMatrix4& cov = cluster.positionCov();
+      buffers.positions[c.sensor].row(itrack) = cluster.position();
+      for (int k = 0; k < 10; ++k) {
+        buffers.covs[c.sensor](itrack, k) = cov(kCovRows[k], kCovCols[k]);
       }
-      fitter.fit();
-      track.setGlobalState(fitter.params(), fitter.cov());
-      track.setGoodnessOfFit(fitter.chi2(), fitter.dof());
+      buffers.masks[c.sensor][itrack] = 1;
+      buffers.hasClusters[c.sensor] = true;
+    }
+  }
+
+  auto& fitter = buffers.fitter;
+
+  // global fit for common goodness-of-fit and common global parameters
+  fitter.reset(numTracks);
+  for (Index isensor = 0; isensor < numSensors; ++isensor) {
+    if (buffers.hasClusters[isensor]) {
+      addPoints(toGlobal[isensor], isensor, buffers);
     }
+  }
+  fitter.fit();
+  for (Index itrack = 0; itrack < numTracks; ++itrack) {
+    Track& track = event.getTrack(begin + itrack);
+    track.setGlobalState(fitter.params(itrack), fitter.cov(itrack));
+    track.setGoodnessOfFit(fitter.chi2(itrack), fitter.dof(itrack));
+  }
 
-    // local fit for optimal parameters/covariance on each sensor plane
-    for (Index iref = 0; iref < event.numSensorEvents(); ++iref) {
-      Fitter fitter;
-      // add all clusters in the target local system
-      const Plane& target = geo.getPlane(iref);
-      for (const auto& c : track.clusters()) {
-        // exclude measurements on target plane for unbiased fit
-        if (fitUnbiased and (c.sensor == iref)) {
-          continue;
-        }
-        const Plane& source = geo.getPlane(c.sensor);
-        const Cluster& cluster =
-            event.getSensorEvent(c.sensor).getCluster(c.cluster);
-        Vector4 local = target.toLocal(source.toGlobal(cluster.position()));
-        Matrix4 jac = target.linearToLocal() * source.linearToGlobal();
-        Vector4 weight = transformCovariance(jac, cluster.positionCov())
-                             .diagonal()
-                             .cwiseInverse();
-        fitter.addPoint(local, weight);
+  // local fit for optimal parameters/covariance on each target plane
+  for (size_t itarget = 0; itarget < targetIds.size(); ++itarget) {
+    Index iref = targetIds[itarget];
+    fitter.reset(numTracks);
+    for (Index isensor = 0; isensor < numSensors; ++isensor) {
+      // exclude measurements on target plane for unbiased fit
+      if (fitUnbiased and (isensor == iref)) {
+        continue;
       }
-      fitter.fit();
-      // local fits only update the local state; not the global fit quality
-      event.getSensorEvent(iref).setLocalState(itrack, fitter.params(),
-                                               fitter.cov());
+      if (buffers.hasClusters[isensor]) {
+        addPoints(toLocal[itarget * numSensors + isensor], isensor, buffers);
+      }
+    }
+    fitter.fit();
+    // local fits only update the local state; not the global fit quality
+    auto& sensorEvent = event.getSensorEvent(iref);
+    for (Index itrack = 0; itrack < numTracks; ++itrack) {
+      sensorEvent.setLocalState(begin + itrack, fitter.params(itrack),
+                                fitter.cov(itrack));
     }
   }
 }
-// straight 3d
 
-Straight3dFitter::Straight3dFitter(const Device& device)
-    : m_geo(device.geometry())
+// number of tracks that are fitted together in one parallel task
+static constexpr Index kFitBlockSize = 64;
+
+template <typename Batch>
+StraightFitterBase<Batch>::StraightFitterBase(const Device& device,
+                                              std::vector<Index> targetIds,
+                                              bool fitUnbiased)
+    : m_targetIds(std::move(targetIds))
+    , m_toGlobal(makeToGlobal(device))
+    , m_toLocal(makeToLocal(device, m_targetIds))
+    , m_fitUnbiased(fitUnbiased)
 {
 }
 
-std::string Straight3dFitter::name() const { return "Straight3dFitter"; }
-
-void Straight3dFitter::execute(Event& event) const
+template <typename Batch>
+void StraightFitterBase<Batch>::execute(Event& event) const
 {
-  executeImpl<LineFitter3D>(m_geo, false, event);
+  Index numTracks = event.numTracks();
+  Index numBlocks = (numTracks + kFitBlockSize - 1) / kFitBlockSize;
+
+  // each task writes only to the preallocated states of its own tracks
+  for (auto targetId : m_targetIds) {
+    event.getSensorEvent(targetId).allocateLocalStates(numTracks);
+  }
+  globalThreadPool().parallelFor(numBlocks, [&](size_t, size_t iblock) {
+    Index begin = iblock * kFitBlockSize;
+    Index end = std::min(numTracks, begin + kFitBlockSize);
+    fitBlock(m_targetIds, m_toGlobal, m_toLocal, m_fitUnbiased, begin, end,
+             m_buffers.local(), event);
+  });
 }
 
-// straight 4d
+template class StraightFitterBase<LineFitterBatch3D>;
+template class StraightFitterBase<LineFitterBatch4D>;
+
+// straight 3d
 
-Straight4dFitter::Straight4dFitter(const Device& device)
-    : m_geo(device.geometry())
+Straight3dFitter::Straight3dFitter(const Device& device,
+                                   std::vector<Index> targetIds)
+    : StraightFitterBase(device, std::move(targetIds), false)
 {
 }
 
-std::string Straight4dFitter::name() const { return "Straight4dFitter"; }
+std::string Straight3dFitter::name() const { return "Straight3dFitter"; }
+
+// straight 4d
 
-void Straight4dFitter::execute(Event& event) const
+Straight4dFitter::Straight4dFitter(const Device& device,
+                                   std::vector<Index> targetIds)
+    : StraightFitterBase(device, std::move(targetIds), false)
 {
-  executeImpl<LineFitter4D>(m_geo, false, event);
 }
 
+std::string Straight4dFitter::name() const { return "Straight4dFitter"; }
+
 // unbiased straight 3d
 
-UnbiasedStraight3dFitter::UnbiasedStraight3dFitter(const Device& device)
-    : m_geo(device.geometry())
+UnbiasedStraight3dFitter::UnbiasedStraight3dFitter(const Device& device,
+                                                   std::vector<Index> targetIds)
+    : StraightFitterBase(device, std::move(targetIds), true)
 {
 }
 
@@ -110,15 +248,11 @@ std::string UnbiasedStraight3dFitter::name() const
   return "UnbiasedStraight3dFitter";
 }
 
-void UnbiasedStraight3dFitter::execute(Event& event) const
-{
-  executeImpl<LineFitter3D>(m_geo, true, event);
-}
-
 // unbiased straight 4d
 
-UnbiasedStraight4dFitter::UnbiasedStraight4dFitter(const Device& device)
-    : m_geo(device.geometry())
+UnbiasedStraight4dFitter::UnbiasedStraight4dFitter(const Device& device,
+                                                   std::vector<Index> targetIds)
+    : StraightFitterBase(device, std::move(targetIds), true)
 {
 }
 
@@ -127,9 +261,4 @@ std::string UnbiasedStraight4dFitter::name() const
   return "UnbiasedStraight4dFitter";
 }
 
-void UnbiasedStraight4dFitter::execute(Event& event) const
-{
-  executeImpl<LineFitter4D>(m_geo, true, event);
-}
-
 } // namespace proteus
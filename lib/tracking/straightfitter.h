@@ -11,78 +11,110 @@
 #include <vector>
 
 #include "loop/processor.h"
+#include "tracking/propagation.h"
+#include "utils/definitions.h"
+#include "utils/scratch.h"
 
 namespace proteus {
 
 class Device;
-class Geometry;
+struct LineFitterBatch3D;
+struct LineFitterBatch4D;
+template <typename Batch>
+struct StraightBuffers;
+
+/** Common implementation of the straight line fitters.
+ *
+ * \tparam Batch Line fitter for a block of tracks, w/ or w/o time
+ */
+template <typename Batch>
+class StraightFitterBase : public Processor {
+public:
+  void execute(Event& event) const;
+
+protected:
+  /**
+   * \param targetIds   Sensors for which local track states are estimated
+   * \param fitUnbiased Ignore the measurement on the target sensor
+   */
+  StraightFitterBase(const Device& device,
+                     std::vector<Index> targetIds,
+                     bool fitUnbiased);
+
+private:
+  std::vector<Index> m_targetIds;
+  // precomputed transformations from each sensor into the global system and
+  // into the local system of every target sensor
+  std::vector<Propagator> m_toGlobal;
+  std::vector<Propagator> m_toLocal;
+  bool m_fitUnbiased;
+  mutable Scratch<StraightBuffers<Batch>> m_buffers;
+};
 
 /** Estimate local track parameters using a straight line fit.
  *
  * This calculates global track parameters and global goodness-of-fit and
- * the local track parameters on the all sensor planes.
+ * the local track parameters on the selected sensor planes. Blocks of tracks
+ * are fitted in parallel using the global thread pool.
  */
-class Straight3dFitter : public Processor {
+class Straight3dFitter : public StraightFitterBase<LineFitterBatch3D> {
 public:
-  Straight3dFitter(const Device& device);
+  /**
+   * \param targetIds Sensors for which local track states are estimated
+   */
+  Straight3dFitter(const Device& device, std::vector<Index> targetIds);
 
   std::string name() const;
-  void execute(Event& event) const;
-
-private:
-  const Geometry& m_geo;
 };
 
 /** Estimate local track parameters including time using a straight line fit.
  *
  * This calculates global track parameters and global goodness-of-fit and
- * the local track parameters on the all sensor planes.
+ * the local track parameters on the selected sensor planes. Blocks of tracks
+ * are fitted in parallel using the global thread pool.
  */
-class Straight4dFitter : public Processor {
+class Straight4dFitter : public StraightFitterBase<LineFitterBatch4D> {
 public:
-  Straight4dFitter(const Device& device);
+  /**
+   * \param targetIds Sensors for which local track states are estimated
+   */
+  Straight4dFitter(const Device& device, std::vector<Index> targetIds);
 
   std::string name() const;
-  void execute(Event& event) const;
-
-private:
-  const Geometry& m_geo;
 };
 
 /** Estimate local track parameters without local information.
  *
  * This calculates new global track parameters and global goodness-of-fit and
- * the local track parameters on the all sensor planes. If the track has any
- * measurement information on a sensor, this measurement is ignored when
+ * the local track parameters on the selected sensor planes. If the track has
+ * any measurement information on a sensor, this measurement is ignored when
  * estimating the local track parameters on that sensor.
  */
-class UnbiasedStraight3dFitter : public Processor {
+class UnbiasedStraight3dFitter : public StraightFitterBase<LineFitterBatch3D> {
 public:
-  UnbiasedStraight3dFitter(const Device& device);
+  /**
+   * \param targetIds Sensors for which local track states are estimated
+   */
+  UnbiasedStraight3dFitter(const Device& device, std::vector<Index> targetIds);
 
   std::string name() const;
-  void execute(Event& event) const;
-
-private:
-  const Geometry& m_geo;
 };
 
 /** Estimate local track parameters including time without local information.
  *
  * This calculates new global track parameters and global goodness-of-fit and
- * the local track parameters on the all sensor planes. If the track has any
- * measurement information on a sensor, this measurement is ignored when
+ * the local track parameters on the selected sensor planes. If the track has
+ * any measurement information on a sensor, this measurement is ignored when
  * estimating the local track parameters on that sensor.
  */
-class UnbiasedStraight4dFitter : public Processor {
+class UnbiasedStraight4dFitter : public StraightFitterBase<LineFitterBatch4D> {
 public:
-  UnbiasedStraight4dFitter(const Device& device);
+  /**
+   * \param targetIds Sensors for which local track states are estimated
+   */
+  UnbiasedStraight4dFitter(const Device& device, std::vector<Index> targetIds);
 
   std::string name() const;
-  void execute(Event& event) const;
-
-private:
-  const Geometry& m_geo;
 };
 
 } // namespace proteus
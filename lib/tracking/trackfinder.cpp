@@ -7,12 +7,15 @@
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <numeric>
 
 #include "mechanics/device.h"
 #include "storage/event.h"
+#include "tracking/findertools.h"
 #include "tracking/linefitter.h"
 #include "tracking/propagation.h"
 #include "utils/logger.h"
+#include "utils/threadpool.h"
 
 namespace proteus {
 
@@ -21,7 +24,10 @@ TrackFinder::TrackFinder(const Device& device,
                          double searchSpatialSigmaMax,
                          double searchTemporalSigmaMax,
                          size_t sizeMin,
-                         double redChi2Max)
+                         double redChi2Max,
+                         int searchCandidatesMax,
+                         double searchRedChi2Max,
+                         size_t seedSize)
     // 2-d Mahalanobis distance peaks at 2 and not at 1
     : m_d2LocMax((0 < searchSpatialSigmaMax)
                      ? (2 * searchSpatialSigmaMax * searchSpatialSigmaMax)
@@ -30,26 +36,17 @@ TrackFinder::TrackFinder(const Device& device,
                       ? (searchTemporalSigmaMax * searchTemporalSigmaMax)
                       : -1)
     , m_reducedChi2Max(redChi2Max)
+    , m_searchCandidatesMax((0 < searchCandidatesMax) ? searchCandidatesMax : 0)
+    , m_searchReducedChi2Max(searchRedChi2Max)
+    , m_seedSize(seedSize)
 {
-  if (trackingIds.size() < 2) {
-    throw std::runtime_error("Need at least two sensors two find tracks");
+  checkTrackingIds(device, trackingIds, sizeMin);
+  if (seedSize < 1) {
+    throw std::runtime_error("Seed size must be at least one");
   }
-  if (trackingIds.size() < sizeMin) {
-    throw std::runtime_error(
-        "Number of tracking sensors < minimum number of clusters");
-  }
-  // ensure the requested tracking sensors are unique
-  std::sort(trackingIds.begin(), trackingIds.end());
-  if (std::unique(trackingIds.begin(), trackingIds.end()) !=
-      trackingIds.end()) {
-    throw std::runtime_error("Found duplicate tracking sensor ids");
-  }
-  // ensure the requested tracking sensors are valid
-  std::vector<Index> allIds = device.sensorIds();
-  std::sort(allIds.begin(), allIds.end());
-  if (!std::includes(allIds.begin(), allIds.end(), trackingIds.begin(),
-                     trackingIds.end())) {
-    throw std::runtime_error("Found invalid tracking sensor ids");
+  // seeds from the last seeding sensor must be completed
+  if ((1 < seedSize) and (sizeMin < seedSize)) {
+    throw std::runtime_error("Seed size > minimum number of clusters");
   }
 
   // Build the search steps along the beam direction.
@@ -60,7 +57,7 @@ TrackFinder::TrackFinder(const Device& device,
   // interactions.
 
   // Determine the range of sensors to be searched/propagated to.
-  sortAlongBeam(device.geometry(), trackingIds);
+  std::vector<Index> allIds = device.sensorIds();
   sortAlongBeam(device.geometry(), allIds);
   auto first = std::find(allIds.begin(), allIds.end(), trackingIds.front());
   auto last = std::next(std::find(first, allIds.end(), trackingIds.back()));
@@ -72,6 +69,9 @@ TrackFinder::TrackFinder(const Device& device,
 
     // geometry and propagation uncertainty is always needed
     step.plane = device.geometry().getPlane(*first);
+    if (!m_steps.empty()) {
+      step.fromPrevious = Propagator(m_steps.back().plane, step.plane);
+    }
     // at the moment only multiple scattering is considered
     // TODO what else? beam energy spread? alignment uncertainty?
     step.processNoise = SymMatrix6::Zero();
@@ -104,6 +104,8 @@ TrackFinder::TrackFinder(const Device& device,
 
     m_steps.push_back(std::move(step));
   }
+  // default plane constructor yields the global plane
+  m_toGlobal = Propagator(m_steps.back().plane, Plane{});
 
   // (debug) output
   for (const auto& step : m_steps) {
@@ -119,39 +121,273 @@ TrackFinder::TrackFinder(const Device& device,
     }
     DEBUG("  minimum candidate size: ", step.candidateSizeMin);
   }
+  if (0 < m_searchCandidatesMax) {
+    VERBOSE("keep at most ", m_searchCandidatesMax, " candidates per seed");
+  }
+  if (0 < m_searchReducedChi2Max) {
+    VERBOSE("search cut on chi2/d.o.f: ", m_searchReducedChi2Max);
+  }
+  if (1 < m_seedSize) {
+    VERBOSE("seeds from ", m_seedSize, " clusters on consecutive sensors");
+  }
 }
 
 std::string TrackFinder::name() const { return "TrackFinder"; }
 
-// Propagate all states from the previous plane to the current plane.
+namespace {
+
+// Track candidates as lightweight handles into a shared cluster tree.
 //
-// This incorporates uncertainties from material interactions.
-static void propagateToCurrent(const SymMatrix6& processNoise,
-                               const Plane& previousPlane,
-                               const Plane& currentPlane,
-                               std::vector<Track>& candidates)
-{
-  for (auto& track : candidates) {
-    // include material interactions at the prev plane
-    TrackState state(track.globalState().params(),
-                     track.globalState().cov() + processNoise);
-    state = propagateTo(state, previousPlane, currentPlane);
-    track.setGlobalState(state);
+// Each node of the tree corresponds to one cluster added to a candidate and
+// links to the node of the previously added cluster. Extending or bifurcating
+// a candidate only adds a single node; cluster lists are never copied. The
+// current states of all candidates are stored separately in
+// structure-of-arrays layout for batch propagation. Full tracks are only
+// materialized for the selected candidates.
+class CandidateTree {
+public:
+  struct Node {
+    Index parent;
+    Index sensor;
+    Index cluster;
+  };
+  struct Candidate {
+    // first and last node of the cluster chain
+    Index root;
+    Index leaf;
+    size_t size;
+    Scalar chi2;
+    int dof;
+  };
+
+  size_t size() const { return m_candidates.size(); }
+  const Candidate& operator[](size_t i) const { return m_candidates[i]; }
+  const Node& node(Index inode) const { return m_nodes[inode]; }
+  TrackState state(size_t i) const
+  {
+    return {m_params.row(i).transpose(), m_covs[i]};
+  }
+
+  /** Remove all candidates and nodes but keep the allocated memory. */
+  void clear()
+  {
+    m_nodes.clear();
+    m_candidates.clear();
+    m_covs.clear();
+  }
+  /** Add a new single-cluster candidate. */
+  void addSeed(Index sensor, Index cluster, const TrackState& state)
+  {
+    Index inode = addNode(kInvalidIndex, sensor, cluster);
+    // no fit yet -> no chi2, undefined degrees-of-freedom
+    m_candidates.push_back({inode, inode, 1, 0, -1});
+    appendState(state);
+  }
+  /** Add a new multi-cluster candidate from a filtered seed. */
+  void addSeed(const std::vector<Track::TrackCluster>& clusters,
+               const TrackState& state,
+               Scalar chi2)
+  {
+    Candidate seed;
+    seed.root = seed.leaf = addNode(kInvalidIndex, clusters.front().sensor,
+                                    clusters.front().cluster);
+    for (auto c = std::next(clusters.begin()); c != clusters.end(); ++c) {
+      seed.leaf = addNode(seed.leaf, c->sensor, c->cluster);
+    }
+    seed.size = clusters.size();
+    seed.chi2 = chi2;
+    seed.dof = 3 * seed.size - 6;
+    m_candidates.push_back(seed);
+    appendState(state);
+  }
+  /** Extend a candidate by one cluster and store it at the given position.
+   *
+   * If the position is equal to the number of candidates, the extended
+   * candidate is added as a new candidate.
+   */
+  void extend(size_t i,
+              const Candidate& from,
+              Index sensor,
+              Index cluster,
+              const TrackState& filtered,
+              Scalar chi2Update)
+  {
+    Candidate extended;
+    extended.root = from.root;
+    extended.leaf = addNode(from.leaf, sensor, cluster);
+    extended.size = from.size + 1;
+    extended.chi2 = from.chi2 + chi2Update;
+    extended.dof = 3 * extended.size - 6;
+    if (i == m_candidates.size()) {
+      m_candidates.push_back(extended);
+      appendState(filtered);
+    } else {
+      m_candidates[i] = extended;
+      m_params.row(i) = filtered.params();
+      m_covs[i] = filtered.cov();
+    }
+  }
+  /** Remove all candidates for which the predicate is true.
+   *
+   * The predicate is called with the candidate index. The relative order of
+   * the remaining candidates is unchanged.
+   */
+  template <typename Predicate>
+  size_t removeIf(Predicate pred)
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < m_candidates.size(); ++i) {
+      if (pred(i)) {
+        continue;
+      }
+      if (n != i) {
+        m_candidates[n] = m_candidates[i];
+        m_params.row(n) = m_params.row(i);
+        m_covs[n] = m_covs[i];
+      }
+      n += 1;
+    }
+    size_t numRemoved = m_candidates.size() - n;
+    m_candidates.resize(n);
+    m_covs.resize(n);
+    return numRemoved;
+  }
+  /** Propagate all states with optional additional noise before. */
+  void propagate(const Propagator& propagator, const SymMatrix6* noise)
+  {
+    if (noise) {
+      for (auto& cov : m_covs) {
+        cov += *noise;
+      }
+    }
+    propagator.propagate(
+        m_params.topRows(static_cast<Eigen::Index>(m_candidates.size())),
+        m_covs.data());
+  }
+  /** Collect the clusters of the given candidate in search order. */
+  void collectClusters(size_t i,
+                       std::vector<Track::TrackCluster>& clusters) const
+  {
+    // clusters are linked backwards
+    clusters.clear();
+    for (Index inode = m_candidates[i].leaf; inode != kInvalidIndex;
+         inode = m_nodes[inode].parent) {
+      clusters.push_back({m_nodes[inode].sensor, m_nodes[inode].cluster});
+    }
+    std::reverse(clusters.begin(), clusters.end());
+  }
+  /** Materialize the full track for the given candidate. */
+  Track makeTrack(size_t i) const
+  {
+    const auto& candidate = m_candidates[i];
+    Track track(state(i), candidate.chi2, candidate.dof);
+    collectClusters(i, m_chain);
+    for (const auto& c : m_chain) {
+      track.addCluster(c.sensor, c.cluster);
+    }
+    return track;
+  }
+
+private:
+  Index addNode(Index parent, Index sensor, Index cluster)
+  {
+    m_nodes.push_back({parent, sensor, cluster});
+    return static_cast<Index>(m_nodes.size() - 1);
+  }
+  void appendState(const TrackState& state)
+  {
+    auto i = static_cast<Eigen::Index>(m_covs.size());
+    // grow geometrically to avoid reallocating on every bifurcation
+    if (m_params.rows() <= i) {
+      m_params.conservativeResize(std::max<Eigen::Index>(16, 2 * i),
+                                  Eigen::NoChange);
+    }
+    m_params.row(i) = state.params();
+    m_covs.push_back(state.cov());
   }
-}
 
-// Propagate all states from the local plane into the global plane.
+  std::vector<Node> m_nodes;
+  std::vector<Candidate> m_candidates;
+  Matrix<Scalar, Eigen::Dynamic, 6> m_params;
+  std::vector<SymMatrix6> m_covs;
+  // temporary storage to reverse the cluster chain
+  mutable std::vector<Track::TrackCluster> m_chain;
+};
+
+// Compatible clusters for a contiguous block of candidates.
+struct SearchBlock {
+  // number of compatible clusters for each candidate in the block
+  std::vector<size_t> numMatches;
+  // filter results for all compatible clusters in search order
+  std::vector<Index> clusters;
+  std::vector<TrackState> filtered;
+  std::vector<Scalar> chi2Updates;
+};
+
+} // namespace
+
+struct TrackFinder::Buffers {
+  CandidateTree candidates;
+  // incomplete seeds for multi-cluster seeding
+  CandidateTree seeds;
+  std::vector<bool> usedClusters;
+  // temporary storage for the parallel search
+  std::vector<SearchBlock> blocks;
+  // temporary storage for the seed extension
+  std::vector<std::pair<Scalar, Index>> sortedClusters;
+  std::vector<Track::TrackCluster> seedClusters;
+  // temporary storage for the candidate pruning and sorting
+  std::vector<size_t> order;
+  std::vector<bool> isExcess;
+};
+
+// number of candidates that are searched together in one parallel task
+static constexpr size_t kSearchBlockSize = 64;
+
+// Filter the state with the cluster if they are compatible.
 //
-// This only computes the equivalent state representation w/o extra noise.
-static void propagateToGlobal(const Plane& local,
-                              std::vector<Track>& candidates)
+// Returns false if the cluster is incompatible with the predicted state.
+// Otherwise, the filtered state and the chi2 increment are computed using
+// the Kalman filter method.
+static bool filterCluster(Scalar d2LocMax,
+                          Scalar d2TimeMax,
+                          const Cluster& cluster,
+                          const TrackState& state,
+                          TrackState& filtered,
+                          Scalar& chi2Update)
 {
-  for (auto& track : candidates) {
-    // no additional uncertainty since we want the equivalent state
-    // default plane constructor yields the global plane
-    TrackState state = propagateTo(track.globalState(), local, Plane{});
-    track.setGlobalState(state);
+  // predicted residuals and covariance
+  Vector3 r = cluster.onPlane() - state.onPlane();
+  SymMatrix3 R = cluster.onPlaneCov() + state.onPlaneCov();
+
+  // check if the cluster is compatible in space
+  Scalar d2Loc =
+      mahalanobisSquared(R.block<2, 2>(kLoc0 - kOnPlane, kLoc0 - kOnPlane),
+                         r.segment<2>(kLoc0));
+  if ((0 <= d2LocMax) and (d2LocMax < d2Loc)) {
+    return false;
+  }
+  // check if the cluster is compatible in time
+  Scalar d2Time =
+      mahalanobisSquared(R.block<1, 1>(kTime - kOnPlane, kTime - kOnPlane),
+                         r.segment<1>(kTime - kOnPlane));
+  if ((0 <= d2TimeMax) and (d2TimeMax < d2Time)) {
+    return false;
   }
+
+  // optimal Kalman gain matrix
+  Matrix<Scalar, 6, 3> K =
+      state.cov().block<6, 3>(0, kOnPlane) * symmetricInverse(R);
+  // filtered local state and covariance
+  filtered =
+      TrackState(state.params() + K * r,
+                 state.cov() - K * state.cov().block<3, 6>(kOnPlane, 0));
+  // filtered residuals and covariance
+  r = cluster.onPlane() - filtered.onPlane();
+  R = cluster.onPlaneCov() - filtered.onPlaneCov();
+  // chi^2 update
+  chi2Update = mahalanobisSquared(R, r);
+  return true;
 }
 
 // Search for matching clusters for all candidates on the given sensor.
@@ -159,14 +395,71 @@ static void propagateToGlobal(const Plane& local,
 // Ambiguities are not resolved but result in additional track candidates.
 // Track states are updated using the Kalman filter method based on the
 // additional information from the added cluster.
+//
+// Candidates only interact via the final selection. The compatibility checks
+// for blocks of candidates are distributed over the thread pool. The results
+// are applied afterwards in the same order as for a sequential search so
+// that the resulting candidates do not depend on the number of threads.
 static void searchSensor(Scalar d2LocMax,
                          Scalar d2TimeMax,
                          Index sensorId,
                          const SensorEvent& sensorEvent,
-                         std::vector<Track>& candidates,
+                         CandidateTree& candidates,
+                         std::vector<SearchBlock>& blocks,
                          std::vector<bool>& usedClusters)
 {
-  // loop only over the initial candidates and not the added ones
+  // only the initial candidates are searched and not the added ones
+  size_t numTracks = candidates.size();
+  size_t numBlocks = (numTracks + kSearchBlockSize - 1) / kSearchBlockSize;
+
+  if (blocks.size() < numBlocks) {
+    blocks.resize(numBlocks);
+  }
+  globalThreadPool().parallelFor(numBlocks, [&](size_t, size_t iblock) {
+    auto& block = blocks[iblock];
+    size_t end = std::min(numTracks, (iblock + 1) * kSearchBlockSize);
+
+    block.numMatches.clear();
+    block.clusters.clear();
+    block.filtered.clear();
+    block.chi2Updates.clear();
+    for (size_t itrack = iblock * kSearchBlockSize; itrack < end; ++itrack) {
+      const TrackState state = candidates.state(itrack);
+      size_t numMatches = 0;
+
+      for (Index icluster = 0; icluster < sensorEvent.numClusters();
+           ++icluster) {
+        const auto& cluster = sensorEvent.getCluster(icluster);
+
+        // in principle, there could already be tracks in the event,
+        // e.g. running multiple track finders with different settings, and
+        // we should only consider free clusters. a bit academic, i know.
+        if (cluster.isInTrack()) {
+          continue;
+        }
+
+        TrackState filtered;
+        Scalar chi2Update;
+        if (not filterCluster(d2LocMax, d2TimeMax, cluster, state, filtered,
+                              chi2Update)) {
+          continue;
+        }
+        block.clusters.push_back(icluster);
+        block.filtered.push_back(filtered);
+        block.chi2Updates.push_back(chi2Update);
+        numMatches += 1;
+      }
+      block.numMatches.push_back(numMatches);
+    }
+  });
+
+  // clusters in existing tracks can not be used for seeding either
+  for (Index icluster = 0; icluster < sensorEvent.numClusters(); ++icluster) {
+    if (sensorEvent.getCluster(icluster).isInTrack()) {
+      usedClusters[icluster] = true;
+    }
+  }
+  // apply the results in the original search order
   //
   // WARNING
   // we are modifying the list of candidates while iterating over it.
@@ -174,80 +467,31 @@ static void searchSensor(Scalar d2LocMax,
   // an iterator. If the underlying memory gets reallocated we will access
   // random memory and break the heap (and you will spent about a day
   // trying to figure out why a call to std::map segfaults).
-  size_t numTracks = candidates.size();
-  for (size_t itrack = 0; itrack < numTracks; ++itrack) {
-    // keep a copy; candidate state will be modified, but the original
-    // state is needed to check for further compatible clusters.
-    TrackState state = candidates[itrack].globalState();
-    Scalar chi2 = candidates[itrack].chi2();
-    int numMatchedClusters = 0;
-
-    for (Index icluster = 0; icluster < sensorEvent.numClusters(); ++icluster) {
-      auto& cluster = sensorEvent.getCluster(icluster);
-
-      // in principle, there could already be tracks in the event,
-      // e.g. running multiple track finders with different settings, and we
-      // should only consider free clusters. a bit academic, i know.
-      if (cluster.isInTrack()) {
+  for (size_t iblock = 0; iblock < numBlocks; ++iblock) {
+    const auto& block = blocks[iblock];
+    size_t imatch = 0;
+
+    for (size_t i = 0; i < block.numMatches.size(); ++i) {
+      size_t itrack = iblock * kSearchBlockSize + i;
+      // keep a copy; candidate will be modified, but the original is needed
+      // to bifurcate for further compatible clusters.
+      const CandidateTree::Candidate original = candidates[itrack];
+
+      for (size_t n = 0; n < block.numMatches[i]; ++n, ++imatch) {
+        Index icluster = block.clusters[imatch];
+        // first matched cluster updates the existing candidate, additional
+        // matched clusters bifurcate the original candidate.
+        size_t icandidate = (n == 0) ? itrack : candidates.size();
+        candidates.extend(icandidate, original, sensorId, icluster,
+                          block.filtered[imatch], block.chi2Updates[imatch]);
+
+        DEBUG("sensor ", sensorId, " added cluster ", icluster,
+              " to candidate ", itrack, " w/ dchi2=",
+              block.chi2Updates[imatch]);
+
+        // mark cluster as in-use for the seeding.
         usedClusters[icluster] = true;
-        continue;
-      }
-
-      // predicted residuals and covariance
-      Vector3 r = cluster.onPlane() - state.onPlane();
-      SymMatrix3 R = cluster.onPlaneCov() + state.onPlaneCov();
-
-      // check if the cluster is compatible in space
-      Scalar d2Loc =
-          mahalanobisSquared(R.block<2, 2>(kLoc0 - kOnPlane, kLoc0 - kOnPlane),
-                             r.segment<2>(kLoc0));
-      if ((0 <= d2LocMax) and (d2LocMax < d2Loc)) {
-        continue;
-      }
-      // check if the cluster is compatible in time
-      Scalar d2Time =
-          mahalanobisSquared(R.block<1, 1>(kTime - kOnPlane, kTime - kOnPlane),
-                             r.segment<1>(kTime - kOnPlane));
-      if ((0 <= d2TimeMax) and (d2TimeMax < d2Time)) {
-        continue;
-      }
-
-      // optimal Kalman gain matrix
-      Matrix<Scalar, 6, 3> K =
-          state.cov().block<6, 3>(0, kOnPlane) * R.inverse();
-      // filtered local state and covariance
-      TrackState filtered(state.params() + K * r,
-                          state.cov() -
-                              K * state.cov().block<3, 6>(kOnPlane, 0));
-      // filtered residuals and covariance
-      r = cluster.onPlane() - filtered.onPlane();
-      R = cluster.onPlaneCov() - filtered.onPlaneCov();
-      // chi^2 update
-      Scalar chi2Update = mahalanobisSquared(R, r);
-
-      if (numMatchedClusters == 0) {
-        // first matched cluster; update existing track
-        auto& track = candidates[itrack];
-        track.addCluster(sensorId, icluster);
-        track.setGlobalState(std::move(filtered));
-        track.setGoodnessOfFit(chi2 + chi2Update, 3 * track.size() - 6);
-      } else {
-        // additional matched cluster; duplicate track w/ different content
-        candidates.emplace_back(candidates[itrack]);
-        auto& track = candidates.back();
-        // this replaces any previously added cluster for the same sensor
-        track.addCluster(sensorId, icluster);
-        track.setGlobalState(std::move(filtered));
-        track.setGoodnessOfFit(chi2 + chi2Update, 3 * track.size() - 6);
       }
-      numMatchedClusters += 1;
-
-      DEBUG("sensor ", sensorId, " added cluster ", icluster, " to candidate ",
-            itrack, " w/ d2loc=", d2Loc, " d2time=", d2Time,
-            " dchi2=", chi2Update);
-
-      // mark cluster as in-use for the seeding.
-      usedClusters[icluster] = true;
     }
   }
 
@@ -267,7 +511,7 @@ static void makeSeedsFromUnusedClusters(Index sensorId,
                                         const SensorEvent& sensorEvent,
                                         const Vector2& seedSlope,
                                         const SymMatrix2& seedSlopeCovariance,
-                                        std::vector<Track>& candidates,
+                                        CandidateTree& candidates,
                                         std::vector<bool>& usedClusters)
 {
   size_t numSeeds = 0;
@@ -286,12 +530,10 @@ static void makeSeedsFromUnusedClusters(Index sensorId,
       continue;
     }
 
-    // abuse global state to store the state on the current plane
+    // candidate states are always stored on the current plane
     TrackState seedState(cluster.position(), cluster.positionCov(), seedSlope,
                          seedSlopeCovariance);
-    // no fit yet -> no chi2, undefined degrees-of-freedom
-    candidates.emplace_back(seedState, 0, -1);
-    candidates.back().addCluster(sensorId, icluster);
+    candidates.addSeed(sensorId, icluster, seedState);
     numSeeds += 1;
   }
 
@@ -300,47 +542,194 @@ static void makeSeedsFromUnusedClusters(Index sensorId,
   }
 }
 
+// Extend incomplete seeds with compatible clusters on the given sensor.
+//
+// Seeds must have a compatible cluster on each consecutive tracking sensor;
+// seeds w/o one are dropped. Completed seeds are moved to the candidates.
+// Free clusters are sorted by their first local coordinate so that possible
+// clusters can be preselected by binary search within a window derived from
+// the seed uncertainty, i.e. the slope compatibility given the beam
+// divergence, before the full compatibility check.
+static void extendSeeds(Scalar d2LocMax,
+                        Scalar d2TimeMax,
+                        size_t seedSize,
+                        Index sensorId,
+                        const SensorEvent& sensorEvent,
+                        CandidateTree& seeds,
+                        CandidateTree& candidates,
+                        std::vector<std::pair<Scalar, Index>>& sorted,
+                        std::vector<Track::TrackCluster>& clusters,
+                        std::vector<bool>& usedClusters)
+{
+  if (seeds.size() == 0) {
+    return;
+  }
+
+  // sort free clusters by their first local coordinate
+  sorted.clear();
+  Scalar varLoc0Max = 0;
+  for (Index icluster = 0; icluster < sensorEvent.numClusters(); ++icluster) {
+    const auto& cluster = sensorEvent.getCluster(icluster);
+    if (cluster.isInTrack()) {
+      continue;
+    }
+    sorted.emplace_back(cluster.position()[kU], icluster);
+    varLoc0Max = std::max(varLoc0Max, cluster.positionCov()(kU, kU));
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  size_t numSeeds = seeds.size();
+  size_t numCompleted = 0;
+  for (size_t iseed = 0; iseed < numSeeds; ++iseed) {
+    const CandidateTree::Candidate original = seeds[iseed];
+    const TrackState state = seeds.state(iseed);
+    int numMatchedClusters = 0;
+
+    // the spatial compatibility implies a maximum distance along loc0
+    auto first = sorted.begin();
+    auto last = sorted.end();
+    if (0 <= d2LocMax) {
+      Scalar loc0 = state.loc0();
+      Scalar window =
+          std::sqrt(d2LocMax * (state.cov()(kLoc0, kLoc0) + varLoc0Max));
+      auto isBefore = [](const std::pair<Scalar, Index>& entry, Scalar x) {
+        return entry.first < x;
+      };
+      auto isAfter = [](Scalar x, const std::pair<Scalar, Index>& entry) {
+        return x < entry.first;
+      };
+      first = std::lower_bound(first, last, loc0 - window, isBefore);
+      last = std::upper_bound(first, last, loc0 + window, isAfter);
+    }
+
+    for (; first != last; ++first) {
+      Index icluster = first->second;
+      TrackState filtered;
+      Scalar chi2Update;
+      if (not filterCluster(d2LocMax, d2TimeMax,
+                            sensorEvent.getCluster(icluster), state, filtered,
+                            chi2Update)) {
+        continue;
+      }
+      // the first compatible cluster updates the original seed
+      size_t iextended = (numMatchedClusters == 0) ? iseed : seeds.size();
+      seeds.extend(iextended, original, sensorId, icluster, filtered,
+                   chi2Update);
+      numMatchedClusters += 1;
+      // mark cluster as in-use for the seeding.
+      usedClusters[icluster] = true;
+
+      if (seeds[iextended].size == seedSize) {
+        seeds.collectClusters(iextended, clusters);
+        candidates.addSeed(clusters, filtered, seeds[iextended].chi2);
+        numCompleted += 1;
+      }
+    }
+  }
+
+  // remove completed seeds and seeds w/o a cluster on this sensor
+  seeds.removeIf([&](size_t i) {
+    return (seeds[i].size == seedSize) or
+           (seeds.node(seeds[i].leaf).sensor != sensorId);
+  });
+
+  if (0 < numCompleted) {
+    DEBUG("sensor ", sensorId, " completed ", numCompleted, " seeds");
+  }
+}
+
 // remove track candidates that are too short
-static void removeShortCandidates(size_t sizeMin,
-                                  std::vector<Track>& candidates)
+static size_t removeShortCandidates(size_t sizeMin, CandidateTree& candidates)
 {
-  auto isTooShort = [=](const Track& t) { return t.size() < sizeMin; };
-  auto rm = std::remove_if(candidates.begin(), candidates.end(), isTooShort);
-  auto n = std::distance(rm, candidates.end());
-  candidates.erase(rm, candidates.end());
+  auto n = candidates.removeIf(
+      [&](size_t i) { return candidates[i].size < sizeMin; });
 
   if (0 < n) {
     DEBUG("removed ", n, " short candidates");
   }
+  return n;
+}
+
+// remove candidates whose running chi2 is already too large
+static size_t removeDivergingCandidates(Scalar reducedChi2Max,
+                                        CandidateTree& candidates)
+{
+  // negative value disables the cut
+  if (reducedChi2Max < 0) {
+    return 0;
+  }
+  // unlike the final selection, candidates w/o redundant measurements, i.e.
+  // seeds and two-cluster candidates, can not be judged yet and are kept.
+  auto n = candidates.removeIf([&](size_t i) {
+    const auto& c = candidates[i];
+    return (0 < c.dof) and ((c.dof * reducedChi2Max) < c.chi2);
+  });
+
+  if (0 < n) {
+    DEBUG("removed ", n, " diverging candidates");
+  }
+  return n;
+}
+
+// keep only the best candidates for each seed
+//
+// Candidates are grouped by their common seed, i.e. the root of the cluster
+// tree, and ranked using the same order as for the final selection. The
+// relative order of the remaining candidates is unchanged.
+static size_t removeExcessCandidates(size_t candidatesMax,
+                                     CandidateTree& candidates,
+                                     std::vector<size_t>& order,
+                                     std::vector<bool>& isExcess)
+{
+  // zero disables the cut
+  if ((candidatesMax == 0) or (candidates.size() <= candidatesMax)) {
+    return 0;
+  }
+
+  // group candidates by seed and rank them within each group.
+  // see isBetterCandidate for the comparison requirements.
+  auto compare = [&](size_t i, size_t j) {
+    const auto& a = candidates[i];
+    const auto& b = candidates[j];
+    // first group by seed
+    if (a.root != b.root)
+      return (a.root < b.root);
+    // then use the final ranking within each group
+    return isBetterCandidate(a.size, a.chi2, i, b.size, b.chi2, j);
+  };
+  order.resize(candidates.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), compare);
+
+  // mark all candidates beyond the allowed number for each seed
+  isExcess.assign(candidates.size(), false);
+  size_t rank = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (0 < i) {
+      bool sameSeed =
+          (candidates[order[i]].root == candidates[order[i - 1]].root);
+      rank = sameSeed ? (rank + 1) : 0;
+    }
+    isExcess[order[i]] = (candidatesMax <= rank);
+  }
+  auto n = candidates.removeIf([&](size_t i) { return isExcess[i]; });
+
+  if (0 < n) {
+    DEBUG("removed ", n, " excess candidates");
+  }
+  return n;
 }
 
 // remove candidates that do not pass quality cuts
 static void removeBadCandidates(Scalar reducedChi2Max,
-                                std::vector<Track>& candidates)
+                                CandidateTree& candidates)
 {
   // drop bad candidates
-  auto isBad = [=](const Track& t) {
-    // numerical crosschecks
-    if (t.degreesOfFreedom() < 0) {
-      return true;
-    }
-    if (not std::isfinite(t.chi2())) {
-      return true;
-    }
-    // negative value disables the cut
-    // we check (dof * cut < chi2) instead of (cut < chi2/dof) so the case
-    // of 2-hit tracks w/ dof=0 does not lead to numerical issues due to the
-    // division by zero. also means that 2-hit tracks are only accepted if
-    // chi2=0 or the chi2 cut is disabled altogether.
-    if ((0 < reducedChi2Max) and
-        ((t.degreesOfFreedom() * reducedChi2Max) <= t.chi2())) {
-      return true;
-    }
-    return false;
+  auto isBad = [&](size_t i) {
+    const auto& c = candidates[i];
+    return not isGoodCandidate(c.dof, c.chi2, reducedChi2Max);
   };
-  auto rm = std::remove_if(candidates.begin(), candidates.end(), isBad);
-  auto n = std::distance(rm, candidates.end());
-  candidates.erase(rm, candidates.end());
+  auto n = candidates.removeIf(isBad);
 
   if (0 < n) {
     DEBUG("removed ", n, " bad candidates");
@@ -348,52 +737,45 @@ static void removeBadCandidates(Scalar reducedChi2Max,
 }
 
 // sort longest tracks w/ smallest chi2 first
-static void sortCandidates(std::vector<Track>& candidates)
+static void sortCandidates(const CandidateTree& candidates,
+                           std::vector<size_t>& order)
 {
-  // WARNING
-  // compare has to fullfil (from C++ standard)
-  //   1. compare(a, a) == false
-  //   2. compare(a, b) == true -> compare(b, a) == false
-  //   3. compare(a, b) == true && compare(b, c) == true -> compare(a, c) ==
-  //   true
-  // if it does not, std::sort will corrupt the heap.
-  // NOTE to future self:
-  // do not try to be smart or optimize this. you got burnt once already.
-  auto compare = [](const Track& a, const Track& b) {
-    // first sort by length, longest first
-    if (a.size() < b.size())
-      return false;
-    if (b.size() < a.size())
-      return true;
-    // second sort by chi2, smallest first
-    if (a.chi2() < b.chi2())
-      return true;
-    if (b.chi2() < a.chi2())
-      return false;
-    // equivalent objects
-    return false;
+  // see isBetterCandidate for the comparison requirements.
+  auto compare = [&](size_t i, size_t j) {
+    const auto& a = candidates[i];
+    const auto& b = candidates[j];
+    return isBetterCandidate(a.size, a.chi2, i, b.size, b.chi2, j);
   };
-  std::sort(candidates.begin(), candidates.end(), compare);
+  // only the lightweight handles are sorted
+  order.resize(candidates.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), compare);
 }
 
 // add all tracks w/ exclusive cluster-to-track association to the event
-static void addTracksToEvent(const std::vector<Track>& candidates, Event& event)
+static void addTracksToEvent(const CandidateTree& candidates,
+                             const std::vector<size_t>& order,
+                             Event& event)
 {
   size_t numAddedTracks = 0;
 
-  for (const auto& track : candidates) {
+  for (auto icandidate : order) {
     // all clusters of the track must be unused
-    bool hasUsedClusters = std::any_of(
-        track.clusters().begin(), track.clusters().end(), [&](const auto& c) {
-          return event.getSensorEvent(c.sensor)
-              .getCluster(c.cluster)
-              .isInTrack();
-        });
+    bool hasUsedClusters = false;
+    for (Index inode = candidates[icandidate].leaf; inode != kInvalidIndex;
+         inode = candidates.node(inode).parent) {
+      const auto& node = candidates.node(inode);
+      const auto& sensorEvent = event.getSensorEvent(node.sensor);
+      if (sensorEvent.getCluster(node.cluster).isInTrack()) {
+        hasUsedClusters = true;
+        break;
+      }
+    }
     if (hasUsedClusters) {
       continue;
     }
     // add new, good track to the event; also fixes cluster-track association
-    event.addTrack(track);
+    event.addTrack(candidates.makeTrack(icandidate));
     numAddedTracks += 1;
   }
 
@@ -402,9 +784,16 @@ static void addTracksToEvent(const std::vector<Track>& candidates, Event& event)
 
 void TrackFinder::execute(Event& event) const
 {
-  std::vector<Track> candidates;
-  std::vector<bool> usedClusters;
-
+  auto& buffers = m_buffers.local();
+  auto& candidates = buffers.candidates;
+  auto& seeds = buffers.seeds;
+  auto& usedClusters = buffers.usedClusters;
+  auto& order = buffers.order;
+  uint64_t numSearched = 0;
+  uint64_t numPruned = 0;
+
+  candidates.clear();
+  seeds.clear();
   for (size_t istep = 0; istep < m_steps.size(); ++istep) {
     const auto& curr = m_steps[istep];
     auto& sensorEvent = event.getSensorEvent(curr.sensorId);
@@ -413,9 +802,11 @@ void TrackFinder::execute(Event& event) const
     usedClusters.assign(sensorEvent.numClusters(), false);
 
     // propagate states onto the current plane w/ material effects
+    // at the previous plane.
     if (0 < istep) {
       const auto& prev = m_steps[istep - 1];
-      propagateToCurrent(prev.processNoise, prev.plane, curr.plane, candidates);
+      candidates.propagate(curr.fromPrevious, &prev.processNoise);
+      seeds.propagate(curr.fromPrevious, &prev.processNoise);
     }
 
     // search for compatible clusters only on tracking planes.
@@ -423,26 +814,53 @@ void TrackFinder::execute(Event& event) const
     if ((0 < istep) and (curr.useForTracking)) {
       // updates/extends candidates and sets clustersUsed flags
       searchSensor(m_d2LocMax, m_d2TimeMax, curr.sensorId, sensorEvent,
-                   candidates, usedClusters);
+                   candidates, buffers.blocks, usedClusters);
+      numSearched += candidates.size();
       // ignore candidates that can never fullfill the final size cut
-      removeShortCandidates(curr.candidateSizeMin, candidates);
+      numPruned += removeShortCandidates(curr.candidateSizeMin, candidates);
+      // bound the combinatorics already during the search
+      numPruned +=
+          removeDivergingCandidates(m_searchReducedChi2Max, candidates);
+      numPruned += removeExcessCandidates(m_searchCandidatesMax, candidates,
+                                          order, buffers.isExcess);
+      // complete seeds after the search so they are not extended twice
+      extendSeeds(m_d2LocMax, m_d2TimeMax, m_seedSize, curr.sensorId,
+                  sensorEvent, seeds, candidates, buffers.sortedClusters,
+                  buffers.seedClusters, usedClusters);
     }
 
     // generate track candidates from unused clusters on seeding planes
     // this has to happen last so clusters are picked up first by existing
     // candidates generated on earlier seeding planes.
+    // multi-cluster seeds start as incomplete seeds and are only added to
+    // the candidates once they are completed on the following sensors.
     if (curr.useForSeeding) {
       makeSeedsFromUnusedClusters(curr.sensorId, sensorEvent, curr.seedSlope,
-                                  curr.seedSlopeCovariance, candidates,
+                                  curr.seedSlopeCovariance,
+                                  (1 < m_seedSize) ? seeds : candidates,
                                   usedClusters);
     }
   }
 
   // final track selection and transformations
   removeBadCandidates(m_reducedChi2Max, candidates);
-  sortCandidates(candidates);
-  propagateToGlobal(m_steps.back().plane, candidates);
-  addTracksToEvent(candidates, event);
+  sortCandidates(candidates, order);
+  // no additional uncertainty since we want the equivalent global state
+  candidates.propagate(m_toGlobal, nullptr);
+  addTracksToEvent(candidates, order, event);
+
+  m_numCandidatesSearched.fill(numSearched);
+  m_numCandidatesPruned.fill(numPruned);
+  m_numCandidatesFinal.fill(candidates.size());
+}
+
+void TrackFinder::finalize()
+{
+  // summed over all search steps
+  INFO("track finder candidates:");
+  INFO("  before pruning/event: ", m_numCandidatesSearched);
+  INFO("  removed by pruning/event: ", m_numCandidatesPruned);
+  INFO("  final/event: ", m_numCandidatesFinal);
 }
 
 } // namespace proteus
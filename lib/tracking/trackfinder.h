@@ -7,7 +7,10 @@
 
 #include "loop/processor.h"
 #include "mechanics/geometry.h"
+#include "tracking/propagation.h"
 #include "utils/definitions.h"
+#include "utils/scratch.h"
+#include "utils/statistics.h"
 
 namespace proteus {
 
@@ -25,6 +28,22 @@ class Track;
  * form a track. Successive candidates that contain clusters that are already
  * used are dropped.
  *
+ * To limit the combinatorics in busy events, candidates can optionally be
+ * pruned after each search step: candidates whose running chi2/d.o.f exceeds
+ * a search cut are dropped and only the best candidates originating from the
+ * same seed cluster are kept, using the same ranking as for the final
+ * ambiguity resolution.
+ *
+ * By default, track candidates are seeded from single clusters using the beam
+ * slope and divergence as initial direction. Optionally, seeds can be built
+ * from compatible clusters on multiple consecutive tracking sensors, e.g.
+ * doublets or triplets. Only completed seeds with a combined state are used
+ * as candidates, which reduces the number of poorly constrained candidates
+ * for large beam divergences.
+ *
+ * The search for compatible clusters is distributed over the global thread
+ * pool. The resulting tracks are independent of the number of threads.
+ *
  * The ``Tracks``s build by the track finder store the constituent clusters
  * and an estimate of the global track parameters. Local track states are
  * not estimated and must be computed using one of the fitter processors.
@@ -37,22 +56,35 @@ public:
    * \param searchTemporalSigmaMax Temporal search cut, negative to disable
    * \param sizeMin                Selection cut on number of clusters
    * \param redChi2Max             Cut on track chi2/d.o.f, negative to disable
+   * \param searchCandidatesMax    Candidates kept per seed after each step,
+   *                               zero or negative to disable
+   * \param searchRedChi2Max       Running cut on candidate chi2/d.o.f after
+   *                               each step, negative to disable
+   * \param seedSize               Number of clusters on consecutive tracking
+   *                               sensors required to form a seed
    */
   TrackFinder(const Device& device,
               std::vector<Index> trackingIds,
               double searchSpatialSigmaMax,
               double searchTemporalSigmaMax,
               size_t sizeMin,
-              double redChi2Max);
+              double redChi2Max,
+              int searchCandidatesMax = -1,
+              double searchRedChi2Max = -1,
+              size_t seedSize = 1);
 
   std::string name() const;
   /** Find tracks and add them to the event. */
   void execute(Event& event) const;
+  /** Print summary statistics of the candidate search. */
+  void finalize();
 
 private:
   struct Step {
     // Copy of the local-global transformation to avoid lookup
     Plane plane;
+    // Precomputed propagation from the previous step
+    Propagator fromPrevious;
     // Propagation uncertainty, e.g. from scattering
     SymMatrix6 processNoise = SymMatrix6::Zero();
     // Corresponding sensor
@@ -67,10 +99,24 @@ private:
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   };
+  // Temporary storage that is reused between events
+  struct Buffers;
+
   std::vector<Step> m_steps;
+  // Precomputed propagation from the last step into the global system
+  Propagator m_toGlobal;
   double m_d2LocMax;
   double m_d2TimeMax;
   double m_reducedChi2Max;
+  size_t m_searchCandidatesMax;
+  double m_searchReducedChi2Max;
+  size_t m_seedSize;
+  // Candidate statistics are pure bookkeeping and do not affect the results.
+  // They are mutable so they can be updated from the const execute method.
+  mutable StatAccumulator<uint64_t> m_numCandidatesSearched;
+  mutable StatAccumulator<uint64_t> m_numCandidatesPruned;
+  mutable StatAccumulator<uint64_t> m_numCandidatesFinal;
+  mutable Scratch<Buffers> m_buffers;
 };
 
 } // namespace proteus
@@ -15,6 +15,8 @@
 #include "mechanics/device.h"
 #include "utils/arguments.h"
 #include "utils/logger.h"
+#include "utils/root.h"
+#include "utils/threadpool.h"
 
 namespace proteus {
 
@@ -39,6 +41,8 @@ void Application::initialize(int argc, char const* argv[])
   args.addOption('u', "subsection", "use the given configuration sub-section");
   args.addOption('s', "skip_events", "skip the first n events", 0);
   args.addOption('n', "num_events", "number of events to process", UINT64_MAX);
+  args.addOption('j', "threads", "number of threads for parallel processing",
+                 1);
   args.addFlag('q', "quiet", "print only errors");
   args.addFlag('v', "verbose", "print more information");
   args.addFlag('\0', "print-events", "print full event information");
@@ -66,6 +70,11 @@ void Application::initialize(int argc, char const* argv[])
   if (!args.has("no-progress")) {
     m_showProgress = true;
   }
+  // threads used by processors that support parallel execution
+  auto numThreads = args.get<int>("threads");
+  if (numThreads < 1)
+    FAIL("number of threads must be at least one");
+  globalThreadPool().setNumThreads(numThreads);
 
   // select configuration (sub-)section
   std::string section = m_name;
@@ -106,12 +115,22 @@ std::string Application::outputPath(const std::string& name) const
   return m_outputPrefix + '-' + name;
 }
 
+RootWriteOptions Application::writeOptions() const
+{
+  // optional writer settings, e.g. to select a faster compression
+  const toml::Value* cfgWriter = m_cfg.find("writer");
+  return RootWriteOptions::fromConfig(cfgWriter ? *cfgWriter : toml::Value());
+}
+
 EventLoop Application::makeEventLoop() const
 {
   // NOTE open the file just when the event loop is created to ensure that the
   //      input reader always starts at the beginning of the file.
-  EventLoop loop(openRead(m_inputPath, toml::Value()), m_dev->numSensors(),
-                 m_skipEvents, m_numEvents, m_showProgress);
+  // optional reader settings, e.g. to tune the input caching
+  const toml::Value* cfgReader = m_cfg.find("reader");
+  EventLoop loop(openRead(m_inputPath, cfgReader ? *cfgReader : toml::Value()),
+                 m_dev->numSensors(), m_skipEvents, m_numEvents,
+                 m_showProgress);
   // full-event output in debug mode
   if (m_printEvents) {
     loop.addAnalyzer(std::make_shared<EventPrinter>());
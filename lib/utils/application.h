@@ -18,6 +18,7 @@
 namespace proteus {
 
 class Device;
+struct RootWriteOptions;
 
 /** Common application class.
  *
@@ -44,6 +45,8 @@ public:
   const toml::Value& config() const { return m_cfg; }
   /** Generate the output path for the given file name. */
   std::string outputPath(const std::string& name) const;
+  /** Output settings for event data files from the `writer` configuration. */
+  RootWriteOptions writeOptions() const;
 
   /** Construct an event loop configured w/ input data from this application.
    *
@@ -16,6 +16,8 @@
 #include <Eigen/Geometry>
 #include <Eigen/LU>
 
+#include "utils/symmetric.h"
+
 namespace proteus {
 
 // Use to number and identify things, e.g. hits, sensors
@@ -126,8 +128,8 @@ template <typename T, typename U>
 inline auto mahalanobisSquared(const Eigen::MatrixBase<T>& cov,
                                const Eigen::MatrixBase<U>& x)
 {
-  // compute `x^T C^-1 x` via `x^T y` where `y` is the solution to `C y = x`
-  return x.dot(cov.template selfadjointView<Eigen::Lower>().ldlt().solve(x));
+  // closed-form for small fixed sizes, decomposition otherwise
+  return symmetricMahalanobisSquared(cov, x);
 }
 
 /** Mahalanobis distance / norm of a vector. */
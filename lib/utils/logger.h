@@ -112,9 +112,10 @@ public:
     }
   }
 
-private:
   /** Check whether messages at the give loggging level are active. */
   bool isActive(Level level) const { return (level <= m_level); }
+
+private:
   std::ostream& stream(Level level) const
   {
     return *(m_streams[static_cast<int>(level)]);
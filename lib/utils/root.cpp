@@ -12,8 +12,12 @@
 #include <stdexcept>
 
 #include <Compression.h>
+#include <RVersion.h>
 #include <TF1.h>
+#include <TROOT.h>
+#include <TTree.h>
 
+#include "utils/config.h"
 #include "utils/logger.h"
 
 namespace proteus {
@@ -67,9 +71,81 @@ RootFilePtr openRootRead(const std::string& path)
 
 RootFilePtr openRootWrite(const std::string& path)
 {
-  // always use better, non-standard compression
+  // defaults to the better, non-standard LZMA compression
+  return openRootWrite(path, RootWriteOptions());
+}
+
+RootWriteOptions RootWriteOptions::fromConfig(const toml::Value& cfg)
+{
+  RootWriteOptions defaults;
+  toml::Value combined = toml::Table{
+      {"compression", defaults.compression},
+      {"compression_level", defaults.compressionLevel},
+      {"basket_size", defaults.basketSize},
+      {"auto_flush", defaults.autoFlush},
+      {"auto_save", defaults.autoSave},
+      {"implicit_mt", defaults.implicitMT},
+  };
+  // configuration is optional
+  if (cfg.is<toml::Table>())
+    combined = configWithDefaults(cfg, combined);
+
+  RootWriteOptions options;
+  options.compression = combined.get<std::string>("compression");
+  options.compressionLevel = combined.get<int>("compression_level");
+  options.basketSize = combined.get<int>("basket_size");
+  options.autoFlush = combined.get<int64_t>("auto_flush");
+  options.autoSave = combined.get<int64_t>("auto_save");
+  options.implicitMT = combined.get<int>("implicit_mt");
+  // fail early for unsupported settings
+  options.compressionSettings();
+  return options;
+}
+
+int RootWriteOptions::compressionSettings() const
+{
+  // algorithm and default level that trades speed for size
+  ROOT::ECompressionAlgorithm algorithm;
+  int level;
+  if (compression == "lzma") {
+    algorithm = ROOT::kLZMA;
+    level = 1;
+  } else if (compression == "lz4") {
+    algorithm = ROOT::kLZ4;
+    level = 4;
+  } else if (compression == "zlib") {
+    algorithm = ROOT::kZLIB;
+    level = 1;
+  } else if (compression == "zstd") {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 20, 0)
+    algorithm = ROOT::kZSTD;
+    level = 5;
+#else
+    throw std::runtime_error("ZSTD compression requires ROOT 6.20 or newer");
+#endif
+  } else if (compression == "none") {
+    return 0;
+  } else {
+    throw std::runtime_error("Unknown ROOT compression '" + compression +
+                             "'");
+  }
+  if (0 <= compressionLevel) {
+    level = compressionLevel;
+  }
+  return ROOT::CompressionSettings(algorithm, level);
+}
+
+RootFilePtr openRootWrite(const std::string& path,
+                          const RootWriteOptions& options)
+{
+  // implicit multi-threading is global and can only be enabled once
+  if ((0 < options.implicitMT) && !ROOT::IsImplicitMTEnabled()) {
+    ROOT::EnableImplicitMT(options.implicitMT);
+    INFO("enabled ROOT implicit multi-threading w/ ", options.implicitMT,
+         " threads");
+  }
   RootFilePtr f(TFile::Open(path.c_str(), "RECREATE", "",
-                            ROOT::CompressionSettings(ROOT::kLZMA, 1)),
+                            options.compressionSettings()),
                 &closeTFileWrite);
   if (!f) {
     throw std::runtime_error("Could not open '" + path + "' to write");
@@ -80,6 +156,15 @@ RootFilePtr openRootWrite(const std::string& path)
   return f;
 }
 
+void setupTreeWrite(TTree* tree, const RootWriteOptions& options)
+{
+  assert(tree && "Tree must be non-NULL");
+
+  tree->SetBasketSize("*", options.basketSize);
+  tree->SetAutoFlush(options.autoFlush);
+  tree->SetAutoSave(options.autoSave);
+}
+
 TDirectory* makeDir(TDirectory* parent, const std::string& path)
 {
   assert(parent && "Parent directory must be non-NULL");
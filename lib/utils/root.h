@@ -8,6 +8,7 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -16,6 +17,10 @@
 #include <TH1.h>
 #include <TH2.h>
 
+class TTree;
+namespace toml {
+class Value;
+}
 namespace proteus {
 
 using RootFilePtr = std::unique_ptr<TFile, void (*)(TFile*)>;
@@ -37,6 +42,52 @@ RootFilePtr openRootRead(const std::string& path);
  */
 RootFilePtr openRootWrite(const std::string& path);
 
+/** Output settings for ROOT files that store event data in trees.
+ *
+ * The defaults correspond to the previous fixed settings, i.e. LZMA level 1
+ * compression and the ROOT default basket, auto-flush, and auto-save sizes.
+ * LZ4 is the fast option for intermediate files that are read again right
+ * away; ZSTD or LZMA are better suited for archival.
+ */
+struct RootWriteOptions {
+  /** Compression algorithm; one of `lzma`, `zstd`, `lz4`, `zlib`, `none`. */
+  std::string compression = "lzma";
+  /** Compression level; negative to use the algorithm-specific default. */
+  int compressionLevel = -1;
+  /** Initial basket buffer size in bytes for each branch. */
+  int basketSize = 32000;
+  /** Flush baskets every n entries if positive or every -n bytes. */
+  int64_t autoFlush = -30000000;
+  /** Save the tree header every n entries if positive or every -n bytes. */
+  int64_t autoSave = -300000000;
+  /** Number of threads for ROOT implicit multi-threading; zero disables it. */
+  int implicitMT = 0;
+
+  /** Construct from an optional configuration w/ defaults for missing keys.
+   *
+   * \exception std::runtime_error When the compression is not supported.
+   */
+  static RootWriteOptions fromConfig(const toml::Value& cfg);
+  /** Combined ROOT compression settings of algorithm and level.
+   *
+   * \exception std::runtime_error When the compression is not supported.
+   */
+  int compressionSettings() const;
+};
+
+/** Open a ROOT file in write mode w/ non-default output settings.
+ *
+ * \exception std::runtime_error When the file can not be opened.
+ *
+ * Enables ROOT implicit multi-threading if requested. The tree settings must
+ * be applied separately via `setupTreeWrite` after all branches are created.
+ */
+RootFilePtr openRootWrite(const std::string& path,
+                          const RootWriteOptions& options);
+
+/** Apply the basket and flush settings to a tree w/ all branches created. */
+void setupTreeWrite(TTree* tree, const RootWriteOptions& options);
+
 /** Create a directory relative to the parent or return an existing one. */
 TDirectory* makeDir(TDirectory* parent, const std::string& path);
 
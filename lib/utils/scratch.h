@@ -0,0 +1,64 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "utils/threadpool.h"
+
+namespace proteus {
+
+/** Reusable temporary storage w/ a separate instance for each thread.
+ *
+ * Processors are executed via a const interface and their configuration can
+ * be shared between threads. Temporary buffers that should be reused between
+ * events to avoid repeated allocations are kept in a `Scratch` member
+ * instead. Each thread of the global thread pool gets its own instance that
+ * is created on first use. The instances must not carry information between
+ * events. The member must be declared `mutable` so it can be used from the
+ * const `execute` method.
+ *
+ * The stored type only needs to be complete where the instances are created,
+ * i.e. where `local()` is used, and can be defined in the implementation
+ * file.
+ */
+template <typename T>
+class Scratch {
+public:
+  /** New instances are default-constructed. */
+  Scratch() : m_make([] { return std::make_shared<T>(); }) {}
+  /** New instances are created by the given function. */
+  explicit Scratch(std::function<std::shared_ptr<T>()> make)
+      : m_make(std::move(make))
+  {
+  }
+
+  /** Access the instance for the current thread. */
+  T& local();
+
+private:
+  std::function<std::shared_ptr<T>()> m_make;
+  std::mutex m_mutex;
+  // shared pointers do not require a complete type for the destruction
+  std::vector<std::shared_ptr<T>> m_instances;
+};
+
+template <typename T>
+inline T& Scratch<T>::local()
+{
+  size_t ithread = ThreadPool::currentThread();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_instances.size() <= ithread) {
+    m_instances.resize(ithread + 1);
+  }
+  if (not m_instances[ithread]) {
+    m_instances[ithread] = m_make();
+  }
+  return *m_instances[ithread];
+}
+
+} // namespace proteus
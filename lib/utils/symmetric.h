@@ -0,0 +1,259 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+/**
+ * \file
+ * \brief Closed-form kernels for small symmetric matrices
+ *
+ * Determinant, inverse, and squared Mahalanobis distance for symmetric
+ * matrices w/ a fixed size of up to four are computed explicitly w/o a
+ * matrix decomposition. Only the lower-left triangular values are used.
+ * All other sizes fall back to the generic Eigen decompositions.
+ */
+
+#pragma once
+
+#include <Eigen/Cholesky>
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+namespace proteus {
+namespace detail {
+
+// Generic implementation based on the Eigen decompositions
+template <typename T, int kSize>
+struct SymmetricKernel {
+  template <typename C>
+  static T determinant(const C& c)
+  {
+    return c.template selfadjointView<Eigen::Lower>().toDenseMatrix()
+        .determinant();
+  }
+  template <typename C, typename I>
+  static void inverse(const C& c, I& inv)
+  {
+    inv = c.template selfadjointView<Eigen::Lower>().ldlt().solve(
+        Eigen::Matrix<T, kSize, kSize>::Identity(c.rows(), c.cols()));
+  }
+  template <typename C, typename X>
+  static T mahalanobisSquared(const C& c, const X& x)
+  {
+    // compute `x^T C^-1 x` via `x^T y` where `y` is the solution to `C y = x`
+    return x.dot(c.template selfadjointView<Eigen::Lower>().ldlt().solve(x));
+  }
+};
+
+template <typename T>
+struct SymmetricKernel<T, 1> {
+  template <typename C>
+  static T determinant(const C& c)
+  {
+    return c(0, 0);
+  }
+  template <typename C, typename I>
+  static void inverse(const C& c, I& inv)
+  {
+    inv(0, 0) = 1 / c(0, 0);
+  }
+  template <typename C, typename X>
+  static T mahalanobisSquared(const C& c, const X& x)
+  {
+    return x[0] * x[0] / c(0, 0);
+  }
+};
+
+template <typename T>
+struct SymmetricKernel<T, 2> {
+  template <typename C>
+  static T determinant(const C& c)
+  {
+    return c(0, 0) * c(1, 1) - c(1, 0) * c(1, 0);
+  }
+  template <typename C, typename I>
+  static void inverse(const C& c, I& inv)
+  {
+    T scale = 1 / determinant(c);
+    inv(0, 0) = scale * c(1, 1);
+    inv(1, 1) = scale * c(0, 0);
+    inv(1, 0) = inv(0, 1) = -scale * c(1, 0);
+  }
+  template <typename C, typename X>
+  static T mahalanobisSquared(const C& c, const X& x)
+  {
+    return (c(1, 1) * x[0] * x[0] - 2 * c(1, 0) * x[0] * x[1] +
+            c(0, 0) * x[1] * x[1]) /
+           determinant(c);
+  }
+};
+
+template <typename T>
+struct SymmetricKernel<T, 3> {
+  // lower-triangular cofactors; equal to the adjugate for symmetric input
+  template <typename C>
+  static Eigen::Matrix<T, 3, 3> cofactors(const C& c)
+  {
+    Eigen::Matrix<T, 3, 3> cof;
+    cof(0, 0) = c(1, 1) * c(2, 2) - c(2, 1) * c(2, 1);
+    cof(1, 0) = c(2, 0) * c(2, 1) - c(1, 0) * c(2, 2);
+    cof(1, 1) = c(0, 0) * c(2, 2) - c(2, 0) * c(2, 0);
+    cof(2, 0) = c(1, 0) * c(2, 1) - c(1, 1) * c(2, 0);
+    cof(2, 1) = c(1, 0) * c(2, 0) - c(0, 0) * c(2, 1);
+    cof(2, 2) = c(0, 0) * c(1, 1) - c(1, 0) * c(1, 0);
+    return cof;
+  }
+  template <typename C, typename M>
+  static T determinant(const C& c, const M& cof)
+  {
+    return c(0, 0) * cof(0, 0) + c(1, 0) * cof(1, 0) + c(2, 0) * cof(2, 0);
+  }
+  template <typename C>
+  static T determinant(const C& c)
+  {
+    return determinant(c, cofactors(c));
+  }
+  template <typename C, typename I>
+  static void inverse(const C& c, I& inv)
+  {
+    auto cof = cofactors(c);
+    T scale = 1 / determinant(c, cof);
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j <= i; ++j) {
+        inv(i, j) = inv(j, i) = scale * cof(i, j);
+      }
+    }
+  }
+  template <typename C, typename X>
+  static T mahalanobisSquared(const C& c, const X& x)
+  {
+    auto cof = cofactors(c);
+    T sum = cof(0, 0) * x[0] * x[0] + cof(1, 1) * x[1] * x[1] +
+            cof(2, 2) * x[2] * x[2] +
+            2 * (cof(1, 0) * x[0] * x[1] + cof(2, 0) * x[0] * x[2] +
+                 cof(2, 1) * x[1] * x[2]);
+    return sum / determinant(c, cof);
+  }
+};
+
+// Blockwise w/ the Schur complement of the upper-left 2x2 block
+template <typename T>
+struct SymmetricKernel<T, 4> {
+  using Kernel2 = SymmetricKernel<T, 2>;
+  using Matrix2 = Eigen::Matrix<T, 2, 2>;
+
+  template <typename C>
+  static Matrix2 schurComplement(const C& c, Matrix2& invUpper)
+  {
+    Kernel2::inverse(c.template topLeftCorner<2, 2>(), invUpper);
+    auto lower = c.template bottomLeftCorner<2, 2>();
+    Matrix2 schur = c.template bottomRightCorner<2, 2>();
+    schur -= lower * invUpper * lower.transpose();
+    return schur;
+  }
+  template <typename C>
+  static T determinant(const C& c)
+  {
+    Matrix2 invUpper;
+    Matrix2 schur = schurComplement(c, invUpper);
+    return Kernel2::determinant(c.template topLeftCorner<2, 2>()) *
+           Kernel2::determinant(schur);
+  }
+  template <typename C, typename I>
+  static void inverse(const C& c, I& inv)
+  {
+    Matrix2 invUpper;
+    Matrix2 invSchur;
+    Kernel2::inverse(schurComplement(c, invUpper), invSchur);
+    Matrix2 offDiagonal =
+        -invSchur * c.template bottomLeftCorner<2, 2>() * invUpper;
+    inv.template topLeftCorner<2, 2>() =
+        invUpper - invUpper * c.template bottomLeftCorner<2, 2>()
+                                  .transpose() *
+                       offDiagonal;
+    inv.template bottomLeftCorner<2, 2>() = offDiagonal;
+    inv.template topRightCorner<2, 2>() = offDiagonal.transpose();
+    inv.template bottomRightCorner<2, 2>() = invSchur;
+  }
+  template <typename C, typename X>
+  static T mahalanobisSquared(const C& c, const X& x)
+  {
+    Matrix2 invUpper;
+    Matrix2 schur = schurComplement(c, invUpper);
+    // residual of the lower block after removing the upper block
+    Eigen::Matrix<T, 2, 1> upper = x.template head<2>();
+    Eigen::Matrix<T, 2, 1> lower =
+        x.template tail<2>() -
+        c.template bottomLeftCorner<2, 2>() * (invUpper * upper);
+    return upper.dot(invUpper * upper) +
+           Kernel2::mahalanobisSquared(schur, lower);
+  }
+};
+
+template <typename Derived>
+using SymmetricKernelFor = SymmetricKernel<typename Derived::Scalar,
+                                           Derived::RowsAtCompileTime>;
+
+} // namespace detail
+
+/** Determinant of a symmetric matrix.
+ *
+ * \param cov Symmetric matrix; only the lower-left triangular values are used.
+ */
+template <typename T>
+inline auto symmetricDeterminant(const Eigen::MatrixBase<T>& cov)
+{
+  return detail::SymmetricKernelFor<T>::determinant(cov.derived());
+}
+
+/** Inverse of a symmetric, positive-definite matrix.
+ *
+ * \param cov Symmetric matrix; only the lower-left triangular values are used.
+ */
+template <typename T>
+inline auto symmetricInverse(const Eigen::MatrixBase<T>& cov)
+{
+  Eigen::Matrix<typename T::Scalar, T::RowsAtCompileTime,
+                T::ColsAtCompileTime>
+      inv(cov.rows(), cov.cols());
+  detail::SymmetricKernelFor<T>::inverse(cov.derived(), inv);
+  return inv;
+}
+
+/** Squared Mahalanobis distance w/ a symmetric, positive-definite matrix.
+ *
+ * \param cov Covariance matrix; only the lower-left triangular values are used.
+ * \param x   Value vector;
+ */
+template <typename T, typename U>
+inline auto symmetricMahalanobisSquared(const Eigen::MatrixBase<T>& cov,
+                                        const Eigen::MatrixBase<U>& x)
+{
+  return detail::SymmetricKernelFor<T>::mahalanobisSquared(cov.derived(),
+                                                           x.derived());
+}
+
+/** Squared Mahalanobis distances for arrays of two-dimensional pairs.
+ *
+ * \param c00 Array of first diagonal covariance entries
+ * \param c10 Array of off-diagonal covariance entries
+ * \param c11 Array of second diagonal covariance entries
+ * \param x0  Array of first vector components
+ * \param x1  Array of second vector components
+ *
+ * All arrays must have the same size. The result is an Eigen expression that
+ * is evaluated element-wise and vectorized on assignment.
+ */
+template <typename C00,
+          typename C10,
+          typename C11,
+          typename X0,
+          typename X1>
+inline auto mahalanobisSquaredBatch2(const Eigen::ArrayBase<C00>& c00,
+                                     const Eigen::ArrayBase<C10>& c10,
+                                     const Eigen::ArrayBase<C11>& c11,
+                                     const Eigen::ArrayBase<X0>& x0,
+                                     const Eigen::ArrayBase<X1>& x1)
+{
+  return (c11 * x0.square() - 2 * c10 * x0 * x1 + c00 * x1.square()) /
+         (c00 * c11 - c10.square());
+}
+
+} // namespace proteus
@@ -0,0 +1,143 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#include "threadpool.h"
+
+#include <algorithm>
+
+namespace proteus {
+
+// state of the current thread to detect calls from within a running task
+static thread_local bool t_isInTask = false;
+static thread_local size_t t_threadIndex = 0;
+
+ThreadPool::ThreadPool(size_t numThreads)
+{
+  startWorkers(std::max<size_t>(numThreads, 1) - 1);
+}
+
+ThreadPool::~ThreadPool() { stopWorkers(); }
+
+size_t ThreadPool::currentThread() { return t_threadIndex; }
+
+void ThreadPool::setNumThreads(size_t numThreads)
+{
+  numThreads = std::max<size_t>(numThreads, 1);
+  if (numThreads != this->numThreads()) {
+    stopWorkers();
+    startWorkers(numThreads - 1);
+  }
+}
+
+void ThreadPool::startWorkers(size_t numWorkers)
+{
+  for (size_t iworker = 0; iworker < numWorkers; ++iworker) {
+    // the calling thread has index zero. the current generation must be
+    // passed explicitly since work could be submitted before the thread runs
+    m_workers.emplace_back(&ThreadPool::work, this, iworker + 1,
+                           m_generation);
+  }
+}
+
+void ThreadPool::stopWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wakeWorkers.notify_all();
+  for (auto& worker : m_workers) {
+    worker.join();
+  }
+  m_workers.clear();
+  m_stop = false;
+}
+
+void ThreadPool::run(size_t n, const Task& task)
+{
+  // nested calls would wait for workers that are busy with the outer call
+  if (t_isInTask or m_workers.empty() or (n < 2)) {
+    for (size_t i = 0; i < n; ++i) {
+      task(t_threadIndex, i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_task = &task;
+    m_numTasks = n;
+    m_nextTask = 0;
+    m_numBusy = m_workers.size();
+    m_exception = nullptr;
+    m_generation += 1;
+  }
+  m_wakeWorkers.notify_all();
+  runTasks(0);
+
+  std::exception_ptr exception;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_wakeCaller.wait(lock, [&] { return m_numBusy == 0; });
+    m_task = nullptr;
+    std::swap(exception, m_exception);
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+void ThreadPool::work(size_t ithread, uint64_t generation)
+{
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wakeWorkers.wait(
+          lock, [&] { return m_stop or (m_generation != generation); });
+      if (m_stop) {
+        return;
+      }
+      generation = m_generation;
+    }
+    runTasks(ithread);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_numBusy -= 1;
+      if (m_numBusy == 0) {
+        m_wakeCaller.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::runTasks(size_t ithread)
+{
+  t_isInTask = true;
+  t_threadIndex = ithread;
+  while (true) {
+    size_t i = m_nextTask.fetch_add(1);
+    if (m_numTasks <= i) {
+      break;
+    }
+    try {
+      (*m_task)(ithread, i);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (not m_exception) {
+        m_exception = std::current_exception();
+      }
+      // skip all remaining tasks
+      m_nextTask = m_numTasks;
+    }
+  }
+  t_isInTask = false;
+  t_threadIndex = 0;
+}
+
+ThreadPool& globalThreadPool()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+} // namespace proteus
@@ -0,0 +1,85 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace proteus {
+
+/** A fixed set of worker threads to run independent tasks in parallel.
+ *
+ * The calling thread always participates in the work. Without additional
+ * worker threads all tasks are executed serially on the calling thread.
+ * Each task gets the index of the executing thread so that it can use
+ * preallocated per-thread buffers without locking. Calls from within a
+ * running task are executed serially on the current thread.
+ */
+class ThreadPool {
+public:
+  /** Construct a pool w/ the given total number of threads. */
+  ThreadPool(size_t numThreads = 1);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  /** Index of the current thread within the running tasks.
+   *
+   * This is zero for the calling thread and outside of tasks.
+   */
+  static size_t currentThread();
+  /** Total number of threads including the calling thread. */
+  size_t numThreads() const { return m_workers.size() + 1; }
+  /** Change the total number of threads; must not be called while busy. */
+  void setNumThreads(size_t numThreads);
+
+  /** Call `func(ithread, i)` for all `i` in `[0, n)` and wait for all.
+   *
+   * The order of the calls is undefined. The thread index is in
+   * `[0, numThreads())`. The first exception thrown by a task is rethrown
+   * on the calling thread after all tasks have finished.
+   */
+  template <typename Function>
+  void parallelFor(size_t n, Function&& func);
+
+private:
+  using Task = std::function<void(size_t, size_t)>;
+
+  void run(size_t n, const Task& task);
+  void work(size_t ithread, uint64_t generation);
+  void runTasks(size_t ithread);
+  void startWorkers(size_t numWorkers);
+  void stopWorkers();
+
+  std::vector<std::thread> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_wakeWorkers;
+  std::condition_variable m_wakeCaller;
+  // current job; only modified by the calling thread while holding the lock
+  const Task* m_task = nullptr;
+  size_t m_numTasks = 0;
+  std::atomic<size_t> m_nextTask{0};
+  uint64_t m_generation = 0;
+  size_t m_numBusy = 0;
+  std::exception_ptr m_exception;
+  bool m_stop = false;
+};
+
+/** Return the global thread pool. */
+ThreadPool& globalThreadPool();
+
+template <typename Function>
+inline void ThreadPool::parallelFor(size_t n, Function&& func)
+{
+  run(n, Task(std::forward<Function>(func)));
+}
+
+} // namespace proteus
@@ -0,0 +1,196 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+/**
+ * \file
+ * \brief Benchmark and cross-check the batched straight line fitters
+ *
+ * Fits the same set of simulated tracks w/ the batched line fitters and w/
+ * the scalar line fitter one track at a time and compares the throughput
+ * and the fit results.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Eigen/StdVector>
+
+#include "benchmark.h"
+#include "tracking/linefitter.h"
+
+using namespace proteus;
+
+template <typename T>
+using AlignedVector = std::vector<T, Eigen::aligned_allocator<T>>;
+
+// tolerances for the different summation order
+constexpr double kRelTol = 1e-9;
+constexpr double kAbsTol = 1e-9;
+// telescope-like layout w/ one point per sensor
+constexpr int kNumSensors = 6;
+constexpr double kSensorPitch = 25.0;
+// fraction of tracks w/o a point on a given sensor
+constexpr double kInefficiency = 0.1;
+// tracks per batch as used in the straight track fitters
+constexpr Eigen::Index kBlockSize = 64;
+
+/** Simulated points in structure-of-arrays layout w/ one row per track. */
+struct Points {
+  using Positions = Matrix<double, Eigen::Dynamic, 4>;
+  using Column = Eigen::Array<double, Eigen::Dynamic, 1>;
+
+  std::vector<Positions> positions;
+  std::vector<Positions> weights;
+  std::vector<Column> masks;
+
+  Points(Eigen::Index numTracks, std::mt19937_64& rng)
+  {
+    std::normal_distribution<double> normal(0, 1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    // stddev for each coordinate; the independent z coordinate is exact
+    const Vector4 stddev(0.01, 0.02, 0.0, 1.0);
+    Matrix<double, Eigen::Dynamic, 4> offsets(numTracks, 4);
+    Matrix<double, Eigen::Dynamic, 4> slopes(numTracks, 4);
+    for (Eigen::Index i = 0; i < numTracks; ++i) {
+      offsets.row(i) << 10 * normal(rng), 10 * normal(rng), 0,
+          100 * uniform(rng);
+      slopes.row(i) << 0.001 * normal(rng), 0.001 * normal(rng), 1, 0.1;
+    }
+    for (int isensor = 0; isensor < kNumSensors; ++isensor) {
+      Positions pos(numTracks, 4);
+      Positions wgt(numTracks, 4);
+      Column mask(numTracks);
+      double z = isensor * kSensorPitch;
+      for (Eigen::Index i = 0; i < numTracks; ++i) {
+        for (int d = 0; d < 4; ++d) {
+          pos(i, d) = offsets(i, d) + z * slopes(i, d) +
+                      stddev[d] * (0.5 + uniform(rng)) * normal(rng);
+          wgt(i, d) = (d == kZ) ? 1 : (1 / (stddev[d] * stddev[d]));
+        }
+        // the first and last sensor always have a point so every track has
+        // at least two points and a well-defined fit
+        bool isEdge = (isensor == 0) or (isensor + 1 == kNumSensors);
+        mask[i] = (isEdge or (kInefficiency <= uniform(rng))) ? 1 : 0;
+      }
+      positions.push_back(std::move(pos));
+      weights.push_back(std::move(wgt));
+      masks.push_back(std::move(mask));
+    }
+  }
+};
+
+/** Fit results for all tracks. */
+struct Results {
+  AlignedVector<Vector6> params;
+  AlignedVector<SymMatrix6> covs;
+  std::vector<double> chi2s;
+  std::vector<int> dofs;
+
+  explicit Results(Eigen::Index numTracks)
+      : params(numTracks), covs(numTracks), chi2s(numTracks), dofs(numTracks)
+  {
+  }
+};
+
+// fit all blocks w/ the batched fitter, one batch per block
+template <typename Batch>
+static void fitBatched(const std::vector<Points>& blocks, Results& results)
+{
+  Batch batch;
+  Eigen::Index offset = 0;
+  for (const auto& points : blocks) {
+    Eigen::Index numTracks = points.masks.front().size();
+    batch.reset(numTracks);
+    for (int isensor = 0; isensor < kNumSensors; ++isensor) {
+      batch.addPoints(points.positions[isensor], points.weights[isensor],
+                      points.masks[isensor]);
+    }
+    batch.fit();
+    for (Eigen::Index i = 0; i < numTracks; ++i) {
+      results.params[offset + i] = batch.params(i);
+      results.covs[offset + i] = batch.cov(i);
+      results.chi2s[offset + i] = batch.chi2(i);
+      results.dofs[offset + i] = batch.dof(i);
+    }
+    offset += numTracks;
+  }
+}
+
+// fit all tracks w/ the scalar fitter, one track at a time
+template <typename Single>
+static void fitSingle(const std::vector<Points>& blocks, Results& results)
+{
+  Eigen::Index offset = 0;
+  for (const auto& points : blocks) {
+    Eigen::Index numTracks = points.masks.front().size();
+    for (Eigen::Index i = 0; i < numTracks; ++i) {
+      Single single;
+      for (int isensor = 0; isensor < kNumSensors; ++isensor) {
+        if (points.masks[isensor][i] != 0) {
+          single.addPoint(points.positions[isensor].row(i).transpose(),
+                          points.weights[isensor].row(i).transpose());
+        }
+      }
+      single.fit();
+      results.params[offset + i] = single.params();
+      results.covs[offset + i] = single.cov();
+      results.chi2s[offset + i] = single.chi2();
+      results.dofs[offset + i] = single.dof();
+    }
+    offset += numTracks;
+  }
+}
+
+template <typename Batch>
+static bool benchmarkFitter(const std::string& name,
+                            const std::vector<Points>& blocks,
+                            Eigen::Index numTracks,
+                            int numRepetitions)
+{
+  Results batchResults(numTracks);
+  Results singleResults(numTracks);
+
+  double time = bench::timeMinimum(numRepetitions, [&]() {
+    fitBatched<Batch>(blocks, batchResults);
+  });
+  double timeRef = bench::timeMinimum(numRepetitions, [&]() {
+    fitSingle<typename Batch::Single>(blocks, singleResults);
+  });
+
+  bench::Agreement agreement(kRelTol, kAbsTol);
+  for (Eigen::Index i = 0; i < numTracks; ++i) {
+    agreement.addAll(batchResults.params[i], singleResults.params[i]);
+    agreement.addAll(batchResults.covs[i], singleResults.covs[i]);
+    agreement.add(batchResults.chi2s[i], singleResults.chi2s[i]);
+    agreement.add(batchResults.dofs[i], singleResults.dofs[i]);
+  }
+  return bench::report(name + " batch vs single", "track", numTracks, time,
+                       timeRef, agreement);
+}
+
+int main(int argc, char const* argv[])
+{
+  if (2 < argc) {
+    std::cerr << "usage: pt-bench-linefitter [NUM_TRACKS]\n";
+    return EXIT_FAILURE;
+  }
+  Eigen::Index numTracks = (argc == 2) ? std::stol(argv[1]) : 16384;
+  int numRepetitions = 20;
+
+  // fixed seed for reproducible inputs
+  std::mt19937_64 rng(12345);
+  std::vector<Points> blocks;
+  for (Eigen::Index begin = 0; begin < numTracks; begin += kBlockSize) {
+    blocks.emplace_back(std::min(kBlockSize, numTracks - begin), rng);
+  }
+  bool isGood = true;
+  isGood &= benchmarkFitter<LineFitterBatch3D>("linefitter3d", blocks,
+                                               numTracks, numRepetitions);
+  isGood &= benchmarkFitter<LineFitterBatch4D>("linefitter4d", blocks,
+                                               numTracks, numRepetitions);
+  return isGood ? EXIT_SUCCESS : EXIT_FAILURE;
+}
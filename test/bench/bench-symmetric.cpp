@@ -0,0 +1,194 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+/**
+ * \file
+ * \brief Benchmark and cross-check the closed-form symmetric kernels
+ *
+ * Compares the closed-form determinant, inverse, and squared Mahalanobis
+ * distance for symmetric matrices of size 1 to 4 to the generic Eigen
+ * implementations and reports the relative throughput.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Eigen/StdVector>
+
+#include "benchmark.h"
+#include "utils/symmetric.h"
+
+using namespace proteus;
+
+template <typename T>
+using AlignedVector = std::vector<T, Eigen::aligned_allocator<T>>;
+
+// tolerances for well-conditioned, positive-definite inputs
+constexpr double kRelTol = 1e-10;
+constexpr double kAbsTol = 1e-12;
+
+/** Random positive-definite matrices w/ a reasonable condition number. */
+template <int kSize>
+struct Inputs {
+  using Matrix = Eigen::Matrix<double, kSize, kSize>;
+  using Vector = Eigen::Matrix<double, kSize, 1>;
+
+  // full symmetric matrices for the reference implementations
+  AlignedVector<Matrix> full;
+  // only the lower triangle is valid; the kernels must not use the rest
+  AlignedVector<Matrix> lower;
+  AlignedVector<Vector> vectors;
+
+  Inputs(size_t num, std::mt19937_64& rng)
+  {
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    auto random = [&]() { return uniform(rng); };
+    for (size_t i = 0; i < num; ++i) {
+      Matrix a = Matrix::NullaryExpr(random);
+      Matrix cov = a * a.transpose() + kSize * Matrix::Identity();
+      Matrix invalid = Matrix::NullaryExpr(random);
+      Matrix tri = cov.template triangularView<Eigen::Lower>();
+      tri.template triangularView<Eigen::StrictlyUpper>() = invalid;
+      full.push_back(cov);
+      lower.push_back(tri);
+      vectors.push_back(Vector::NullaryExpr(random));
+    }
+  }
+};
+
+template <int kSize>
+static bool benchmarkSize(size_t num, int numRepetitions, std::mt19937_64& rng)
+{
+  using Matrix = typename Inputs<kSize>::Matrix;
+
+  const Inputs<kSize> in(num, rng);
+  const std::string size = std::to_string(kSize);
+  bool isGood = true;
+
+  // determinant
+  {
+    std::vector<double> det(num), ref(num);
+    double time = bench::timeMinimum(numRepetitions, [&]() {
+      for (size_t i = 0; i < num; ++i) {
+        det[i] = symmetricDeterminant(in.lower[i]);
+      }
+    });
+    double timeRef = bench::timeMinimum(numRepetitions, [&]() {
+      for (size_t i = 0; i < num; ++i) {
+        ref[i] = in.full[i].determinant();
+      }
+    });
+    bench::Agreement agreement(kRelTol, kAbsTol);
+    for (size_t i = 0; i < num; ++i) {
+      agreement.add(det[i], ref[i]);
+    }
+    isGood &= bench::report("determinant" + size + " vs lu", "matrix", num,
+                            time, timeRef, agreement);
+  }
+  // inverse vs ldlt-based and direct inverse
+  {
+    AlignedVector<Matrix> inv(num), refLdlt(num), refInv(num);
+    double time = bench::timeMinimum(numRepetitions, [&]() {
+      for (size_t i = 0; i < num; ++i) {
+        inv[i] = symmetricInverse(in.lower[i]);
+      }
+    });
+    double timeLdlt = bench::timeMinimum(numRepetitions, [&]() {
+      for (size_t i = 0; i < num; ++i) {
+        refLdlt[i] = in.full[i].ldlt().solve(Matrix::Identity());
+      }
+    });
+    double timeInv = bench::timeMinimum(numRepetitions, [&]() {
+      for (size_t i = 0; i < num; ++i) {
+        refInv[i] = in.full[i].inverse();
+      }
+    });
+    bench::Agreement agreeLdlt(kRelTol, kAbsTol);
+    bench::Agreement agreeInv(kRelTol, kAbsTol);
+    for (size_t i = 0; i < num; ++i) {
+      agreeLdlt.addAll(inv[i], refLdlt[i]);
+      agreeInv.addAll(inv[i], refInv[i]);
+    }
+    isGood &= bench::report("inverse" + size + " vs ldlt", "matrix", num,
+                            time, timeLdlt, agreeLdlt);
+    isGood &= bench::report("inverse" + size + " vs inverse", "matrix", num,
+                            time, timeInv, agreeInv);
+  }
+  // squared mahalanobis distance vs ldlt solve
+  {
+    std::vector<double> d2(num), ref(num);
+    double time = bench::timeMinimum(numRepetitions, [&]() {
+      for (size_t i = 0; i < num; ++i) {
+        d2[i] = symmetricMahalanobisSquared(in.lower[i], in.vectors[i]);
+      }
+    });
+    double timeRef = bench::timeMinimum(numRepetitions, [&]() {
+      for (size_t i = 0; i < num; ++i) {
+        ref[i] = in.vectors[i].dot(in.full[i].ldlt().solve(in.vectors[i]));
+      }
+    });
+    bench::Agreement agreement(kRelTol, kAbsTol);
+    for (size_t i = 0; i < num; ++i) {
+      agreement.add(d2[i], ref[i]);
+    }
+    isGood &= bench::report("mahalanobis" + size + " vs ldlt", "vector", num,
+                            time, timeRef, agreement);
+  }
+  return isGood;
+}
+
+// two-dimensional distances for structure-of-arrays inputs
+static bool
+benchmarkBatch2(size_t num, int numRepetitions, std::mt19937_64& rng)
+{
+  using Array = Eigen::ArrayXd;
+
+  const Inputs<2> in(num, rng);
+  Array c00(num), c10(num), c11(num), x0(num), x1(num);
+  for (size_t i = 0; i < num; ++i) {
+    c00[i] = in.full[i](0, 0);
+    c10[i] = in.full[i](1, 0);
+    c11[i] = in.full[i](1, 1);
+    x0[i] = in.vectors[i][0];
+    x1[i] = in.vectors[i][1];
+  }
+
+  Array d2(num);
+  std::vector<double> ref(num);
+  double time = bench::timeMinimum(numRepetitions, [&]() {
+    d2 = mahalanobisSquaredBatch2(c00, c10, c11, x0, x1);
+  });
+  double timeRef = bench::timeMinimum(numRepetitions, [&]() {
+    for (size_t i = 0; i < num; ++i) {
+      ref[i] = in.vectors[i].dot(in.full[i].ldlt().solve(in.vectors[i]));
+    }
+  });
+  bench::Agreement agreement(kRelTol, kAbsTol);
+  for (size_t i = 0; i < num; ++i) {
+    agreement.add(d2[i], ref[i]);
+  }
+  return bench::report("mahalanobis2 batch vs ldlt", "vector", num, time,
+                       timeRef, agreement);
+}
+
+int main(int argc, char const* argv[])
+{
+  if (2 < argc) {
+    std::cerr << "usage: pt-bench-symmetric [NUM_MATRICES]\n";
+    return EXIT_FAILURE;
+  }
+  size_t num = (argc == 2) ? std::stoul(argv[1]) : 4096;
+  int numRepetitions = 20;
+
+  // fixed seed for reproducible inputs
+  std::mt19937_64 rng(12345);
+  bool isGood = true;
+  isGood &= benchmarkSize<1>(num, numRepetitions, rng);
+  isGood &= benchmarkSize<2>(num, numRepetitions, rng);
+  isGood &= benchmarkSize<3>(num, numRepetitions, rng);
+  isGood &= benchmarkSize<4>(num, numRepetitions, rng);
+  isGood &= benchmarkBatch2(num, numRepetitions, rng);
+  return isGood ? EXIT_SUCCESS : EXIT_FAILURE;
+}
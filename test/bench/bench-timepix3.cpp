@@ -0,0 +1,173 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+/**
+ * \file
+ * \brief Benchmark and cross-check the parallel Timepix3 decoding
+ *
+ * Writes a synthetic Timepix3 raw data file and reads it once using a
+ * single thread and once using all available threads. Compares the read
+ * throughput and the decoded events.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "io/timepix3.h"
+#include "storage/event.h"
+#include "utils/logger.h"
+#include "utils/threadpool.h"
+
+using namespace proteus;
+
+// heartbeat, i.e. time base, packets are written at a fixed cadence
+constexpr uint64_t kHeartbeatInterval = 500;
+// invalid packets that the reader must skip are mixed into the data
+constexpr uint64_t kInvalidInterval = 777;
+constexpr uint64_t kBrokenHeartbeatInterval = 901;
+// about 20 hits per 50us event w/ 1/(4096 * 40MHz) time units
+constexpr uint64_t kTimeStepMax = 800000;
+
+static void write(std::ofstream& out, uint64_t word)
+{
+  out.write(reinterpret_cast<const char*>(&word), sizeof(word));
+}
+
+/** Write a raw data file w/ randomly distributed hits. */
+static void writeSynthetic(const std::string& path, uint64_t numHits)
+{
+  std::mt19937_64 rng(12345);
+  std::uniform_int_distribution<uint64_t> timeStep(0, kTimeStepMax);
+  std::uniform_int_distribution<uint64_t> dcol(0, 127);
+  std::uniform_int_distribution<uint64_t> spix(0, 63);
+  std::uniform_int_distribution<uint64_t> pix(0, 7);
+  std::uniform_int_distribution<uint64_t> tot(0, 1023);
+  std::uniform_int_distribution<uint64_t> type(0, 1);
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("Could not open '" + path + "' to write");
+  }
+  // header magic word and header size
+  uint32_t header[2] = {1380208723, 8};
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+  uint64_t time = 0;
+  for (uint64_t i = 0; i < numHits; ++i) {
+    if ((i % kHeartbeatInterval) == 0) {
+      // least and most significant bits of the heartbeat time
+      write(out, (0x44ull << 56) | (((time >> 12) & 0xFFFFFFFFull) << 16));
+      write(out, (0x45ull << 56) | (((time >> 44) & 0xFFFFull) << 16));
+    }
+    time += timeStep(rng);
+    // pixel time within the current heartbeat period
+    uint64_t value = (time & 0x3FFFFFFFFFFull) >> 8;
+    uint64_t ftoa = 15 - (value & 0xF);
+    uint64_t toa = (value >> 4) & 0x3FFF;
+    uint64_t spidr = (value >> 18) & 0xFFFF;
+    uint64_t word = ((type(rng) ? 0xAull : 0xBull) << 60);
+    word |= (2 * dcol(rng)) << 52;
+    word |= (4 * spix(rng)) << 45;
+    word |= pix(rng) << 44;
+    word |= toa << 30;
+    word |= tot(rng) << 20;
+    word |= ftoa << 16;
+    word |= spidr;
+    write(out, word);
+    if ((i % kInvalidInterval) == 0) {
+      write(out, 0x7ull << 60);
+    }
+    if ((i % kBrokenHeartbeatInterval) == 0) {
+      write(out, (0x4ull << 60) | (0x4ull << 56) | (0x12ull << 48));
+    }
+  }
+  // incomplete trailing word
+  out.write("\x01\x02\x03", 3);
+}
+
+/** Decoded content of all events. */
+struct Decoded {
+  std::vector<uint64_t> events;
+  std::vector<int> hits;
+  uint64_t numEvents = 0;
+};
+
+static void readAll(const std::string& path, Decoded& decoded)
+{
+  decoded.events.clear();
+  decoded.hits.clear();
+  decoded.numEvents = 0;
+
+  Timepix3Reader reader(path);
+  Event event(1);
+  bool hasMore = true;
+  while (hasMore) {
+    hasMore = reader.read(event);
+    const auto& sensorEvent = event.getSensorEvent(0);
+    decoded.events.push_back(sensorEvent.frame());
+    decoded.events.push_back(sensorEvent.timestamp());
+    decoded.events.push_back(sensorEvent.numHits());
+    for (Index ihit = 0; ihit < sensorEvent.numHits(); ++ihit) {
+      const auto& hit = sensorEvent.getHit(ihit);
+      decoded.hits.push_back(hit.digitalCol());
+      decoded.hits.push_back(hit.digitalRow());
+      decoded.hits.push_back(hit.timestamp());
+      decoded.hits.push_back(hit.value());
+    }
+    decoded.numEvents += 1;
+  }
+}
+
+int main(int argc, char const* argv[])
+{
+  if ((argc < 2) or (3 < argc)) {
+    std::cerr << "usage: pt-bench-timepix3 PATH [NUM_HITS]\n";
+    return EXIT_FAILURE;
+  }
+  std::string path(argv[1]);
+  uint64_t numHits = (argc == 3) ? std::stoull(argv[2]) : 4000000;
+  int numRepetitions = 3;
+  size_t numThreads = std::max(2u, std::thread::hardware_concurrency());
+
+  // the reader reports its throughput on every close
+  globalLogger().setMinimalLevel(Logger::Level::Warning);
+  writeSynthetic(path, numHits);
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  double numMegabytes = file.tellg() / (1024. * 1024.);
+
+  Decoded parallel, serial;
+  globalThreadPool().setNumThreads(numThreads);
+  double time = bench::timeMinimum(numRepetitions,
+                                   [&]() { readAll(path, parallel); });
+  globalThreadPool().setNumThreads(1);
+  double timeRef =
+      bench::timeMinimum(numRepetitions, [&]() { readAll(path, serial); });
+
+  bench::Agreement agreement(0, 0);
+  agreement.add(parallel.numEvents, serial.numEvents);
+  agreement.add(parallel.events.size(), serial.events.size());
+  agreement.add(parallel.hits.size(), serial.hits.size());
+  if (agreement.isGood()) {
+    for (size_t i = 0; i < serial.events.size(); ++i) {
+      agreement.add(parallel.events[i], serial.events[i]);
+    }
+    for (size_t i = 0; i < serial.hits.size(); ++i) {
+      agreement.add(parallel.hits[i], serial.hits[i]);
+    }
+  }
+  std::string name =
+      "timepix3 " + std::to_string(numThreads) + " vs 1 thread(s)";
+  bool isGood =
+      bench::report(name, "MB", numMegabytes, time, timeRef, agreement);
+  std::cout << "decoded " << serial.numEvents << " events w/ "
+            << (serial.hits.size() / 4) << " hits\n";
+  return isGood ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2014-2019 The Proteus authors
+// SPDX-License-Identifier: MIT
+/**
+ * \file
+ * \brief Common helpers for the benchmark and cross-check drivers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <string>
+
+namespace proteus {
+namespace bench {
+
+/** Minimum wall-clock time of a function over several repetitions.
+ *
+ * \returns Time in seconds of the fastest repetition
+ *
+ * The minimum is less sensitive to interruptions than the average.
+ */
+template <typename Function>
+inline double timeMinimum(int numRepetitions, Function&& function)
+{
+  using Clock = std::chrono::steady_clock;
+
+  double best = std::numeric_limits<double>::max();
+  for (int i = 0; i < numRepetitions; ++i) {
+    auto start = Clock::now();
+    function();
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+/** Largest deviation between the tested and the reference values. */
+class Agreement {
+public:
+  /** \param rtol Relative tolerance
+   *  \param atol Absolute tolerance
+   */
+  Agreement(double rtol, double atol) : m_rtol(rtol), m_atol(atol) {}
+
+  /** Compare a single value to the reference value. */
+  void add(double value, double reference)
+  {
+    double deviation = std::abs(value - reference);
+    // NaN must not pass silently
+    if (not(deviation <= (m_atol + m_rtol * std::abs(reference)))) {
+      m_numFailed += 1;
+    }
+    if (std::isfinite(deviation)) {
+      m_maxDeviation = std::max(m_maxDeviation, deviation);
+    }
+  }
+  /** Compare all elements of two equally-sized Eigen objects. */
+  template <typename Value, typename Reference>
+  void addAll(const Value& value, const Reference& reference)
+  {
+    for (int i = 0; i < value.size(); ++i) {
+      add(value.data()[i], reference.data()[i]);
+    }
+  }
+
+  bool isGood() const { return (m_numFailed == 0); }
+  double maxDeviation() const { return m_maxDeviation; }
+  long numFailed() const { return m_numFailed; }
+
+private:
+  double m_rtol;
+  double m_atol;
+  double m_maxDeviation = 0;
+  long m_numFailed = 0;
+};
+
+/** Print the timing and the agreement for one comparison.
+ *
+ * \param name      Name of the compared operation
+ * \param unit      Name of the processed unit, e.g. matrix or track
+ * \param numUnits  Number of units processed by each timed call
+ * \param time      Time in seconds for the tested implementation
+ * \param reference Time in seconds for the reference implementation
+ * \returns true if the results agree
+ */
+inline bool report(const std::string& name,
+                   const std::string& unit,
+                   double numUnits,
+                   double time,
+                   double reference,
+                   const Agreement& agreement)
+{
+  std::printf("%-28s %12.4g %s/s  reference %12.4g %s/s  speedup %6.2f  "
+              "max_deviation %.3g",
+              name.c_str(), numUnits / time, unit.c_str(),
+              numUnits / reference, unit.c_str(), reference / time,
+              agreement.maxDeviation());
+  if (not agreement.isGood()) {
+    std::printf("  FAILED %ld", agreement.numFailed());
+  }
+  std::printf("\n");
+  return agreement.isGood();
+}
+
+} // namespace bench
+} // namespace proteus
@@ -0,0 +1,14 @@
+#!/bin/sh
+#
+# benchmark the optimized kernels and check them against their references
+#
+# each driver reports the throughput relative to the reference and fails if
+# the results do not agree.
+
+set -ex
+
+pt-bench-linefitter
+pt-bench-symmetric
+# synthetic raw data is written to the output directory
+mkdir -p output
+pt-bench-timepix3 output/bench-timepix3.dat
@@ -0,0 +1,15 @@
+#!/bin/sh
+#
+# compare the broken line fitter to the reference gbl fitter
+
+set -ex
+
+. ./run_common.sh
+
+for fitter in gbl3d brokenline; do
+  pt-recon ${flags} -u compare_${fitter} -g ${datasetdir}/geometry.toml \
+    ${data} ${output_prefix}compare_${fitter}
+done
+
+./fitter-checker ${output_prefix}compare_gbl3d-trees.root \
+  ${output_prefix}compare_brokenline-trees.root